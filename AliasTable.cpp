@@ -0,0 +1,57 @@
+#include "AliasTable.h"
+#include <cmath>
+
+bool AliasTable::build(const std::vector<double> &weights)
+{
+    threshold.clear();
+    alias.clear();
+
+    const size_t count = weights.size();
+    if (count == 0 || count > UINT32_MAX)
+        return false;
+
+    std::vector<double> scaled(count);
+    double sum = 0.0;
+    for (size_t k = 0; k < count; ++k)
+    {
+        const double w = weights[k];
+        scaled[k] = std::isfinite(w) && w > 0.0 ? w : 0.0;
+        sum += scaled[k];
+    }
+    if (!(sum > 0.0) || !std::isfinite(sum))
+        return false;
+
+    // Scale so the average column holds exactly 1
+    std::vector<uint32_t> small;
+    std::vector<uint32_t> large;
+    for (size_t k = 0; k < count; ++k)
+    {
+        scaled[k] = scaled[k] * static_cast<double>(count) / sum;
+        (scaled[k] < 1.0 ? small : large).push_back(static_cast<uint32_t>(k));
+    }
+
+    constexpr double FULL = 4294967296.0; // 2^32
+    threshold.assign(count, static_cast<uint64_t>(FULL));
+    alias.resize(count);
+    for (size_t k = 0; k < count; ++k)
+        alias[k] = static_cast<uint32_t>(k);
+
+    // Fill each short column up with probability from a tall one
+    while (!small.empty() && !large.empty())
+    {
+        const uint32_t lo = small.back();
+        small.pop_back();
+        const uint32_t hi = large.back();
+
+        threshold[lo] = static_cast<uint64_t>(std::llround(scaled[lo] * FULL));
+        alias[lo] = hi;
+        scaled[hi] = (scaled[hi] + scaled[lo]) - 1.0;
+        if (scaled[hi] < 1.0)
+        {
+            large.pop_back();
+            small.push_back(hi);
+        }
+    }
+    // Whatever is left over is 1 up to rounding and keeps its whole column
+    return true;
+}
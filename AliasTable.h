@@ -0,0 +1,35 @@
+#ifndef ALIAS_TABLE_H
+#define ALIAS_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Walker/Vose alias table: draws index k with probability weight[k] / sum in
+// constant time from two 32-bit random numbers, one to pick a column and one
+// to choose between the column's own index and its alias.
+//
+// Building is deterministic (no floating-point accumulation order depends on
+// anything but the weights), so the same weights always give the same table
+// and the same draws for the same random numbers.
+class AliasTable
+{
+public:
+    // Returns false if there are no weights, more than 2^32 - 1 of them, or
+    // none is positive and finite. Negative, NaN and infinite weights count as 0.
+    bool build(const std::vector<double> &weights);
+
+    size_t size() const { return alias.size(); }
+
+    uint32_t sample(uint32_t columnBits, uint32_t acceptBits) const
+    {
+        const uint32_t column = static_cast<uint32_t>((static_cast<uint64_t>(columnBits) * alias.size()) >> 32);
+        return acceptBits < threshold[column] ? column : alias[column];
+    }
+
+private:
+    std::vector<uint64_t> threshold; // Keep the column if acceptBits < threshold (out of 2^32)
+    std::vector<uint32_t> alias;
+};
+
+#endif // ALIAS_TABLE_H
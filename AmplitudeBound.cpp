@@ -0,0 +1,83 @@
+#include "AmplitudeBound.h"
+#include "WaveBank.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    constexpr size_t MAX_LEVELS = 64;
+}
+
+AmplitudeBound::AmplitudeBound(const WaveBank &waves, float threshold)
+{
+    rebuild(waves, threshold);
+}
+
+void AmplitudeBound::rebuild(const WaveBank &waves, float threshold)
+{
+    this->threshold = threshold;
+    const size_t count = waves.size();
+    magnitudes.resize(count);
+    sorted.clear();
+    for (size_t i = 0; i < count; ++i)
+    {
+        magnitudes[i] = std::abs(waves.amplitude(i));
+        if (!std::isnan(magnitudes[i]))
+            sorted.push_back(magnitudes[i]);
+    }
+    std::sort(sorted.begin(), sorted.end());
+    largest = sorted.empty() ? 0.0f : sorted.back();
+
+    // Level 0 takes everyone (NaN included); the rest sit at the quantiles
+    levels.assign(1, 0.0f);
+    const size_t levelCount = std::min(MAX_LEVELS, sorted.size());
+    for (size_t b = 1; b < levelCount; ++b)
+    {
+        const float bound = sorted[b * sorted.size() / levelCount];
+        if (bound > levels.back())
+            levels.push_back(bound);
+    }
+
+    wordCount = (count + 63) / 64;
+    masks.assign(levels.size() * wordCount, 0);
+    for (size_t j = 0; j < count; ++j)
+    {
+        // Highest level whose bound |a_j| reaches; NaN only makes level 0
+        size_t top = 0;
+        if (!std::isnan(magnitudes[j]))
+            top = static_cast<size_t>(std::upper_bound(levels.begin(), levels.end(), magnitudes[j]) - levels.begin()) - 1;
+        for (size_t b = 0; b <= top; ++b)
+            masks[b * wordCount + j / 64] |= uint64_t(1) << (j % 64);
+    }
+}
+
+size_t AmplitudeBound::levelFor(size_t i) const
+{
+    // fl(|a_i| + x) grows with x, so candidates have |a_j| above any level v
+    // with fl(|a_i| + v) <= threshold; take the highest such level
+    const float magnitude = magnitudes[i];
+    size_t low = 0;
+    size_t high = levels.size();
+    while (high - low > 1)
+    {
+        const size_t middle = (low + high) / 2;
+        if (magnitude + levels[middle] <= threshold)
+            low = middle;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+size_t AmplitudeBound::candidateEstimate(size_t i, size_t from) const
+{
+    if (!rowHasCandidates(i) || from >= magnitudes.size())
+        return 0;
+
+    const uint64_t *mask = masks.data() + levelFor(i) * wordCount;
+    size_t w = from / 64;
+    size_t total = static_cast<size_t>(__builtin_popcountll(mask[w] & (~uint64_t(0) << (from % 64))));
+    for (++w; w < wordCount; ++w)
+        total += static_cast<size_t>(__builtin_popcountll(mask[w]));
+    return total;
+}
@@ -0,0 +1,79 @@
+#ifndef AMPLITUDE_BOUND_H
+#define AMPLITUDE_BOUND_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class WaveBank;
+
+// Rules out pairs that cannot breach the threshold without sampling them.
+//
+// Every sample of a wave satisfies |s| <= |a| (|sin| <= 1, and rounding the
+// product to float cannot pass the float |a|), and float addition is
+// monotone, so each combined sample obeys
+//     |fl(s1 + s2)| <= fl(|s1| + |s2|) <= fl(|a1| + |a2|).
+// A pair can therefore only breach when fl(|a1| + |a2|) > threshold; this is
+// exact, not a heuristic, and the pairs it rejects would have been rejected by
+// sampling too.
+//
+// To avoid testing every pair, particles are split into amplitude levels at
+// the quantiles of |a|, and for each level there is a bitset of the particles
+// at or above it. A row only walks the set bits of the highest level that
+// still contains all of its candidates, so the work is close to the number of
+// candidate pairs rather than N^2. Bits are visited in index order, which keeps
+// the sweep's canonical (i, j) order.
+class AmplitudeBound
+{
+public:
+    AmplitudeBound() = default;
+    AmplitudeBound(const WaveBank &waves, float threshold);
+
+    // Recompute the bound for `waves`, reusing the memory of the previous one
+    void rebuild(const WaveBank &waves, float threshold);
+
+    // Exact test: true if pair (i, j) may breach
+    bool mayBreach(size_t i, size_t j) const { return magnitudes[i] + magnitudes[j] > threshold; }
+
+    // Upper bound on the number of candidates j >= from for row i
+    size_t candidateEstimate(size_t i, size_t from) const;
+
+    // Call visit(j) for every j >= from, ascending, for which (i, j) may breach
+    template <typename Visit>
+    void forEachCandidate(size_t i, size_t from, Visit visit) const
+    {
+        if (!rowHasCandidates(i) || from >= magnitudes.size())
+            return;
+
+        const uint64_t *mask = masks.data() + levelFor(i) * wordCount;
+        size_t w = from / 64;
+        uint64_t word = mask[w] & (~uint64_t(0) << (from % 64));
+        while (true)
+        {
+            while (word != 0)
+            {
+                const size_t j = w * 64 + static_cast<size_t>(__builtin_ctzll(word));
+                word &= word - 1;
+                if (mayBreach(i, j))
+                    visit(j);
+            }
+            if (++w >= wordCount)
+                break;
+            word = mask[w];
+        }
+    }
+
+private:
+    bool rowHasCandidates(size_t i) const { return magnitudes[i] + largest > threshold; }
+    size_t levelFor(size_t i) const;
+
+    float threshold = 0.0f;
+    float largest = 0.0f;
+    std::vector<float> magnitudes;
+    std::vector<float> sorted; // Scratch for rebuild()
+    std::vector<float> levels; // Ascending lower bounds; levels[0] admits everything
+    std::vector<uint64_t> masks; // levels.size() bitsets of wordCount words
+    size_t wordCount = 0;
+};
+
+#endif // AMPLITUDE_BOUND_H
@@ -0,0 +1,17 @@
+#ifndef ANOMALY_H
+#define ANOMALY_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// One logged anomaly: the two particles, what happened and the combined wave
+struct Anomaly {
+    std::string particle1;
+    std::string particle2;
+    std::string interactionInfo;
+    std::vector<float> waveData;
+    std::vector<std::pair<int, float>> breachPoints;
+};
+
+#endif // ANOMALY_H
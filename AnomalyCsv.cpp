@@ -0,0 +1,235 @@
+#include "AnomalyCsv.h"
+#include "MappedFile.h"
+#include "Metrics.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <iterator>
+
+namespace
+{
+    // Read one text field starting at `p`, unquoting it if needed. Returns the
+    // position after the field's delimiter, or nullptr if no delimiter follows.
+    const char *readTextField(const char *p, const char *end, std::string *out)
+    {
+        if (p < end && *p == '"')
+        {
+            if (out)
+                out->clear();
+            ++p;
+            while (p < end)
+            {
+                const char *quote = static_cast<const char *>(std::memchr(p, '"', end - p));
+                if (!quote)
+                    return nullptr;
+                if (out)
+                    out->append(p, quote);
+                p = quote + 1;
+                if (p < end && *p == '"')
+                {
+                    // Escaped quote
+                    if (out)
+                        out->push_back('"');
+                    ++p;
+                    continue;
+                }
+                break;
+            }
+            // Tolerate stray text between the closing quote and the comma
+            const char *comma = p < end ? static_cast<const char *>(std::memchr(p, ',', end - p)) : nullptr;
+            if (comma && out)
+                out->append(p, comma);
+            return comma ? comma + 1 : nullptr;
+        }
+
+        const char *comma = static_cast<const char *>(std::memchr(p, ',', end - p));
+        if (!comma)
+            return nullptr;
+        if (out)
+            out->assign(p, comma);
+        return comma + 1;
+    }
+
+    // Start of the first row that begins at or after `from`, given whether
+    // `from` lies inside a quoted field
+    const char *nextRowStart(const char *from, const char *end, bool inQuotes)
+    {
+        for (const char *p = from; p < end; ++p)
+        {
+            if (*p == '"')
+                inQuotes = !inQuotes;
+            else if (*p == '\n' && !inQuotes)
+                return p + 1;
+        }
+        return end;
+    }
+
+    void parseRows(const char *begin, const char *end, std::vector<Anomaly> &out)
+    {
+        const char *row = begin;
+        while (row < end)
+        {
+            const char *rowEnd = findCsvRowEnd(row, end);
+            Anomaly anomaly;
+            if (parseAnomalyCsvRow(row, rowEnd, anomaly))
+                out.push_back(std::move(anomaly));
+            row = rowEnd + 1;
+        }
+    }
+}
+
+void appendAnomalyCsvRow(std::string &out, const std::string &particle1, const std::string &particle2,
+                         const std::string &interactionInfo, const float *waveData, size_t sampleCount)
+{
+    out += particle1;
+    out += ',';
+    out += particle2;
+    out += ',';
+    out += interactionInfo;
+    out += ',';
+
+    // Write wave data (comma-separated values)
+    char text[32];
+    for (size_t i = 0; i < sampleCount; ++i)
+    {
+        auto result = std::to_chars(text, text + sizeof(text), waveData[i], std::chars_format::general, 6);
+        out.append(text, result.ptr);
+        if (i < sampleCount - 1)
+            out += ',';
+    }
+    out += '\n';
+}
+
+const char *findCsvRowEnd(const char *row, const char *end)
+{
+    const char *newline = static_cast<const char *>(std::memchr(row, '\n', end - row));
+    if (!newline)
+        newline = end;
+
+    // Fast path: no quotes means the first newline ends the row
+    if (!std::memchr(row, '"', newline - row))
+        return newline;
+
+    bool inQuotes = false;
+    for (const char *p = row; p < end; ++p)
+    {
+        if (*p == '"')
+            inQuotes = !inQuotes;
+        else if (*p == '\n' && !inQuotes)
+            return p;
+    }
+    return end;
+}
+
+bool isAnomalyCsvRow(const char *row, const char *rowEnd)
+{
+    const char *p = row;
+    for (int field = 0; field < 3 && p; ++field)
+        p = readTextField(p, rowEnd, nullptr);
+    return p && p < rowEnd;
+}
+
+bool parseAnomalyCsvRow(const char *row, const char *rowEnd, Anomaly &anomaly)
+{
+    const char *p = readTextField(row, rowEnd, &anomaly.particle1);
+    if (p)
+        p = readTextField(p, rowEnd, &anomaly.particle2);
+    if (p)
+        p = readTextField(p, rowEnd, &anomaly.interactionInfo);
+    if (!p || p >= rowEnd)
+        return false;
+
+    // Parse wave data
+    anomaly.waveData.reserve(anomaly.waveData.size() + (rowEnd - p) / 8);
+    while (p < rowEnd)
+    {
+        while (p < rowEnd && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '+'))
+            ++p;
+        if (p < rowEnd && *p == ',')
+        {
+            ++p; // Empty cell
+            continue;
+        }
+        if (p >= rowEnd)
+            break;
+
+        float value;
+        auto result = std::from_chars(p, rowEnd, value);
+        if (result.ec != std::errc())
+            break;
+        anomaly.waveData.push_back(value);
+
+        p = result.ptr;
+        while (p < rowEnd && (*p == ' ' || *p == '\t' || *p == '\r'))
+            ++p;
+        if (p < rowEnd && *p != ',')
+            break;
+        ++p;
+    }
+    return true;
+}
+
+bool parseAnomalyCsvRow(const std::string &line, Anomaly &anomaly)
+{
+    return parseAnomalyCsvRow(line.data(), line.data() + line.size(), anomaly);
+}
+
+std::vector<const char *> splitCsvChunks(const char *begin, const char *end, ThreadPool &pool,
+                                         size_t chunkBytes)
+{
+    // Cut the range into blocks and count the quotes in each, so every block
+    // knows whether it starts inside a quoted field
+    const size_t blockCount = std::max<size_t>(1, (end - begin + chunkBytes - 1) / chunkBytes);
+    std::vector<size_t> quotes(blockCount);
+    pool.run(blockCount, [&](size_t block) {
+        const char *from = begin + block * chunkBytes;
+        const char *to = std::min(end, from + chunkBytes);
+        quotes[block] = static_cast<size_t>(std::count(from, to, '"'));
+    });
+
+    // Move every block start forward to the next row boundary
+    std::vector<const char *> bounds(blockCount + 1, end);
+    bounds[0] = begin;
+    size_t quotesBefore = quotes[0];
+    for (size_t block = 1; block < blockCount; ++block)
+    {
+        bounds[block] = std::max(bounds[block - 1],
+                                 nextRowStart(begin + block * chunkBytes, end, quotesBefore % 2 == 1));
+        quotesBefore += quotes[block];
+    }
+    return bounds;
+}
+
+std::vector<Anomaly> loadAnomalyCsv(const std::string &fileName, size_t threads)
+{
+    RATTRAP_TIME(Load);
+    std::vector<Anomaly> anomalies;
+    MappedFile file(fileName);
+    if (!file.isOpen() || file.size() == 0)
+        return anomalies;
+
+    file.adviseSequential();
+    const char *data = file.data();
+    const char *end = data + file.size();
+
+    // Skip header
+    const char *body = findCsvRowEnd(data, end);
+    body = body < end ? body + 1 : end;
+
+    ThreadPool pool(threads);
+    std::vector<const char *> bounds = splitCsvChunks(body, end, pool, CSV_CHUNK_BYTES);
+    std::vector<std::vector<Anomaly>> parsed(bounds.size() - 1);
+    pool.run(parsed.size(), [&](size_t chunk) {
+        parseRows(bounds[chunk], bounds[chunk + 1], parsed[chunk]);
+    });
+
+    size_t total = 0;
+    for (const auto &rows : parsed)
+        total += rows.size();
+    anomalies.reserve(total);
+    for (auto &rows : parsed)
+        std::move(rows.begin(), rows.end(), std::back_inserter(anomalies));
+    RATTRAP_COUNT(AnomaliesLoaded, anomalies.size());
+    return anomalies;
+}
@@ -0,0 +1,49 @@
+#ifndef ANOMALY_CSV_H
+#define ANOMALY_CSV_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "Anomaly.h"
+
+class ThreadPool;
+
+// Header row of collisions.csv
+constexpr const char *ANOMALY_CSV_HEADER = "Particle1,Particle2,InteractionInfo,WaveData\n";
+
+// Append one collisions.csv row, newline included. Numbers are written like
+// an iostream with default precision (%g, 6 significant digits).
+void appendAnomalyCsvRow(std::string &out, const std::string &particle1, const std::string &particle2,
+                         const std::string &interactionInfo, const float *waveData, size_t sampleCount);
+
+// End of the row starting at `row`: the first newline outside double quotes,
+// or `end` if there is none
+const char *findCsvRowEnd(const char *row, const char *end);
+
+// True if [row, rowEnd) holds the three text fields followed by wave data,
+// i.e. parseAnomalyCsvRow would accept it
+bool isAnomalyCsvRow(const char *row, const char *rowEnd);
+
+// Parse one row (without its newline) into `anomaly`; false if a field is
+// missing. Text fields may be quoted ("a,b", "say ""hi"""). Wave samples are
+// read with std::from_chars; surrounding blanks and empty cells are skipped
+// and parsing stops at the first cell that is not a number, so ragged or
+// truncated rows keep the samples that could be read.
+bool parseAnomalyCsvRow(const char *row, const char *rowEnd, Anomaly &anomaly);
+bool parseAnomalyCsvRow(const std::string &line, Anomaly &anomaly);
+
+// Bytes per chunk when a CSV is split for parallel parsing
+constexpr size_t CSV_CHUNK_BYTES = size_t(4) << 20;
+
+// Split [begin, end), which must start on a row, into about chunkBytes-sized
+// pieces that each start on a row boundary, honouring quoted newlines. Returns
+// the boundaries: chunk k is [bounds[k], bounds[k + 1]). Quotes are counted on `pool`.
+std::vector<const char *> splitCsvChunks(const char *begin, const char *end, ThreadPool &pool,
+                                         size_t chunkBytes = CSV_CHUNK_BYTES);
+
+// Read every anomaly in a collisions.csv file, skipping the header row.
+// The file is mapped, cut into row-aligned chunks and parsed on `threads`
+// threads (0 = every core); the result is in file order.
+std::vector<Anomaly> loadAnomalyCsv(const std::string &fileName, size_t threads = 0);
+
+#endif // ANOMALY_CSV_H
@@ -0,0 +1,456 @@
+#include "AnomalyFile.h"
+#include "AnomalyCsv.h"
+#include "Particles.h"
+#include "Metrics.h"
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr uint64_t BLOCK_ALIGNMENT = 64;
+
+    uint64_t alignUp(uint64_t value)
+    {
+        return (value + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT;
+    }
+
+    // start + count * size <= limit, without overflowing
+    bool fitsBefore(uint64_t start, uint64_t count, uint64_t size, uint64_t limit)
+    {
+        uint64_t bytes, end;
+        return !__builtin_mul_overflow(count, size, &bytes) && !__builtin_add_overflow(start, bytes, &end) &&
+               end <= limit;
+    }
+
+    // Header checks shared by the reader and the appending writer. The tables
+    // are read in place, so their offsets must suit the types stored there.
+    bool validHeader(const AnomalyFileHeader &header, uint64_t fileSize)
+    {
+        if (std::memcmp(header.magic, ANOMALY_FILE_MAGIC, sizeof(header.magic)) != 0)
+            return false;
+        if (header.version != ANOMALY_FILE_VERSION || header.recordOffset == 0)
+            return false;
+        if (header.recordCount > 0 && header.waveStride < uint64_t(header.sampleCount) * sizeof(float))
+            return false;
+        if (header.waveOffset % alignof(float) != 0 || header.waveStride % alignof(float) != 0 ||
+            header.recordOffset % alignof(AnomalyFileRecord) != 0 || header.stringOffset % alignof(uint32_t) != 0)
+            return false;
+        return header.waveOffset >= sizeof(AnomalyFileHeader) &&
+               fitsBefore(header.waveOffset, header.recordCount, header.waveStride, header.recordOffset) &&
+               fitsBefore(header.recordOffset, header.recordCount, sizeof(AnomalyFileRecord), header.stringOffset) &&
+               fitsBefore(header.stringOffset, 1, header.stringBytes, fileSize) &&
+               header.stringBytes >= sizeof(uint32_t);
+    }
+}
+
+std::string anomalyJournalName(const std::string &fileName)
+{
+    return fileName + ".journal";
+}
+
+bool writeAnomalyJournal(const std::string &fileName, const std::string &tail)
+{
+    const std::string journalName = anomalyJournalName(fileName);
+    const std::string tempName = journalName + ".tmp";
+    std::FILE *output = std::fopen(tempName.c_str(), "wb");
+    if (!output)
+    {
+        std::cerr << "Error opening " << tempName << " for writing." << std::endl;
+        return false;
+    }
+    bool ok = std::fwrite(tail.data(), 1, tail.size(), output) == tail.size() && std::fflush(output) == 0 &&
+              fsync(fileno(output)) == 0;
+    ok = std::fclose(output) == 0 && ok;
+    if (!ok || std::rename(tempName.c_str(), journalName.c_str()) != 0)
+    {
+        std::cerr << "Error writing " << journalName << "." << std::endl;
+        std::remove(tempName.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool readAnomalyJournal(const std::string &fileName, std::string &tail)
+{
+    std::ifstream input(anomalyJournalName(fileName), std::ios::binary);
+    if (!input.is_open())
+        return false;
+    tail.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    return !input.bad();
+}
+
+bool AnomalyFileWriter::open(const std::string &fileName)
+{
+    close();
+    records.clear();
+    strings.clear();
+    stringIds.clear();
+
+    if (!loadExisting(fileName))
+        return false;
+
+    if (!file)
+    {
+        file = std::fopen(fileName.c_str(), "w+b");
+        if (!file)
+        {
+            std::cerr << "Error opening " << fileName << " for writing." << std::endl;
+            return false;
+        }
+        header = AnomalyFileHeader{};
+        std::memcpy(header.magic, ANOMALY_FILE_MAGIC, sizeof(header.magic));
+        header.version = ANOMALY_FILE_VERSION;
+        header.waveOffset = sizeof(AnomalyFileHeader);
+    }
+
+    // Keep the file's current tail in the journal until close() replaces it
+    std::string tail;
+    finalTail(tail);
+    if (!writeAnomalyJournal(fileName, tail))
+    {
+        std::fclose(file);
+        file = nullptr;
+        return false;
+    }
+    journalName = anomalyJournalName(fileName);
+
+    // Mark the file as open (recordOffset == 0) until close() writes the tables
+    AnomalyFileHeader openHeader = header;
+    openHeader.recordOffset = 0;
+    std::fseek(file, 0, SEEK_SET);
+    std::fwrite(&openHeader, sizeof(openHeader), 1, file);
+    fseeko(file, off_t(header.waveOffset + header.recordCount * header.waveStride), SEEK_SET);
+    return true;
+}
+
+bool AnomalyFileWriter::prepareAppend(const std::string &fileName)
+{
+    AnomalyFileReader existing;
+    if (existing.open(fileName))
+        return true;
+
+    // Missing and empty files are started from scratch
+    {
+        std::ifstream probe(fileName, std::ios::binary | std::ios::ate);
+        if (!probe.is_open() || probe.tellg() == 0)
+            return true;
+    }
+
+    // Left open by a run that died: go back to the tail in the journal
+    std::string tail;
+    AnomalyFileHeader closed;
+    if (readAnomalyJournal(fileName, tail) && tail.size() >= sizeof(closed))
+    {
+        std::memcpy(&closed, tail.data(), sizeof(closed));
+        if (validHeader(closed, closed.recordOffset + (tail.size() - sizeof(closed))) && restore(fileName, tail) &&
+            existing.open(fileName))
+        {
+            std::cerr << fileName << " was left incomplete by an interrupted run; restored its " << existing.size()
+                      << " earlier records." << std::endl;
+            return true;
+        }
+    }
+    std::cerr << fileName << " is not a complete anomaly file and has no usable journal; not appending to it."
+              << std::endl;
+    return false;
+}
+
+bool AnomalyFileWriter::loadExisting(const std::string &fileName)
+{
+    if (!prepareAppend(fileName))
+        return false;
+
+    // Missing and empty files are started from scratch
+    AnomalyFileReader existing;
+    if (!existing.open(fileName))
+        return true;
+
+    header = existing.fileHeader();
+    for (size_t i = 0; i < existing.size(); ++i)
+        records.push_back(existing.record(i));
+    for (uint32_t id = 0; id < existing.stringTableSize(); ++id)
+    {
+        strings.emplace_back(existing.string(id));
+        stringIds.emplace(strings.back(), id);
+    }
+
+    file = std::fopen(fileName.c_str(), "r+b");
+    if (!file)
+    {
+        std::cerr << "Error opening " << fileName << " for writing." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+uint32_t AnomalyFileWriter::intern(const std::string &text)
+{
+    auto found = stringIds.find(text);
+    if (found != stringIds.end())
+        return found->second;
+
+    uint32_t id = static_cast<uint32_t>(strings.size());
+    strings.push_back(text);
+    stringIds.emplace(text, id);
+    return id;
+}
+
+bool AnomalyFileWriter::write(const std::string &particle1, const std::string &particle2,
+                              const std::string &interactionInfo, const float *waveData, size_t sampleCount)
+{
+    if (!file)
+        return false;
+
+    if (header.recordCount == 0)
+    {
+        header.sampleCount = static_cast<uint32_t>(sampleCount);
+        header.waveStride = alignUp(sampleCount * sizeof(float));
+    }
+    else if (sampleCount != header.sampleCount)
+    {
+        std::cerr << "Anomaly wave has " << sampleCount << " samples, file expects "
+                  << header.sampleCount << "; record skipped." << std::endl;
+        return false;
+    }
+
+    AnomalyFileRecord record{};
+    record.particle1 = intern(particle1);
+    record.particle2 = intern(particle2);
+    record.interactionInfo = intern(interactionInfo);
+    for (size_t i = 0; i < sampleCount; ++i)
+    {
+        float magnitude = std::abs(waveData[i]);
+        if (magnitude > Particle::AMPLITUDE_THRESHOLD)
+            ++record.breachCount;
+        if (magnitude > record.peakAmplitude)
+            record.peakAmplitude = magnitude;
+    }
+
+    RATTRAP_TIME(FileWrite);
+    RATTRAP_COUNT(BytesWritten, header.waveStride);
+    padding.resize(header.waveStride - sampleCount * sizeof(float), 0);
+    std::fwrite(waveData, sizeof(float), sampleCount, file);
+    if (!padding.empty())
+        std::fwrite(padding.data(), 1, padding.size(), file);
+
+    records.push_back(record);
+    ++header.recordCount;
+    return true;
+}
+
+void AnomalyFileWriter::finalTables(AnomalyFileHeader &closed, std::string &tables) const
+{
+    closed = header;
+    closed.recordOffset = header.waveOffset + header.recordCount * header.waveStride;
+    tables.assign(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(AnomalyFileRecord));
+
+    // String table: count, offsets, bytes
+    std::vector<uint32_t> offsets;
+    offsets.reserve(strings.size() + 1);
+    uint32_t offset = 0;
+    for (const std::string &text : strings)
+    {
+        offsets.push_back(offset);
+        offset += static_cast<uint32_t>(text.size());
+    }
+    offsets.push_back(offset);
+
+    uint32_t stringCount = static_cast<uint32_t>(strings.size());
+    closed.stringOffset = closed.recordOffset + tables.size();
+    tables.append(reinterpret_cast<const char *>(&stringCount), sizeof(stringCount));
+    tables.append(reinterpret_cast<const char *>(offsets.data()), offsets.size() * sizeof(uint32_t));
+    for (const std::string &text : strings)
+        tables += text;
+    closed.stringBytes = sizeof(uint32_t) * (offsets.size() + 1) + offset;
+}
+
+void AnomalyFileWriter::finalTail(std::string &tail) const
+{
+    AnomalyFileHeader closed;
+    std::string tables;
+    finalTables(closed, tables);
+    tail.assign(reinterpret_cast<const char *>(&closed), sizeof(closed));
+    tail += tables;
+}
+
+bool AnomalyFileWriter::close()
+{
+    if (!file)
+        return true;
+
+    RATTRAP_TIME(FileWrite);
+    std::string tables;
+    finalTables(header, tables);
+    fseeko(file, off_t(header.recordOffset), SEEK_SET);
+    std::fwrite(tables.data(), 1, tables.size(), file);
+    RATTRAP_COUNT(BytesWritten, tables.size());
+
+    std::fseek(file, 0, SEEK_SET);
+    std::fwrite(&header, sizeof(header), 1, file);
+    bool ok = std::ferror(file) == 0 && std::fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = std::fclose(file) == 0 && ok;
+    file = nullptr;
+
+    // The file is complete again; a failed close keeps the journal to roll back to
+    if (ok)
+        std::remove(journalName.c_str());
+    return ok;
+}
+
+bool AnomalyFileWriter::checkpoint(std::string &tail)
+{
+    if (!file)
+        return false;
+
+    finalTail(tail);
+    return std::fflush(file) == 0 && fsync(fileno(file)) == 0;
+}
+
+bool AnomalyFileWriter::restore(const std::string &fileName, const std::string &tail)
+{
+    AnomalyFileHeader closed;
+    if (tail.size() < sizeof(closed))
+        return false;
+    std::memcpy(&closed, tail.data(), sizeof(closed));
+
+    // The wave blocks must still all be there; anything after them is from after the checkpoint
+    std::FILE *output = std::fopen(fileName.c_str(), "r+b");
+    if (!output)
+        return false;
+    bool ok = fseeko(output, 0, SEEK_END) == 0 && static_cast<uint64_t>(ftello(output)) >= closed.recordOffset &&
+              ftruncate(fileno(output), off_t(closed.recordOffset)) == 0;
+    if (ok)
+    {
+        fseeko(output, off_t(closed.recordOffset), SEEK_SET);
+        std::fwrite(tail.data() + sizeof(closed), 1, tail.size() - sizeof(closed), output);
+        std::fseek(output, 0, SEEK_SET);
+        std::fwrite(&closed, sizeof(closed), 1, output);
+        ok = std::ferror(output) == 0;
+    }
+    ok = std::fclose(output) == 0 && ok;
+    return ok;
+}
+
+bool AnomalyFileReader::isAnomalyFile(const std::string &fileName)
+{
+    std::ifstream probe(fileName, std::ios::binary);
+    char magic[sizeof(ANOMALY_FILE_MAGIC)] = {};
+    probe.read(magic, sizeof(magic));
+    return probe.gcount() == sizeof(magic) && std::memcmp(magic, ANOMALY_FILE_MAGIC, sizeof(magic)) == 0;
+}
+
+bool AnomalyFileReader::open(const std::string &fileName)
+{
+    header = nullptr;
+    if (!file.open(fileName) || file.size() < sizeof(AnomalyFileHeader))
+        return false;
+
+    const auto *candidate = reinterpret_cast<const AnomalyFileHeader *>(file.data());
+    if (!validHeader(*candidate, file.size()))
+        return false;
+
+    const char *table = file.data() + candidate->stringOffset;
+    std::memcpy(&stringCount, table, sizeof(stringCount));
+    uint64_t offsetBytes = (uint64_t(stringCount) + 1) * sizeof(uint32_t);
+    if (sizeof(uint32_t) + offsetBytes > candidate->stringBytes)
+        return false;
+
+    // Strings must run in order and end inside the table
+    stringOffsets = reinterpret_cast<const uint32_t *>(table + sizeof(uint32_t));
+    stringData = table + sizeof(uint32_t) + offsetBytes;
+    if (stringOffsets[stringCount] > candidate->stringBytes - sizeof(uint32_t) - offsetBytes)
+        return false;
+    for (uint32_t id = 0; id < stringCount; ++id)
+    {
+        if (stringOffsets[id] > stringOffsets[id + 1])
+            return false;
+    }
+
+    // Every record must name strings that exist
+    records = reinterpret_cast<const AnomalyFileRecord *>(file.data() + candidate->recordOffset);
+    for (uint64_t i = 0; i < candidate->recordCount; ++i)
+    {
+        const AnomalyFileRecord &entry = records[i];
+        if (entry.particle1 >= stringCount || entry.particle2 >= stringCount || entry.interactionInfo >= stringCount)
+            return false;
+    }
+    header = candidate;
+    return true;
+}
+
+Anomaly AnomalyFileReader::decode(size_t index) const
+{
+    Anomaly anomaly;
+    const AnomalyFileRecord &entry = records[index];
+    anomaly.particle1 = string(entry.particle1);
+    anomaly.particle2 = string(entry.particle2);
+    anomaly.interactionInfo = string(entry.interactionInfo);
+
+    const float *samples = wave(index);
+    anomaly.waveData.assign(samples, samples + header->sampleCount);
+    return anomaly;
+}
+
+bool convertCsvToAnomalyFile(const std::string &csvFileName, const std::string &anomalyFileName)
+{
+    MappedFile input(csvFileName);
+    if (!input.isOpen())
+        return false;
+    input.adviseSequential();
+
+    std::remove(anomalyFileName.c_str());
+    AnomalyFileWriter writer;
+    if (!writer.open(anomalyFileName))
+        return false;
+
+    // Skip header, then stream the rows straight from the mapping
+    const char *end = input.data() + input.size();
+    const char *row = input.size() > 0 ? findCsvRowEnd(input.data(), end) + 1 : end;
+    Anomaly anomaly;
+    while (row < end)
+    {
+        const char *rowEnd = findCsvRowEnd(row, end);
+        anomaly.particle1.clear();
+        anomaly.particle2.clear();
+        anomaly.interactionInfo.clear();
+        anomaly.waveData.clear();
+        if (parseAnomalyCsvRow(row, rowEnd, anomaly))
+            writer.write(anomaly.particle1, anomaly.particle2, anomaly.interactionInfo,
+                         anomaly.waveData.data(), anomaly.waveData.size());
+        row = rowEnd + 1;
+    }
+    return writer.close();
+}
+
+bool convertAnomalyFileToCsv(const std::string &anomalyFileName, const std::string &csvFileName)
+{
+    AnomalyFileReader reader;
+    if (!reader.open(anomalyFileName))
+        return false;
+
+    std::FILE *output = std::fopen(csvFileName.c_str(), "wb");
+    if (!output)
+        return false;
+
+    std::string buffer = ANOMALY_CSV_HEADER;
+    for (size_t i = 0; i < reader.size(); ++i)
+    {
+        const AnomalyFileRecord &record = reader.record(i);
+        appendAnomalyCsvRow(buffer, std::string(reader.string(record.particle1)),
+                            std::string(reader.string(record.particle2)),
+                            std::string(reader.string(record.interactionInfo)),
+                            reader.wave(i), reader.sampleCount());
+        if (buffer.size() >= (size_t(1) << 20))
+        {
+            std::fwrite(buffer.data(), 1, buffer.size(), output);
+            buffer.clear();
+        }
+    }
+    std::fwrite(buffer.data(), 1, buffer.size(), output);
+    return std::fclose(output) == 0;
+}
@@ -0,0 +1,165 @@
+#ifndef ANOMALY_FILE_H
+#define ANOMALY_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "Anomaly.h"
+#include "MappedFile.h"
+
+// Binary anomaly file (.rta), a columnar alternative to collisions.csv that
+// can be memory-mapped and read in place.
+//
+//   AnomalyFileHeader        64 bytes
+//   wave blocks              recordCount blocks of waveStride bytes; each holds
+//                            sampleCount float32 samples, zero padded, and
+//                            starts on a 64-byte boundary
+//   AnomalyFileRecord[]      one per anomaly, same order as the wave blocks
+//   string table             uint32 count, uint32 offsets[count + 1], then the
+//                            bytes of every string back to back (no NULs)
+//
+// All values are little-endian. A file whose recordOffset is 0 was not closed
+// properly and is rejected by the reader.
+//
+// Appending overwrites the old tables with new wave blocks, so while a writer
+// has the file open, <file>.journal holds the tail (final header and tables)
+// of the last complete version. It is written before the file is touched and
+// removed once close() has finished; if a run dies in between, the next
+// writer rolls the file back to it and only the interrupted run's records are
+// lost. The compact format (.rtc) does the same.
+
+constexpr char ANOMALY_FILE_MAGIC[8] = {'R', 'T', 'A', 'N', 'O', 'M', 'L', 'Y'};
+constexpr uint32_t ANOMALY_FILE_VERSION = 1;
+
+struct AnomalyFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t sampleCount;    // Samples in every wave block
+    uint64_t recordCount;
+    uint64_t waveOffset;     // First wave block
+    uint64_t waveStride;     // Bytes from one wave block to the next
+    uint64_t recordOffset;   // AnomalyFileRecord table
+    uint64_t stringOffset;   // String table
+    uint64_t stringBytes;    // Size of the string table
+};
+static_assert(sizeof(AnomalyFileHeader) == 64, "AnomalyFileHeader must stay 64 bytes");
+
+struct AnomalyFileRecord
+{
+    uint32_t particle1;        // String table index
+    uint32_t particle2;        // String table index
+    uint32_t interactionInfo;  // String table index
+    uint32_t breachCount;      // Samples above the amplitude threshold
+    float peakAmplitude;       // Largest |sample|
+    uint32_t reserved;
+};
+static_assert(sizeof(AnomalyFileRecord) == 24, "AnomalyFileRecord must stay 24 bytes");
+
+// Streams anomalies into a .rta file. Wave blocks go straight to disk; the
+// record and string tables are kept in memory and written by close(). Opening
+// an existing, properly closed file appends to it, like the CSV log does.
+class AnomalyFileWriter
+{
+public:
+    AnomalyFileWriter() = default;
+    ~AnomalyFileWriter() { close(); }
+
+    AnomalyFileWriter(const AnomalyFileWriter &) = delete;
+    AnomalyFileWriter &operator=(const AnomalyFileWriter &) = delete;
+
+    bool open(const std::string &fileName);
+    bool isOpen() const { return file != nullptr; }
+
+    // Make sure open() can append to `fileName`, rolling back a run that died
+    // before close(). False, with a message, if the file exists but is
+    // neither complete nor recoverable from its journal.
+    static bool prepareAppend(const std::string &fileName);
+
+    // Append one anomaly. Every wave in a file has the same sample count; the
+    // first record fixes it and mismatching waves are rejected.
+    bool write(const std::string &particle1, const std::string &particle2,
+               const std::string &interactionInfo, const float *waveData, size_t sampleCount);
+
+    // Write the tables and the final header, then close the file
+    bool close();
+
+    // Make the wave blocks written so far durable and set `tail` to what
+    // close() would write now: the final header, then the tables that go at
+    // its recordOffset. restore() uses it to put the file back in that state.
+    bool checkpoint(std::string &tail);
+
+    // Cut `fileName` back to the wave blocks covered by a checkpoint() tail
+    // and write that tail's tables and header, leaving a complete file
+    static bool restore(const std::string &fileName, const std::string &tail);
+
+private:
+    // The header and tables close() would write
+    void finalTables(AnomalyFileHeader &closed, std::string &tables) const;
+    void finalTail(std::string &tail) const;
+    uint32_t intern(const std::string &text);
+    bool loadExisting(const std::string &fileName);
+
+    std::FILE *file = nullptr;
+    std::string journalName;
+    AnomalyFileHeader header{};
+    std::vector<AnomalyFileRecord> records;
+    std::vector<std::string> strings;
+    std::unordered_map<std::string, uint32_t> stringIds;
+    std::vector<char> padding;
+};
+
+// Zero-copy view of a .rta file. open() checks the tables before anything is
+// read through them: every offset in bounds, strings in order and every
+// record's string IDs below stringTableSize().
+class AnomalyFileReader
+{
+public:
+    // True if the file starts with the .rta magic
+    static bool isAnomalyFile(const std::string &fileName);
+
+    bool open(const std::string &fileName);
+    bool isOpen() const { return header != nullptr; }
+
+    const AnomalyFileHeader &fileHeader() const { return *header; }
+    size_t size() const { return header ? header->recordCount : 0; }
+    uint32_t stringTableSize() const { return stringCount; }
+    uint32_t sampleCount() const { return header ? header->sampleCount : 0; }
+
+    const AnomalyFileRecord &record(size_t index) const { return records[index]; }
+    const float *wave(size_t index) const
+    {
+        return reinterpret_cast<const float *>(file.data() + header->waveOffset + index * header->waveStride);
+    }
+    std::string_view string(uint32_t id) const
+    {
+        return std::string_view(stringData + stringOffsets[id], stringOffsets[id + 1] - stringOffsets[id]);
+    }
+
+    // Copy record `index` into an Anomaly
+    Anomaly decode(size_t index) const;
+
+private:
+    MappedFile file;
+    const AnomalyFileHeader *header = nullptr;
+    const AnomalyFileRecord *records = nullptr;
+    const uint32_t *stringOffsets = nullptr;
+    const char *stringData = nullptr;
+    uint32_t stringCount = 0;
+};
+
+// The journal kept beside an anomaly file while it is appended to. Writing
+// goes through a temporary file and a rename, so a journal is never partial.
+std::string anomalyJournalName(const std::string &fileName);
+bool writeAnomalyJournal(const std::string &fileName, const std::string &tail);
+bool readAnomalyJournal(const std::string &fileName, std::string &tail);
+
+// Convert between collisions.csv and .rta; false if the input cannot be read
+bool convertCsvToAnomalyFile(const std::string &csvFileName, const std::string &anomalyFileName);
+bool convertAnomalyFileToCsv(const std::string &anomalyFileName, const std::string &csvFileName);
+
+#endif // ANOMALY_FILE_H
@@ -0,0 +1,306 @@
+#include "AnomalyStore.h"
+#include "AnomalyCsv.h"
+#include "Metrics.h"
+#include "Particles.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+    constexpr char INDEX_MAGIC[8] = {'R', 'T', 'C', 'S', 'V', 'I', 'D', 'X'};
+    constexpr size_t FINGERPRINT_BYTES = 4096;
+
+    // Layout of "<file>.idx": this header, then rowCount uint64 row offsets
+    struct IndexHeader
+    {
+        char magic[8];
+        uint64_t scannedBytes; // Prefix of the CSV covered by the index (ends on a newline)
+        uint64_t fingerprint;  // Hash of the first and last FINGERPRINT_BYTES of that prefix
+        uint64_t rowCount;
+    };
+
+    // FNV-1a over both ends of the indexed prefix, to notice a CSV that was
+    // replaced rather than appended to, including one rewritten after an
+    // unchanged first block
+    uint64_t fingerprint(const char *data, size_t size)
+    {
+        uint64_t hash = 1469598103934665603ull;
+        auto mix = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+            {
+                hash ^= static_cast<unsigned char>(data[i]);
+                hash *= 1099511628211ull;
+            }
+        };
+        mix(0, std::min(size, FINGERPRINT_BYTES));
+        mix(size - std::min(size, FINGERPRINT_BYTES), size);
+        return hash;
+    }
+}
+
+AnomalyStore::AnomalyStore(size_t cacheCapacity, size_t prefetchRadius)
+    : cacheCapacity(std::max<size_t>(1, cacheCapacity)), prefetchRadius(prefetchRadius)
+{
+    if (prefetchRadius > 0)
+        prefetcher = std::thread(&AnomalyStore::prefetchLoop, this);
+}
+
+AnomalyStore::~AnomalyStore()
+{
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        stopping = true;
+    }
+    prefetchWake.notify_all();
+    if (prefetcher.joinable())
+        prefetcher.join();
+}
+
+bool AnomalyStore::open(const std::string &fileName)
+{
+    RATTRAP_TIME(Load);
+    bool ok;
+    if (AnomalyFileReader::isAnomalyFile(fileName))
+        ok = binary.open(fileName);
+    else if (CompactAnomalyFileReader::isCompactAnomalyFile(fileName))
+        ok = compact.open(fileName);
+    else
+        ok = indexCsv(fileName);
+    RATTRAP_COUNT(AnomaliesLoaded, size());
+    return ok;
+}
+
+size_t AnomalyStore::size() const
+{
+    if (compact.isOpen())
+        return compact.size();
+    return binary.isOpen() ? binary.size() : rowOffsets.size();
+}
+
+bool AnomalyStore::indexCsv(const std::string &fileName)
+{
+    rowOffsets.clear();
+    if (!csv.open(fileName))
+        return false;
+
+    const std::string indexName = fileName + ".idx";
+    if (loadSidecar(indexName, csv.size()))
+        return true;
+
+    // Skip header
+    const char *data = csv.data();
+    const char *headerEnd = findCsvRowEnd(data, data + csv.size());
+    if (headerEnd == data + csv.size())
+        return true;
+
+    csv.adviseSequential();
+    scanRows(static_cast<size_t>(headerEnd - data) + 1);
+    saveSidecar(indexName);
+    return true;
+}
+
+void AnomalyStore::scanRows(size_t from)
+{
+    const char *data = csv.data();
+    const char *end = data + csv.size();
+
+    // Scan row-aligned chunks in parallel and append their offsets in order
+    ThreadPool pool;
+    std::vector<const char *> bounds = splitCsvChunks(data + from, end, pool);
+    std::vector<std::vector<uint64_t>> found(bounds.size() - 1);
+    pool.run(found.size(), [&](size_t chunk) {
+        const char *row = bounds[chunk];
+        while (row < bounds[chunk + 1])
+        {
+            const char *rowEnd = findCsvRowEnd(row, end);
+            if (isAnomalyCsvRow(row, rowEnd))
+                found[chunk].push_back(static_cast<uint64_t>(row - data));
+            row = rowEnd + 1;
+        }
+    });
+
+    for (const auto &offsets : found)
+        rowOffsets.insert(rowOffsets.end(), offsets.begin(), offsets.end());
+}
+
+bool AnomalyStore::loadSidecar(const std::string &indexName, uint64_t sourceSize)
+{
+    std::ifstream input(indexName, std::ios::binary | std::ios::ate);
+    IndexHeader header;
+    const std::streamoff indexSize = input.tellg();
+    if (indexSize < static_cast<std::streamoff>(sizeof(header)) || !input.seekg(0) ||
+        !input.read(reinterpret_cast<char *>(&header), sizeof(header)))
+        return false;
+
+    const char *data = csv.data();
+    if (std::memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+        header.scannedBytes == 0 || header.scannedBytes > sourceSize ||
+        data[header.scannedBytes - 1] != '\n' ||
+        header.fingerprint != fingerprint(data, header.scannedBytes))
+        return false;
+
+    // The offsets must all be in the sidecar, ascending and inside the
+    // scanned prefix; anything else is rebuilt by a rescan
+    const uint64_t offsetBytes = static_cast<uint64_t>(indexSize) - sizeof(header);
+    if (header.rowCount != offsetBytes / sizeof(uint64_t))
+        return false;
+    rowOffsets.resize(header.rowCount);
+    bool valid = static_cast<bool>(
+        input.read(reinterpret_cast<char *>(rowOffsets.data()), header.rowCount * sizeof(uint64_t)));
+    for (size_t i = 0; valid && i < rowOffsets.size(); ++i)
+        valid = rowOffsets[i] < header.scannedBytes && (i == 0 || rowOffsets[i - 1] < rowOffsets[i]);
+    if (!valid)
+    {
+        rowOffsets.clear();
+        return false;
+    }
+
+    // The CSV is append-only: index whatever was written since the sidecar was saved
+    if (header.scannedBytes < sourceSize)
+    {
+        scanRows(header.scannedBytes);
+        saveSidecar(indexName);
+    }
+    return true;
+}
+
+void AnomalyStore::saveSidecar(const std::string &indexName) const
+{
+    // Only rows that end in a newline are final; a partial last row is rescanned next time
+    const char *data = csv.data();
+    size_t scanned = csv.size();
+    while (scanned > 0 && data[scanned - 1] != '\n')
+        --scanned;
+    if (scanned == 0)
+        return;
+
+    size_t rows = rowOffsets.size();
+    while (rows > 0 && rowOffsets[rows - 1] >= scanned)
+        --rows;
+
+    IndexHeader header;
+    std::memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.scannedBytes = scanned;
+    header.fingerprint = fingerprint(data, scanned);
+    header.rowCount = rows;
+
+    // Write to a temporary file and rename, so readers never see half an index
+    const std::string tempName = indexName + ".tmp";
+    {
+        std::ofstream output(tempName, std::ios::binary | std::ios::trunc);
+        if (!output.is_open())
+            return;
+        output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        output.write(reinterpret_cast<const char *>(rowOffsets.data()), rows * sizeof(uint64_t));
+        if (!output)
+            return;
+    }
+    std::rename(tempName.c_str(), indexName.c_str());
+}
+
+std::shared_ptr<const Anomaly> AnomalyStore::decode(size_t index) const
+{
+    RATTRAP_TIME(Decode);
+    auto anomaly = std::make_shared<Anomaly>();
+    if (compact.isOpen())
+    {
+        // Breach points come with the record
+        *anomaly = compact.decode(index);
+        return anomaly;
+    }
+
+    if (binary.isOpen())
+    {
+        *anomaly = binary.decode(index);
+    }
+    else
+    {
+        const char *data = csv.data();
+        const char *row = data + rowOffsets[index];
+        const char *end = data + csv.size();
+        parseAnomalyCsvRow(row, findCsvRowEnd(row, end), *anomaly);
+    }
+    anomaly->breachPoints = Particle::checkAmplitudeBreach(anomaly->waveData);
+    return anomaly;
+}
+
+std::shared_ptr<const Anomaly> AnomalyStore::lookup(size_t index)
+{
+    auto found = cacheIndex.find(index);
+    if (found == cacheIndex.end())
+        return nullptr;
+    cache.splice(cache.begin(), cache, found->second);
+    return found->second->second;
+}
+
+void AnomalyStore::insert(size_t index, std::shared_ptr<const Anomaly> anomaly)
+{
+    if (cacheIndex.count(index))
+        return;
+    cache.emplace_front(index, std::move(anomaly));
+    cacheIndex[index] = cache.begin();
+    if (cache.size() > cacheCapacity)
+    {
+        cacheIndex.erase(cache.back().first);
+        cache.pop_back();
+    }
+}
+
+std::shared_ptr<const Anomaly> AnomalyStore::get(size_t index)
+{
+    std::shared_ptr<const Anomaly> anomaly;
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        anomaly = lookup(index);
+    }
+
+    if (!anomaly)
+    {
+        anomaly = decode(index);
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        insert(index, anomaly);
+    }
+
+    if (prefetcher.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            prefetchCenter = index;
+            prefetchPending = true;
+        }
+        prefetchWake.notify_one();
+    }
+    return anomaly;
+}
+
+void AnomalyStore::prefetchLoop()
+{
+    std::unique_lock<std::mutex> lock(cacheMutex);
+    while (true)
+    {
+        prefetchWake.wait(lock, [this] { return prefetchPending || stopping; });
+        if (stopping)
+            return;
+
+        const size_t center = prefetchCenter;
+        prefetchPending = false;
+
+        // Nearest neighbours first; give up as soon as a newer request arrives
+        for (size_t distance = 1; distance <= prefetchRadius && !prefetchPending && !stopping; ++distance)
+        {
+            for (size_t index : {center + distance, center - distance})
+            {
+                if (index >= size() || cacheIndex.count(index))
+                    continue;
+
+                lock.unlock();
+                auto anomaly = decode(index);
+                lock.lock();
+                insert(index, std::move(anomaly));
+            }
+        }
+    }
+}
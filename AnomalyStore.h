@@ -0,0 +1,84 @@
+#ifndef ANOMALY_STORE_H
+#define ANOMALY_STORE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "Anomaly.h"
+#include "AnomalyFile.h"
+#include "CompactAnomalyFile.h"
+#include "MappedFile.h"
+
+// Random access to the anomalies in a collisions.csv, .rta or .rtc file
+// without decoding the whole file up front.
+//
+// .rta and .rtc files are indexed by construction; .rtc waves are rebuilt
+// from their parameters when a record is decoded. For CSV, the byte offset of every
+// row is found in one memchr pass over the mapped file and saved next to it
+// as "<file>.idx"; later opens reuse that index, and only scan the appended
+// tail when the CSV has grown since. An index that does not fit the CSV
+// (other bytes at either end of the indexed part, offsets out of order or
+// out of range) is thrown away and rebuilt by a full scan. Records are
+// decoded when asked for and kept in a small LRU cache, and a background
+// thread decodes the neighbours of the last record requested so paging back
+// and forth does not wait.
+// Decoded records always carry their breach points.
+class AnomalyStore
+{
+public:
+    explicit AnomalyStore(size_t cacheCapacity = 64, size_t prefetchRadius = 2);
+    ~AnomalyStore();
+
+    AnomalyStore(const AnomalyStore &) = delete;
+    AnomalyStore &operator=(const AnomalyStore &) = delete;
+
+    // Index `fileName`; false if it cannot be read
+    bool open(const std::string &fileName);
+
+    size_t size() const;
+
+    // Decoded record `index` (must be < size()); also queues its neighbours for prefetch
+    std::shared_ptr<const Anomaly> get(size_t index);
+
+private:
+    using CacheList = std::list<std::pair<size_t, std::shared_ptr<const Anomaly>>>;
+
+    bool indexCsv(const std::string &fileName);
+    bool loadSidecar(const std::string &indexName, uint64_t sourceSize);
+    void saveSidecar(const std::string &indexName) const;
+    void scanRows(size_t from);
+
+    std::shared_ptr<const Anomaly> decode(size_t index) const;
+    std::shared_ptr<const Anomaly> lookup(size_t index);
+    void insert(size_t index, std::shared_ptr<const Anomaly> anomaly);
+    void prefetchLoop();
+
+    // Sources; one of the three is in use
+    AnomalyFileReader binary;
+    CompactAnomalyFileReader compact;
+    MappedFile csv;
+    std::vector<uint64_t> rowOffsets; // CSV: start of every row, one entry per row; rows end at findCsvRowEnd()
+
+    // LRU cache, most recent first
+    size_t cacheCapacity;
+    size_t prefetchRadius;
+    std::mutex cacheMutex;
+    CacheList cache;
+    std::unordered_map<size_t, CacheList::iterator> cacheIndex;
+
+    // Prefetch thread
+    std::condition_variable prefetchWake;
+    size_t prefetchCenter = 0;
+    bool prefetchPending = false;
+    bool stopping = false;
+    std::thread prefetcher;
+};
+
+#endif // ANOMALY_STORE_H
@@ -0,0 +1,78 @@
+#include "AnomalyStream.h"
+#include <chrono>
+#include <thread>
+
+namespace
+{
+    // Yields before a blocked producer starts sleeping between attempts
+    constexpr int SPIN_YIELDS = 64;
+    constexpr std::chrono::microseconds BLOCKED_SLEEP{200};
+}
+
+const char *streamPolicyName(StreamPolicy policy)
+{
+    switch (policy)
+    {
+    case StreamPolicy::Block:
+        return "block";
+    case StreamPolicy::Drop:
+        return "drop";
+    }
+    return "unknown";
+}
+
+bool parseStreamPolicy(const std::string &name, StreamPolicy &policy)
+{
+    for (StreamPolicy candidate : {StreamPolicy::Block, StreamPolicy::Drop})
+    {
+        if (name == streamPolicyName(candidate))
+        {
+            policy = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+AnomalyStream::AnomalyStream(size_t capacity, StreamPolicy policy) : queue(capacity), overflowPolicy(policy)
+{
+}
+
+bool AnomalyStream::publish(Anomaly &anomaly)
+{
+    for (int attempt = 0; !detached.load(std::memory_order_acquire); ++attempt)
+    {
+        if (queue.tryPush(anomaly))
+        {
+            publishedCount.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        if (overflowPolicy == StreamPolicy::Drop)
+            break;
+        if (attempt < SPIN_YIELDS)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(BLOCKED_SLEEP);
+    }
+    droppedCount.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void AnomalyStream::close()
+{
+    closed.store(true, std::memory_order_release);
+}
+
+bool AnomalyStream::finished()
+{
+    // Check closed first: once it is set, everything published is already in
+    // the queue, so an empty queue afterwards means the stream is done
+    if (!closed.load(std::memory_order_acquire))
+        return false;
+    return queue.empty();
+}
+
+void AnomalyStream::detach()
+{
+    detached.store(true, std::memory_order_release);
+}
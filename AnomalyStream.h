@@ -0,0 +1,78 @@
+#ifndef ANOMALY_STREAM_H
+#define ANOMALY_STREAM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "Anomaly.h"
+#include "MpscQueue.h"
+
+// What publish() does when the consumer has fallen behind and the queue is full
+enum class StreamPolicy : uint8_t
+{
+    Block, // Wait for room: the simulation slows down to the consumer's pace
+    Drop   // Discard the record and count it: the simulation never waits
+};
+
+const char *streamPolicyName(StreamPolicy policy);
+bool parseStreamPolicy(const std::string &name, StreamPolicy &policy);
+
+// Live feed of anomalies from the simulation to one consumer (the viewer).
+//
+// Records go through a bounded lock-free MpscQueue, so publishing never takes
+// a lock; with StreamPolicy::Block a producer that finds the queue full
+// yields and then sleeps briefly until there is room. The producer calls
+// close() when the run is over. The consumer drains records at its own pace
+// and calls detach() when it goes away, after which publish() drops
+// everything instead of waiting for room that will never come.
+class AnomalyStream
+{
+public:
+    explicit AnomalyStream(size_t capacity = 1024, StreamPolicy policy = StreamPolicy::Block);
+
+    AnomalyStream(const AnomalyStream &) = delete;
+    AnomalyStream &operator=(const AnomalyStream &) = delete;
+
+    // Producer side, any thread. Returns false if the record was dropped.
+    bool publish(Anomaly &anomaly);
+
+    // Producer side: no more records will be published
+    void close();
+
+    // Consumer side: hand up to maxRecords queued records to visit(Anomaly &)
+    // in publish order; returns how many there were
+    template <typename Visit>
+    size_t drain(size_t maxRecords, Visit visit)
+    {
+        size_t taken = 0;
+        while (taken < maxRecords && queue.tryPop(scratch))
+        {
+            visit(scratch);
+            ++taken;
+        }
+        return taken;
+    }
+
+    // Consumer side: the producer has closed the stream and everything
+    // published has been drained
+    bool finished();
+
+    // Consumer side: stop accepting records
+    void detach();
+
+    StreamPolicy policy() const { return overflowPolicy; }
+    uint64_t published() const { return publishedCount.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return droppedCount.load(std::memory_order_relaxed); }
+
+private:
+    MpscQueue<Anomaly> queue;
+    StreamPolicy overflowPolicy;
+    Anomaly scratch; // Consumer-side landing spot for popped records
+    std::atomic<bool> closed{false};
+    std::atomic<bool> detached{false};
+    std::atomic<uint64_t> publishedCount{0};
+    std::atomic<uint64_t> droppedCount{0};
+};
+
+#endif // ANOMALY_STREAM_H
@@ -1,41 +1,165 @@
 #include "AnomalyVisualizer.h"
-#include <fstream>
+#include "Wave.h"
+#include "WaveSynth.h"
 #include <sstream>
 #include <math.h>
 
+namespace {
+    constexpr float MARKER_RADIUS = 5.0f;
+    constexpr int MARKER_SEGMENTS = 12;
+}
+
 AnomalyVisualizer::AnomalyVisualizer(const std::string& csvFilename) : currentAnomaly(0) {
+    setUp();
     loadAnomalies(csvFilename);
+    select(0);
+}
+
+AnomalyVisualizer::AnomalyVisualizer(AnomalyStream& stream) : stream(&stream), currentAnomaly(0) {
+    setUp();
+    pollLive();
+}
+
+void AnomalyVisualizer::setUp() {
+    referenceWave.type = sf::LineStrip;
+    anomalousWave.type = sf::LineStrip;
+    breachMarkers.type = sf::Triangles;
+
+    font.loadFromFile("/usr/share/fonts/truetype/ubuntu/Ubuntu-R.ttf");
+    text.setFont(font);
+    text.setCharacterSize(20);
+    text.setFillColor(sf::Color::Black);
+    text.setPosition(10, 10);
+
+    buildReferenceWave(DEFAULT_WAVE_SAMPLES);
+}
+
+AnomalyVisualizer::~AnomalyVisualizer() {
+    if (coilList != 0)
+        glDeleteLists(coilList, 1);
 }
 
 void AnomalyVisualizer::loadAnomalies(const std::string& csvFilename) {
-    std::ifstream file(csvFilename);
-    std::string line;
-    
-    // Skip header
-    std::getline(file, line);
-    
-    while (std::getline(file, line)) {
-        std::istringstream iss(line);
-        Anomaly anomaly;
-        std::string waveDataStr;
-        
-        if (std::getline(iss, anomaly.particle1, ',') &&
-            std::getline(iss, anomaly.particle2, ',') &&
-            std::getline(iss, anomaly.interactionInfo, ',') &&
-            std::getline(iss, waveDataStr)) {
-            
-            // Parse wave data
-            std::istringstream waveStream(waveDataStr);
-            float value;
-            while (waveStream >> value) {
-                anomaly.waveData.push_back(value);
-                if (waveStream.peek() == ',')
-                    waveStream.ignore();
-            }
-            
-            anomalies.push_back(anomaly);
+    // Only the record index is built here; records are decoded as they are shown
+    anomalies.open(csvFilename);
+}
+
+size_t AnomalyVisualizer::anomalyCount() const {
+    return stream ? liveAnomalies.size() : anomalies.size();
+}
+
+bool AnomalyVisualizer::pollLive(size_t maxRecords) {
+    if (!streaming())
+        return false;
+
+    const bool following = !current || currentAnomaly + 1 >= liveAnomalies.size();
+    const size_t received = stream->drain(maxRecords, [&](Anomaly& anomaly) {
+        liveAnomalies.push_back(std::make_shared<const Anomaly>(std::move(anomaly)));
+    });
+    const bool finishedNow = stream->finished();
+    streamFinished = finishedNow;
+    if (received == 0 && !finishedNow)
+        return false;
+
+    if (following && !liveAnomalies.empty())
+        select(liveAnomalies.size() - 1);
+    else if (current)
+        updateText();
+    return true;
+}
+
+void AnomalyVisualizer::select(size_t index) {
+    if (index >= anomalyCount())
+        return;
+    currentAnomaly = index;
+    current = stream ? liveAnomalies[index] : anomalies.get(index);
+    buildAnomalyGeometry();
+}
+
+void AnomalyVisualizer::buildReferenceWave(size_t samples) {
+    // Normal wave, at the same resolution as the anomaly under it
+    const float spacing = sampleSpacing(samples);
+    referenceWave.vertices.resize(samples);
+    for (size_t i = 0; i < samples; ++i) {
+        float x = i * (720.0f / samples);
+        float y = 200 + std::sin(i * spacing * 0.1f) * 50;
+        referenceWave.vertices[i] = sf::Vertex(sf::Vector2f(x, y), sf::Color::Blue);
+    }
+    referenceWave.uploaded = false;
+}
+
+void AnomalyVisualizer::buildAnomalyGeometry() {
+    const auto& anomaly = *current;
+    const size_t samples = anomaly.waveData.size();
+    if (samples != 0 && samples != referenceWave.vertices.size())
+        buildReferenceWave(samples);
+
+    // Anomalous wave
+    anomalousWave.vertices.resize(samples);
+    for (size_t i = 0; i < samples; ++i) {
+        float x = i * (720.0f / samples);
+        float y = 400 + anomaly.waveData[i] * 50;
+        anomalousWave.vertices[i] = sf::Vertex(sf::Vector2f(x, y), sf::Color::Red);
+    }
+    anomalousWave.uploaded = false;
+
+    // Breach points as one triangle list of small discs
+    breachMarkers.vertices.clear();
+    breachMarkers.vertices.reserve(anomaly.breachPoints.size() * MARKER_SEGMENTS * 3);
+    for (const auto& point : anomaly.breachPoints) {
+        sf::Vector2f center(point.first * (720.0f / samples), 400 + point.second * 50);
+        for (int k = 0; k < MARKER_SEGMENTS; ++k) {
+            float a0 = 2.0f * static_cast<float>(M_PI) * k / MARKER_SEGMENTS;
+            float a1 = 2.0f * static_cast<float>(M_PI) * (k + 1) / MARKER_SEGMENTS;
+            breachMarkers.vertices.emplace_back(center, sf::Color::Yellow);
+            breachMarkers.vertices.emplace_back(
+                sf::Vector2f(center.x + MARKER_RADIUS * std::cos(a0), center.y + MARKER_RADIUS * std::sin(a0)),
+                sf::Color::Yellow);
+            breachMarkers.vertices.emplace_back(
+                sf::Vector2f(center.x + MARKER_RADIUS * std::cos(a1), center.y + MARKER_RADIUS * std::sin(a1)),
+                sf::Color::Yellow);
         }
     }
+    breachMarkers.uploaded = false;
+
+    updateText();
+}
+
+void AnomalyVisualizer::updateText() {
+    const auto& anomaly = *current;
+    std::stringstream ss;
+    ss << "Anomaly " << (currentAnomaly + 1) << " of " << anomalyCount();
+    if (streaming())
+        ss << " (live)";
+    if (stream && stream->dropped() != 0)
+        ss << ", " << stream->dropped() << " dropped";
+    ss << "\n";
+    ss << "Particles: " << anomaly.particle1 << " - " << anomaly.particle2 << "\n";
+    ss << "Interaction: " << anomaly.interactionInfo;
+    text.setString(ss.str());
+}
+
+void AnomalyVisualizer::upload(Geometry& geometry) {
+    // Buffers need a GL context, so they are (re)filled lazily from render()
+    if (geometry.uploaded || !sf::VertexBuffer::isAvailable())
+        return;
+    geometry.buffer.setPrimitiveType(geometry.type);
+    geometry.buffer.setUsage(sf::VertexBuffer::Static);
+    if (geometry.buffer.getVertexCount() != geometry.vertices.size())
+        geometry.buffer.create(geometry.vertices.size());
+    if (!geometry.vertices.empty())
+        geometry.buffer.update(geometry.vertices.data());
+    geometry.uploaded = true;
+}
+
+void AnomalyVisualizer::draw(sf::RenderWindow& window, Geometry& geometry) {
+    if (geometry.vertices.empty())
+        return;
+    upload(geometry);
+    if (geometry.uploaded)
+        window.draw(geometry.buffer);
+    else
+        window.draw(geometry.vertices.data(), geometry.vertices.size(), geometry.type);
 }
 
 void AnomalyVisualizer::render(sf::RenderWindow& window)
@@ -61,83 +185,44 @@ void AnomalyVisualizer::renderCoil(sf::RenderWindow& window) {
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
     gluLookAt(5, 5, 5, 0, 0, 0, 0, 1, 0);
-    
-    // Render coil rings
-    glColor3f(0.5f, 0.5f, 0.5f);
-    for (int i = 0; i < 10; ++i) {
-        glPushMatrix();
-        glTranslatef(0, i * 0.5f, 0);
-        glutSolidTorus(0.1, 1.0, 20, 20);
-        glPopMatrix();
+
+    // Tessellate the coil rings once into a display list
+    if (coilList == 0) {
+        coilList = glGenLists(1);
+        glNewList(coilList, GL_COMPILE);
+        glColor3f(0.5f, 0.5f, 0.5f);
+        for (int i = 0; i < 10; ++i) {
+            glPushMatrix();
+            glTranslatef(0, i * 0.5f, 0);
+            glutSolidTorus(0.1, 1.0, 20, 20);
+            glPopMatrix();
+        }
+        glEndList();
     }
+    glCallList(coilList);
 }
 
 void AnomalyVisualizer::renderWaveGraphs(sf::RenderWindow& window) {
-    if (currentAnomaly >= anomalies.size()) return;
-    
-    const auto& anomaly = anomalies[currentAnomaly];
-    
-    // Render normal wave
-    sf::VertexArray normalWave(sf::LineStrip, 360);
-    for (int i = 0; i < 360; ++i) {
-        float x = i * 2.0f;
-        float y = 200 + std::sin(i * 0.1f) * 50;
-        normalWave[i].position = sf::Vector2f(x, y);
-        normalWave[i].color = sf::Color::Blue;
-    }
-    window.draw(normalWave);
-    
-    // Render anomalous wave
-    sf::VertexArray anomalousWave(sf::LineStrip, anomaly.waveData.size());
-    for (size_t i = 0; i < anomaly.waveData.size(); ++i) {
-        float x = i * (720.0f / anomaly.waveData.size());
-        float y = 400 + anomaly.waveData[i] * 50;
-        anomalousWave[i].position = sf::Vector2f(x, y);
-        anomalousWave[i].color = sf::Color::Red;
-    }
-    window.draw(anomalousWave);
+    draw(window, referenceWave);
+    if (!current) return;
+
+    draw(window, anomalousWave);
 
     // Highlight breach points
-    sf::CircleShape breachPoint(5);
-    breachPoint.setFillColor(sf::Color::Yellow);
-    for (const auto& point : anomaly.breachPoints) {
-        float x = point.first * (720.0f / anomaly.waveData.size());
-        float y = 400 + point.second * 50;
-        breachPoint.setPosition(x - 5, y - 5);
-        window.draw(breachPoint);
-    }
+    draw(window, breachMarkers);
 }
 
 void AnomalyVisualizer::renderText(sf::RenderWindow& window) {
-    if (currentAnomaly >= anomalies.size()) return;
-    
-    const auto& anomaly = anomalies[currentAnomaly];
-    
-    sf::Font font;
-    font.loadFromFile("/usr/share/fonts/truetype/ubuntu/Ubuntu-R.ttf");
-    
-    sf::Text text;
-    text.setFont(font);
-    text.setCharacterSize(20);
-    text.setFillColor(sf::Color::Black);
-    
-    std::stringstream ss;
-    ss << "Anomaly " << (currentAnomaly + 1) << " of " << anomalies.size() << "\n";
-    ss << "Particles: " << anomaly.particle1 << " - " << anomaly.particle2 << "\n";
-    ss << "Interaction: " << anomaly.interactionInfo;
-    
-    text.setString(ss.str());
-    text.setPosition(10, 10);
-    
+    if (!current) return;
     window.draw(text);
 }
 
 void AnomalyVisualizer::next() {
-    if (currentAnomaly < anomalies.size() - 1)
-        ++currentAnomaly;
+    if (currentAnomaly + 1 < anomalyCount())
+        select(currentAnomaly + 1);
 }
 
 void AnomalyVisualizer::previous() {
     if (currentAnomaly > 0)
-        --currentAnomaly;
+        select(currentAnomaly - 1);
 }
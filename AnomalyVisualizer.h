@@ -5,29 +5,70 @@
 #include <vector>
 #include <string>
 #include <GL/glut.h>
+#include <memory>
+#include "Anomaly.h"
+#include "AnomalyStore.h"
+#include "AnomalyStream.h"
 
-struct Anomaly {
-    std::string particle1;
-    std::string particle2;
-    std::string interactionInfo;
-    std::vector<float> waveData;
-    std::vector<std::pair<int, float>> breachPoints;
-};
-
+// Retained-mode viewer: the font, the text, the wave and breach geometry and
+// the coil mesh are built once (or once per selected anomaly) and only drawn
+// in render().
+//
+// Anomalies come either from a file or live from an AnomalyStream while the
+// simulation runs. In live mode pollLive() moves whatever has arrived into
+// the view; when the newest anomaly is selected, the selection follows new
+// arrivals.
 class AnomalyVisualizer {
 public:
     AnomalyVisualizer(const std::string& csvFilename);
+    explicit AnomalyVisualizer(AnomalyStream& stream);
+    ~AnomalyVisualizer();
+
+    // Take up to maxRecords anomalies from the stream; true if the view changed
+    bool pollLive(size_t maxRecords = 4096);
+
+    // True while more anomalies may still arrive
+    bool streaming() const { return stream != nullptr && !streamFinished; }
+
     void render(sf::RenderWindow& window);
     void next();
     void previous();
 
 private:
-    std::vector<Anomaly> anomalies;
+    AnomalyStore anomalies;
+    AnomalyStream* stream = nullptr;
+    bool streamFinished = false;
+    std::vector<std::shared_ptr<const Anomaly>> liveAnomalies; // Live mode: everything received so far
     size_t currentAnomaly;
+    std::shared_ptr<const Anomaly> current; // Decoded copy of anomalies[currentAnomaly]
+    void setUp();
     void loadAnomalies(const std::string& csvFilename);
+    size_t anomalyCount() const;
+    void select(size_t index);
+    void updateText();
     void renderCoil(sf::RenderWindow& window);
     void renderWaveGraphs(sf::RenderWindow& window);
     void renderText(sf::RenderWindow& window);
+
+    // Geometry kept between frames; vertices stay on the CPU side as well so
+    // they can be drawn directly where vertex buffers are unavailable
+    struct Geometry {
+        std::vector<sf::Vertex> vertices;
+        sf::VertexBuffer buffer;
+        sf::PrimitiveType type;
+        bool uploaded = false;
+    };
+    void buildReferenceWave(size_t samples);
+    void buildAnomalyGeometry();
+    void upload(Geometry& geometry);
+    void draw(sf::RenderWindow& window, Geometry& geometry);
+
+    sf::Font font;
+    sf::Text text;
+    Geometry referenceWave;
+    Geometry anomalousWave;
+    Geometry breachMarkers;
+    GLuint coilList = 0; // Display list with the coil rings, compiled on first use
 };
 
 #endif // ANOMALY_VISUALIZER_H
@@ -0,0 +1,573 @@
+#include "Catalog.h"
+#include "MappedFile.h"
+#include "Metrics.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <system_error>
+
+namespace
+{
+    const char *const TYPE_IDENTIFIERS[] = {
+        "QuarkUp", "QuarkDown", "QuarkCharm", "QuarkStrange", "QuarkTop", "QuarkBottom",
+        "LeptonElectron", "LeptonMuon", "LeptonTau", "LeptonNeutrinoElectron",
+        "LeptonNeutrinoMuon", "LeptonNeutrinoTau", "LeptonPositron",
+        "BosonPhoton", "BosonZ", "BosonW", "BosonH", "BosonGluon",
+        "ExoticX", "ExoticY", "ExoticZ",
+        "Unknown"};
+    constexpr int TYPE_COUNT = static_cast<int>(sizeof(TYPE_IDENTIFIERS) / sizeof(TYPE_IDENTIFIERS[0]));
+    static_assert(TYPE_COUNT == static_cast<int>(ParticleType::Unknown) + 1,
+                  "TYPE_IDENTIFIERS must list every ParticleType");
+}
+
+std::vector<Particle> defaultCatalog()
+{
+    return {
+        Particle(ParticleType::QuarkUp, "Up Quark", 2.0e-27, 1.6e-19, 2.5e-13, 1.0f, 1.5f, 0.5f, 0.6f, 500.0f),
+        Particle(ParticleType::QuarkDown, "Down Quark", 3.0e-27, -1.6e-19, 2.2e-13, 0.5f, 1.0f, 0.6f, 0.4f, 550.0f),
+        Particle(ParticleType::QuarkCharm, "Charm Quark", 1.3e-27, 2.0e-19, 2.0e-13, 0.8f, 0.5f, 0.7f, 0.5f, 500.0f),
+        Particle(ParticleType::QuarkStrange, "Strange Quark", 9.5e-30, -1.0e-19, 1.6e-13, 0.9f, 0.5f, 0.4f, 0.6f, 550.0f),
+        Particle(ParticleType::QuarkTop, "Top Quark", 1.8e-25, 1.602e-19, 2.0e-13, 0.1f, 0.7f, 0.3f, 0.8f, 700.0f),
+        Particle(ParticleType::QuarkBottom, "Bottom Quark", 4.2e-28, -1.602e-19, 1.7e-13, 0.2f, 0.6f, 0.5f, 0.7f, 600.0f),
+        Particle(ParticleType::LeptonElectron, "Electron", 9.1e-31, -1.602e-19, 1.0e-13, 0.99f, 0.8f, 0.2f, 0.9f, 1000.0f),
+        Particle(ParticleType::LeptonMuon, "Muon", 1.88e-28, -1.602e-19, 2.0e-13, 0.3f, 0.5f, 0.6f, 0.4f, 1000.0f),
+        Particle(ParticleType::LeptonTau, "Tau", 3.2e-27, -1.602e-19, 1.5e-13, 0.6f, 0.6f, 0.4f, 0.7f, 1200.0f),
+        Particle(ParticleType::LeptonNeutrinoElectron, "Electron Neutrino", 1.0e-35, 0.0, 1.0e-14, 0.1f, 0.1f, 0.1f, 0.1f, 2000.0f),
+        Particle(ParticleType::LeptonNeutrinoMuon, "Muon Neutrino", 1.0e-35, 0.0, 1.0e-14, 0.2f, 0.2f, 0.2f, 0.2f, 2100.0f),
+        Particle(ParticleType::LeptonNeutrinoTau, "Tau Neutrino", 1.0e-35, 0.0, 1.0e-14, 0.3f, 0.3f, 0.3f, 0.3f, 2200.0f),
+        Particle(ParticleType::LeptonPositron, "Positron", 9.1e-31, 1.602e-19, 1.0e-13, 0.95f, 0.75f, 0.25f, 0.85f, 1050.0f),
+        Particle(ParticleType::BosonPhoton, "Photon", 0.0, 0.0, 0.0, 0.9f, 1.0f, 0.1f, 1.0f, 1500.0f),
+        Particle(ParticleType::BosonZ, "Z Boson", 9.1e-26, 0, 2.5e-13, 0.7f, 1.0f, 0.2f, 0.9f, 1100.0f),
+        Particle(ParticleType::BosonW, "W Boson", 8.0e-26, 1.602e-19, 3.0e-13, 0.6f, 1.0f, 0.3f, 0.8f, 1150.0f),
+        Particle(ParticleType::BosonH, "Higgs Boson", 1.0e-25, 0, 3.0e-13, 0.5f, 1.2f, 0.4f, 0.7f, 1250.0f),
+        Particle(ParticleType::BosonGluon, "Gluon", 0.0, 0.0, 1.0e-13, 0.4f, 0.4f, 0.4f, 0.5f, 1300.0f),
+        Particle(ParticleType::ExoticX, "Exotic X", 2.0e-24, 2.0e-19, 4.0e-13, 0.8f, 0.2f, 0.8f, 0.6f, 1400.0f),
+        Particle(ParticleType::ExoticY, "Exotic Y", 2.5e-24, -2.0e-19, 4.5e-13, 0.2f, 0.8f, 0.8f, 0.7f, 1450.0f),
+        Particle(ParticleType::ExoticZ, "Exotic Z", 3.0e-24, 0.0, 5.0e-13, 0.8f, 0.8f, 0.2f, 0.8f, 1500.0f)
+    };
+}
+
+
+bool parseParticleType(std::string_view text, ParticleType &type)
+{
+    for (int i = 0; i < TYPE_COUNT; ++i)
+    {
+        if (text == TYPE_IDENTIFIERS[i])
+        {
+            type = static_cast<ParticleType>(i);
+            return true;
+        }
+    }
+
+    // Numeric value, after optional whitespace and '+', with nothing following
+    size_t start = 0;
+    while (start < text.size() && std::isspace(static_cast<unsigned char>(text[start])))
+        ++start;
+    if (start < text.size() && text[start] == '+')
+        ++start;
+    const char *last = text.data() + text.size();
+    int value;
+    const std::from_chars_result result = std::from_chars(text.data() + start, last, value);
+    if (result.ec == std::errc() && result.ptr == last && value >= 0 && value < TYPE_COUNT)
+    {
+        type = static_cast<ParticleType>(value);
+        return true;
+    }
+    return false;
+}
+
+namespace
+{
+    // Catalog CSVs are cut into line-aligned chunks of about this size
+    constexpr size_t CATALOG_CHUNK_BYTES = size_t(1) << 20;
+
+    // Particles are validated this many at a time; only a failing block is searched
+    constexpr size_t VALIDATE_BLOCK = 4096;
+
+    // task(index) for every index in [0, count), on the pool if there is one
+    void runTasks(ThreadPool *pool, size_t count, const std::function<void(size_t)> &task)
+    {
+        if (pool && count > 1)
+        {
+            pool->run(count, task);
+            return;
+        }
+        for (size_t index = 0; index < count; ++index)
+            task(index);
+    }
+
+    template <typename T>
+    bool allFinite(const T *values, size_t begin, size_t end)
+    {
+        bool finite = true;
+        for (size_t i = begin; i < end; ++i)
+            finite &= std::isfinite(values[i]);
+        return finite;
+    }
+
+    // Columns are checked one at a time without early exits, so the loops vectorize
+    bool validBlock(const ParticleStore::Columns &columns, size_t begin, size_t end)
+    {
+        uint8_t maxType = 0;
+        for (size_t i = begin; i < end; ++i)
+            maxType = std::max(maxType, static_cast<uint8_t>(columns.types[i]));
+        return maxType < TYPE_COUNT && allFinite(columns.xs, begin, end) && allFinite(columns.ys, begin, end) &&
+               allFinite(columns.zs, begin, end) && allFinite(columns.amplitudes, begin, end) &&
+               allFinite(columns.frequencies, begin, end) && allFinite(columns.masses, begin, end) &&
+               allFinite(columns.charges, begin, end) && allFinite(columns.energies, begin, end);
+    }
+
+    // Index of the first of `count` particles with an unknown type or a field
+    // that is not finite, or `count` if every one is valid
+    size_t firstInvalidParticle(const ParticleStore::Columns &columns, size_t count, ThreadPool *pool)
+    {
+        const size_t blocks = (count + VALIDATE_BLOCK - 1) / VALIDATE_BLOCK;
+        std::vector<char> valid(blocks);
+        runTasks(pool, blocks, [&](size_t block) {
+            valid[block] = validBlock(columns, block * VALIDATE_BLOCK, std::min(count, (block + 1) * VALIDATE_BLOCK));
+        });
+        for (size_t block = 0; block < blocks; ++block)
+        {
+            if (valid[block])
+                continue;
+            const size_t end = std::min(count, (block + 1) * VALIDATE_BLOCK);
+            for (size_t i = block * VALIDATE_BLOCK; i < end; ++i)
+            {
+                if (!validBlock(columns, i, i + 1))
+                    return i;
+            }
+        }
+        return count;
+    }
+
+    // Sets particles' names, reusing the ID of the last name seen for each
+    // type while it repeats, so runs of identical names skip the hash lookup.
+    // Room is made up front for `count` new names, the most there can be, as
+    // rehashing a growing table costs more than the lookups themselves.
+    class NameCache
+    {
+    public:
+        NameCache(ParticleStore &particles, size_t count) : particles(particles)
+        {
+            particles.reserveNames(particles.nameCount() + count);
+        }
+
+        void set(ParticleHandle h, ParticleType type, std::string_view name)
+        {
+            Entry &entry = last[static_cast<uint8_t>(type)];
+            if (!entry.known || entry.name != name)
+                entry = Entry{name, particles.internName(name), true};
+            particles.setName(h, entry.id);
+        }
+
+    private:
+        struct Entry
+        {
+            std::string_view name;
+            uint32_t id = 0;
+            bool known = false;
+        };
+
+        ParticleStore &particles;
+        Entry last[256];
+    };
+
+    // A line-aligned piece of a catalog CSV
+    struct CsvChunk
+    {
+        const char *begin;
+        const char *end;
+        size_t lines = 0;    // Lines starting in the chunk
+        size_t rows = 0;     // Of which particle rows
+        size_t firstRow = 0; // Index of the chunk's first particle row in the file
+        size_t badLine = 0;  // 1-based line in the chunk of the first malformed row, 0 if none
+    };
+
+    // visit(line, lineEnd, index) for every line of [begin, end) until it returns false
+    template <typename Visit>
+    void forEachLine(const char *begin, const char *end, Visit visit)
+    {
+        size_t index = 0;
+        for (const char *line = begin; line < end; ++index)
+        {
+            const char *newline = static_cast<const char *>(std::memchr(line, '\n', static_cast<size_t>(end - line)));
+            const char *lineEnd = newline ? newline : end;
+            if (!visit(line, lineEnd, index))
+                return;
+            line = newline ? newline + 1 : end;
+        }
+    }
+
+    // Blank lines, comments and a header on the first line hold no particle
+    bool isParticleRow(const char *line, const char *lineEnd, bool firstLine)
+    {
+        if (line == lineEnd || *line == '#')
+            return false;
+        return !(firstLine && lineEnd - line >= 4 && std::memcmp(line, "Type", 4) == 0);
+    }
+
+    // The next ','-separated field of [p, end), as std::getline(row, field, ',') reads it
+    bool nextField(const char *&p, const char *end, std::string_view &field)
+    {
+        if (p == end)
+            return false;
+        const char *comma = static_cast<const char *>(std::memchr(p, ',', static_cast<size_t>(end - p)));
+        const char *fieldEnd = comma ? comma : end;
+        field = std::string_view(p, static_cast<size_t>(fieldEnd - p));
+        p = comma ? comma + 1 : end;
+        return true;
+    }
+
+    // A number as `std::istream >> double` reads it: leading whitespace and a
+    // '+' are skipped and anything after the number is ignored
+    bool parseNumber(std::string_view field, double &value)
+    {
+        const char *p = field.data();
+        const char *end = p + field.size();
+        while (p < end && std::isspace(static_cast<unsigned char>(*p)))
+            ++p;
+        if (p + 1 < end && *p == '+' && p[1] != '-')
+            ++p;
+        return std::from_chars(p, end, value).ec == std::errc();
+    }
+
+    // Parse a row into particle `i` of `columns`; the name is left in `name`
+    bool parseRow(const char *line, const char *lineEnd, const ParticleStore::Columns &columns, size_t i,
+                  std::string_view &name)
+    {
+        const char *p = line;
+        std::string_view typeText, field;
+        ParticleType type;
+        if (!nextField(p, lineEnd, typeText) || !nextField(p, lineEnd, name) || !parseParticleType(typeText, type))
+            return false;
+
+        double numbers[8];
+        for (double &number : numbers)
+        {
+            if (!nextField(p, lineEnd, field) || !parseNumber(field, number))
+                return false;
+        }
+
+        columns.types[i] = type;
+        columns.masses[i] = numbers[0];
+        columns.charges[i] = numbers[1];
+        columns.energies[i] = numbers[2];
+        columns.xs[i] = static_cast<float>(numbers[3]);
+        columns.ys[i] = static_cast<float>(numbers[4]);
+        columns.zs[i] = static_cast<float>(numbers[5]);
+        columns.amplitudes[i] = static_cast<float>(numbers[6]);
+        columns.frequencies[i] = static_cast<float>(numbers[7]);
+        return true;
+    }
+
+    bool loadCatalogCsv(const std::string &fileName, const char *data, const char *end, ParticleStore &particles,
+                        std::string &error, ThreadPool *pool)
+    {
+        std::vector<CsvChunk> chunks;
+        for (const char *begin = data; begin < end;)
+        {
+            const char *cut = begin + std::min(CATALOG_CHUNK_BYTES, static_cast<size_t>(end - begin));
+            const char *newline =
+                cut < end ? static_cast<const char *>(std::memchr(cut, '\n', static_cast<size_t>(end - cut))) : nullptr;
+            const char *chunkEnd = newline ? newline + 1 : end;
+            chunks.push_back(CsvChunk{begin, chunkEnd});
+            begin = chunkEnd;
+        }
+
+        // Count the rows of every chunk, so each knows where its particles go
+        runTasks(pool, chunks.size(), [&](size_t c) {
+            CsvChunk &chunk = chunks[c];
+            forEachLine(chunk.begin, chunk.end, [&](const char *line, const char *lineEnd, size_t index) {
+                chunk.rows += isParticleRow(line, lineEnd, c == 0 && index == 0);
+                chunk.lines = index + 1;
+                return true;
+            });
+        });
+        size_t total = 0;
+        for (CsvChunk &chunk : chunks)
+        {
+            chunk.firstRow = total;
+            total += chunk.rows;
+        }
+
+        // Parse straight into the new columns
+        const size_t first = particles.size();
+        const ParticleStore::Columns columns = particles.appendColumns(total);
+        std::vector<std::string_view> names(total);
+        runTasks(pool, chunks.size(), [&](size_t c) {
+            CsvChunk &chunk = chunks[c];
+            size_t row = chunk.firstRow;
+            forEachLine(chunk.begin, chunk.end, [&](const char *line, const char *lineEnd, size_t index) {
+                if (!isParticleRow(line, lineEnd, c == 0 && index == 0))
+                    return true;
+                if (!parseRow(line, lineEnd, columns, row, names[row]))
+                {
+                    chunk.badLine = index + 1;
+                    return false;
+                }
+                ++row;
+                return true;
+            });
+        });
+
+        size_t linesBefore = 0;
+        for (const CsvChunk &chunk : chunks)
+        {
+            if (chunk.badLine != 0)
+            {
+                error = fileName + ":" + std::to_string(linesBefore + chunk.badLine) + ": malformed particle row";
+                return false;
+            }
+            linesBefore += chunk.lines;
+        }
+
+        const size_t invalid = firstInvalidParticle(columns, total, pool);
+        if (invalid < total)
+        {
+            // Only now find which line the particle came from
+            linesBefore = 0;
+            for (size_t c = 0; c < chunks.size(); ++c)
+            {
+                const CsvChunk &chunk = chunks[c];
+                if (invalid < chunk.firstRow + chunk.rows)
+                {
+                    size_t row = chunk.firstRow;
+                    forEachLine(chunk.begin, chunk.end, [&](const char *line, const char *lineEnd, size_t index) {
+                        if (isParticleRow(line, lineEnd, c == 0 && index == 0) && row++ == invalid)
+                        {
+                            linesBefore += index + 1;
+                            return false;
+                        }
+                        return true;
+                    });
+                    break;
+                }
+                linesBefore += chunk.lines;
+            }
+            error = fileName + ":" + std::to_string(linesBefore) + ": particle field is not a finite number";
+            return false;
+        }
+
+        NameCache cache(particles, total);
+        for (size_t i = 0; i < total; ++i)
+            cache.set(static_cast<ParticleHandle>(first + i), columns.types[i], names[i]);
+        return true;
+    }
+
+    template <typename T>
+    void appendColumn(std::string &out, const T *values, size_t count)
+    {
+        out.append(reinterpret_cast<const char *>(values), count * sizeof(T));
+        out.append((8 - out.size() % 8) % 8, '\0');
+    }
+
+    // Write `bytes` beside `fileName` and rename it into place
+    bool replaceFile(const std::string &fileName, const std::string &bytes)
+    {
+        const std::string tempName = fileName + ".tmp";
+        std::FILE *output = std::fopen(tempName.c_str(), "wb");
+        if (!output)
+        {
+            std::cerr << "Error opening " << tempName << " for writing." << std::endl;
+            return false;
+        }
+        bool ok = std::fwrite(bytes.data(), 1, bytes.size(), output) == bytes.size();
+        ok = std::fclose(output) == 0 && ok;
+        if (!ok || std::rename(tempName.c_str(), fileName.c_str()) != 0)
+        {
+            std::cerr << "Error writing " << fileName << "." << std::endl;
+            std::remove(tempName.c_str());
+            return false;
+        }
+        RATTRAP_COUNT(BytesWritten, bytes.size());
+        return true;
+    }
+
+    template <typename T>
+    void appendNumber(std::string &out, T value)
+    {
+        char text[32];
+        const std::to_chars_result result = std::to_chars(text, text + sizeof(text), value);
+        out.append(text, result.ptr);
+    }
+}
+
+void appendParticleColumns(std::string &out, const ParticleStore &particles)
+{
+    const size_t count = particles.size();
+    appendColumn(out, particles.types(), count);
+    appendColumn(out, particles.xs(), count);
+    appendColumn(out, particles.ys(), count);
+    appendColumn(out, particles.zs(), count);
+    appendColumn(out, particles.amplitudes(), count);
+    appendColumn(out, particles.frequencies(), count);
+    appendColumn(out, particles.masses(), count);
+    appendColumn(out, particles.charges(), count);
+    appendColumn(out, particles.energies(), count);
+
+    std::vector<uint32_t> lengths(count);
+    std::string names;
+    for (size_t p = 0; p < count; ++p)
+    {
+        const std::string &name = particles.name(static_cast<ParticleHandle>(p));
+        lengths[p] = static_cast<uint32_t>(name.size());
+        names += name;
+    }
+    appendColumn(out, lengths.data(), count);
+    appendColumn(out, names.data(), names.size());
+}
+
+const char *readParticleColumns(const char *data, const char *end, size_t count, ParticleStore &particles,
+                                std::string &error, ThreadPool *pool)
+{
+    // Offsets of the columns, each padded to 8 bytes
+    auto padded = [](uint64_t bytes) { return (bytes + 7) / 8 * 8; };
+    const uint64_t n = count;
+    const uint64_t available = static_cast<uint64_t>(end - data);
+    const uint64_t fixedBytes = padded(n) + 5 * padded(n * 4) + 3 * padded(n * 8) + padded(n * 4);
+    if (n > available || fixedBytes > available)
+    {
+        error = "particle columns are truncated";
+        return nullptr;
+    }
+    const char *types = data;
+    const char *floats = types + padded(n);
+    const char *doubles = floats + 5 * padded(n * 4);
+    const char *lengthColumn = doubles + 3 * padded(n * 8);
+    const char *nameBytes = lengthColumn + padded(n * 4);
+
+    std::vector<uint32_t> lengths(count);
+    std::memcpy(lengths.data(), lengthColumn, count * sizeof(uint32_t));
+    std::vector<uint64_t> nameOffsets(count + 1, 0);
+    for (size_t p = 0; p < count; ++p)
+        nameOffsets[p + 1] = nameOffsets[p] + lengths[p];
+    if (padded(nameOffsets[count]) > static_cast<uint64_t>(end - nameBytes))
+    {
+        error = "particle columns are truncated";
+        return nullptr;
+    }
+
+    const size_t first = particles.size();
+    const ParticleStore::Columns columns = particles.appendColumns(count);
+    float *const floatColumns[5] = {columns.xs, columns.ys, columns.zs, columns.amplitudes, columns.frequencies};
+    double *const doubleColumns[3] = {columns.masses, columns.charges, columns.energies};
+    const size_t blocks = (count + VALIDATE_BLOCK - 1) / VALIDATE_BLOCK;
+    runTasks(pool, blocks, [&](size_t block) {
+        const size_t begin = block * VALIDATE_BLOCK;
+        const size_t rows = std::min(count, begin + VALIDATE_BLOCK) - begin;
+        std::memcpy(columns.types + begin, types + begin, rows);
+        for (int f = 0; f < 5; ++f)
+            std::memcpy(floatColumns[f] + begin, floats + f * padded(n * 4) + begin * 4, rows * 4);
+        for (int d = 0; d < 3; ++d)
+            std::memcpy(doubleColumns[d] + begin, doubles + d * padded(n * 8) + begin * 8, rows * 8);
+    });
+
+    const size_t invalid = firstInvalidParticle(columns, count, pool);
+    if (invalid < count)
+    {
+        error = "particle " + std::to_string(invalid) + " has an unknown type or a field that is not a finite number";
+        return nullptr;
+    }
+
+    NameCache cache(particles, count);
+    for (size_t p = 0; p < count; ++p)
+    {
+        cache.set(static_cast<ParticleHandle>(first + p), columns.types[p],
+                  std::string_view(nameBytes + nameOffsets[p], lengths[p]));
+    }
+    return nameBytes + padded(nameOffsets[count]);
+}
+
+bool isCatalogFile(const std::string &fileName)
+{
+    char magic[sizeof(CATALOG_FILE_MAGIC)];
+    std::FILE *input = std::fopen(fileName.c_str(), "rb");
+    if (!input)
+        return false;
+    const bool read = std::fread(magic, 1, sizeof(magic), input) == sizeof(magic);
+    std::fclose(input);
+    return read && std::memcmp(magic, CATALOG_FILE_MAGIC, sizeof(magic)) == 0;
+}
+
+bool loadCatalog(const std::string &fileName, ParticleStore &particles, std::string &error, ThreadPool *pool)
+{
+    RATTRAP_TIME(Load);
+    MappedFile file;
+    if (!file.open(fileName))
+    {
+        error = "cannot open " + fileName;
+        return false;
+    }
+    file.adviseSequential();
+    const char *data = file.data();
+    const char *end = data + file.size();
+
+    if (file.size() < sizeof(CATALOG_FILE_MAGIC) ||
+        std::memcmp(data, CATALOG_FILE_MAGIC, sizeof(CATALOG_FILE_MAGIC)) != 0)
+        return loadCatalogCsv(fileName, data, end, particles, error, pool);
+
+    CatalogFileHeader header;
+    if (file.size() < sizeof(header) ||
+        (std::memcpy(&header, data, sizeof(header)), header.version != CATALOG_FILE_VERSION))
+    {
+        error = fileName + " is not a supported particle catalog";
+        return false;
+    }
+    if (header.columnBytes != file.size() - sizeof(header) || header.particleCount > header.columnBytes)
+    {
+        error = fileName + " is damaged";
+        return false;
+    }
+    if (!readParticleColumns(data + sizeof(header), end, static_cast<size_t>(header.particleCount), particles,
+                             error, pool))
+    {
+        error = fileName + ": " + error;
+        return false;
+    }
+    return true;
+}
+
+bool saveCatalog(const std::string &fileName, const ParticleStore &particles)
+{
+    std::string bytes(sizeof(CatalogFileHeader), '\0');
+    appendParticleColumns(bytes, particles);
+
+    CatalogFileHeader header{};
+    std::memcpy(header.magic, CATALOG_FILE_MAGIC, sizeof(header.magic));
+    header.version = CATALOG_FILE_VERSION;
+    header.particleCount = particles.size();
+    header.columnBytes = bytes.size() - sizeof(header);
+    std::memcpy(&bytes[0], &header, sizeof(header));
+    return replaceFile(fileName, bytes);
+}
+
+bool saveCatalogCsv(const std::string &fileName, const ParticleStore &particles)
+{
+    std::string text = CATALOG_CSV_HEADER;
+    for (size_t p = 0; p < particles.size(); ++p)
+    {
+        const ParticleHandle h = static_cast<ParticleHandle>(p);
+        text += TYPE_IDENTIFIERS[static_cast<uint8_t>(particles.type(h))];
+        text += ',';
+        text += particles.name(h);
+        for (double value : {particles.mass(h), particles.charge(h), particles.energy(h)})
+        {
+            text += ',';
+            appendNumber(text, value);
+        }
+        for (float value : {particles.x(h), particles.y(h), particles.z(h), particles.amplitude(h),
+                            particles.frequency(h)})
+        {
+            text += ',';
+            appendNumber(text, value);
+        }
+        text += '\n';
+    }
+    return replaceFile(fileName, text);
+}
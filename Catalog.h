@@ -0,0 +1,79 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Particles.h"
+#include "ParticleStore.h"
+
+class ThreadPool;
+
+// Binary particle catalog (.rtp), for catalogs too big to parse quickly:
+//
+//   CatalogFileHeader  32 bytes
+//   particle columns   as written by appendParticleColumns()
+//
+// All values are little-endian.
+
+constexpr char CATALOG_FILE_MAGIC[8] = {'R', 'T', 'P', 'A', 'R', 'T', 'S', '1'};
+constexpr uint32_t CATALOG_FILE_VERSION = 1;
+
+struct CatalogFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t particleCount;
+    uint64_t columnBytes;    // Size of the particle columns that follow
+};
+static_assert(sizeof(CatalogFileHeader) == 32, "CatalogFileHeader must stay 32 bytes");
+
+// Header row of a catalog CSV
+constexpr const char *CATALOG_CSV_HEADER = "Type,Name,Mass,Charge,Energy,X,Y,Z,Amplitude,Frequency\n";
+
+// The built-in set of 21 Standard Model and exotic particles
+std::vector<Particle> defaultCatalog();
+
+// Parse a ParticleType from its enum identifier ("QuarkUp") or its numeric value
+bool parseParticleType(std::string_view text, ParticleType &type);
+
+// Append a particle catalog to `particles`. The file is either a binary
+// catalog, recognised by its magic, or a CSV with the columns
+//   Type,Name,Mass,Charge,Energy,X,Y,Z,Amplitude,Frequency
+// in which a header row, blank lines and lines starting with '#' are skipped.
+//
+// The file is memory-mapped and cut into line-aligned chunks that are parsed
+// on `pool` (or on the calling thread without one) straight into the store's
+// columns. Every field is then checked in bulk: the type must be known and
+// every number finite. Names are interned, and a name that repeats the last
+// one seen for its ParticleType, as in generated catalogs, reuses that ID
+// without a lookup. Returns false (with a message in `error`) naming the
+// first bad row, in which case `particles` is left partly filled.
+bool loadCatalog(const std::string &fileName, ParticleStore &particles, std::string &error,
+                 ThreadPool *pool = nullptr);
+
+// Replace `fileName` with `particles` as a binary catalog, or as a catalog CSV
+// (names must not contain commas or newlines)
+bool saveCatalog(const std::string &fileName, const ParticleStore &particles);
+bool saveCatalogCsv(const std::string &fileName, const ParticleStore &particles);
+
+// True if the file starts with the binary catalog magic
+bool isCatalogFile(const std::string &fileName);
+
+// Append the particles' columns in the layout binary catalogs and checkpoints
+// share: uint8 types, float x, y, z, amplitude, frequency, double mass,
+// charge, energy, uint32 name lengths, then the name bytes, each column
+// padded to a multiple of 8 bytes
+void appendParticleColumns(std::string &out, const ParticleStore &particles);
+
+// Append the `count` particles whose columns start at `data` to `particles`,
+// validating and interning as loadCatalog() does. Returns the end of the
+// columns, or nullptr with `error` set if they run past `end` or hold a bad
+// field.
+const char *readParticleColumns(const char *data, const char *end, size_t count, ParticleStore &particles,
+                                std::string &error, ThreadPool *pool = nullptr);
+
+#endif // CATALOG_H
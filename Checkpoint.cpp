@@ -0,0 +1,382 @@
+#include "Checkpoint.h"
+#include "Catalog.h"
+#include "MappedFile.h"
+#include "Metrics.h"
+#include "Particles.h"
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    template <typename T>
+    void appendValue(std::string &out, const T &value)
+    {
+        out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    void appendBytes(std::string &out, const std::string &bytes)
+    {
+        appendValue(out, static_cast<uint64_t>(bytes.size()));
+        out += bytes;
+        out.append((8 - out.size() % 8) % 8, '\0');
+    }
+
+    // Bounds-checked walk over the mapped file; every section starts 8-byte aligned
+    struct SectionReader
+    {
+        const char *p;
+        const char *end;
+
+        const char *take(uint64_t bytes)
+        {
+            const uint64_t padded = (bytes + 7) / 8 * 8;
+            if (static_cast<uint64_t>(end - p) < padded)
+                return nullptr;
+            const char *start = p;
+            p += padded;
+            return start;
+        }
+
+        template <typename T>
+        bool read(T &value)
+        {
+            const char *bytes = take(sizeof(value));
+            if (bytes)
+                std::memcpy(&value, bytes, sizeof(value));
+            return bytes != nullptr;
+        }
+
+        bool readBytes(std::string &bytes)
+        {
+            uint64_t size;
+            const char *data = read(size) ? take(size) : nullptr;
+            if (data)
+                bytes.assign(data, size);
+            return data != nullptr;
+        }
+    };
+
+    // Cut a text output back to `bytes`; a file that was never created is fine if nothing was in it
+    bool truncateTo(const std::string &fileName, uint64_t bytes, std::string &error)
+    {
+        struct stat info;
+        if (stat(fileName.c_str(), &info) != 0)
+        {
+            if (bytes == 0)
+                return true;
+            error = fileName + " is missing";
+            return false;
+        }
+        if (static_cast<uint64_t>(info.st_size) < bytes)
+        {
+            error = fileName + " is shorter than it was at the checkpoint";
+            return false;
+        }
+        if (truncate(fileName.c_str(), off_t(bytes)) != 0)
+        {
+            error = "cannot truncate " + fileName;
+            return false;
+        }
+        return true;
+    }
+}
+
+CheckpointWriter::CheckpointWriter(std::string fileName, uint64_t settings, std::chrono::milliseconds interval)
+    : fileName(std::move(fileName)), settings(settings), interval(interval)
+{
+    worker = std::thread(&CheckpointWriter::run, this);
+}
+
+bool CheckpointWriter::due() const
+{
+    if (submitted && std::chrono::steady_clock::now() - lastSubmit < interval)
+        return false;
+    std::lock_guard<std::mutex> lock(mutex);
+    return !stopping && (!buffers[0].busy || !buffers[1].busy);
+}
+
+void CheckpointWriter::submit(const CheckpointState &state, std::future<OutputCheckpoint> outputs)
+{
+    RATTRAP_TIME(Checkpoint);
+    lastSubmit = std::chrono::steady_clock::now();
+    submitted = true;
+
+    size_t index;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping || (buffers[0].busy && buffers[1].busy))
+        {
+            ++skippedCount;
+            return;
+        }
+        index = buffers[0].busy ? 1 : 0;
+    }
+
+    // The buffer is ours until it is queued; its capacity is kept between checkpoints
+    Buffer &buffer = buffers[index];
+    std::string &out = buffer.bytes;
+    out.clear();
+
+    const ParticleStore *particles = state.particles;
+    const size_t count = particles ? particles->size() : 0;
+    CheckpointHeader header{};
+    std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.kind = static_cast<uint8_t>(state.kind);
+    header.settings = settings;
+    header.particleCount = count;
+    header.row = state.position.row;
+    header.column = state.position.column;
+    header.nextDraw = state.nextDraw;
+    appendValue(out, header);
+
+    if (count != particleSectionCount)
+    {
+        particleSection.clear();
+        if (particles)
+            appendParticleColumns(particleSection, *particles);
+        particleSectionCount = count;
+    }
+    out += particleSection;
+
+    std::string image;
+    if (state.interactions)
+        state.interactions->saveTo(image);
+    appendBytes(out, image);
+
+    const uint64_t drawn = state.tally ? state.tally->pairsDrawn() : 0;
+    appendValue(out, drawn);
+    if (state.tally)
+    {
+        // Entries go straight into the buffer; load order does not matter
+        const size_t start = out.size();
+        out.resize(start + drawn * 24);
+        char *entry = &out[start];
+        state.tally->forEachUnordered([&](uint32_t i, uint32_t j, uint64_t draws, uint64_t anomalies) {
+            std::memcpy(entry, &i, sizeof(i));
+            std::memcpy(entry + 4, &j, sizeof(j));
+            std::memcpy(entry + 8, &draws, sizeof(draws));
+            std::memcpy(entry + 16, &anomalies, sizeof(anomalies));
+            entry += 24;
+        });
+    }
+    buffer.outputs = std::move(outputs);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        buffer.busy = true;
+        pending.push_back(index);
+    }
+    wake.notify_one();
+}
+
+void CheckpointWriter::finish()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping)
+            return;
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+uint64_t CheckpointWriter::written() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return writtenCount;
+}
+
+uint64_t CheckpointWriter::skipped() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return skippedCount;
+}
+
+void CheckpointWriter::run()
+{
+    while (true)
+    {
+        size_t index;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return !pending.empty() || stopping; });
+            if (pending.empty())
+                break;
+            index = pending.front();
+            pending.pop_front();
+        }
+
+        // The snapshot is only valid once the outputs it refers to are on disk
+        Buffer &buffer = buffers[index];
+        OutputCheckpoint outputs;
+        outputs.ok = true;
+        if (buffer.outputs.valid())
+        {
+            try
+            {
+                outputs = buffer.outputs.get();
+            }
+            catch (const std::future_error &)
+            {
+                outputs.ok = false; // The collision writer closed before reaching the mark
+            }
+        }
+
+        bool ok = outputs.ok;
+        if (ok)
+        {
+            std::string &out = buffer.bytes;
+            appendValue(out, outputs.csvBytes);
+            appendValue(out, outputs.logBytes);
+            appendBytes(out, outputs.anomalyFileTail);
+            appendBytes(out, outputs.compactFileTail);
+
+            const uint64_t fileBytes = out.size();
+            std::memcpy(&out[offsetof(CheckpointHeader, fileBytes)], &fileBytes, sizeof(fileBytes));
+            ok = writeFile(out);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        buffer.busy = false;
+        ok ? ++writtenCount : ++skippedCount;
+    }
+}
+
+bool CheckpointWriter::writeFile(const std::string &bytes)
+{
+    // Write beside the target and rename, so a crash keeps the previous checkpoint
+    const std::string tempName = fileName + ".tmp";
+    std::FILE *output = std::fopen(tempName.c_str(), "wb");
+    if (!output)
+    {
+        std::cerr << "Error opening " << tempName << " for writing." << std::endl;
+        return false;
+    }
+    bool ok = std::fwrite(bytes.data(), 1, bytes.size(), output) == bytes.size() && std::fflush(output) == 0 &&
+              fsync(fileno(output)) == 0;
+    ok = std::fclose(output) == 0 && ok;
+    if (!ok)
+    {
+        std::cerr << "Error writing " << tempName << "." << std::endl;
+        return false;
+    }
+    RATTRAP_COUNT(BytesWritten, bytes.size());
+    return std::rename(tempName.c_str(), fileName.c_str()) == 0;
+}
+
+bool loadCheckpoint(const std::string &fileName, RunCheckpoint &checkpoint, std::string &error)
+{
+    MappedFile file;
+    if (!file.open(fileName))
+    {
+        error = "cannot open checkpoint " + fileName;
+        return false;
+    }
+    file.adviseSequential();
+
+    CheckpointHeader header;
+    if (file.size() < sizeof(header) ||
+        (std::memcpy(&header, file.data(), sizeof(header)),
+         std::memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0) ||
+        header.version != CHECKPOINT_VERSION)
+    {
+        error = fileName + " is not a checkpoint file";
+        return false;
+    }
+    if (header.fileBytes != file.size() || header.kind > static_cast<uint8_t>(CheckpointKind::MonteCarlo))
+    {
+        error = fileName + " is damaged";
+        return false;
+    }
+
+    checkpoint.kind = static_cast<CheckpointKind>(header.kind);
+    checkpoint.settings = header.settings;
+    checkpoint.position = SweepPosition{static_cast<size_t>(header.row), static_cast<size_t>(header.column)};
+    checkpoint.nextDraw = header.nextDraw;
+
+    SectionReader in{file.data() + sizeof(header), file.data() + file.size()};
+    const size_t count = static_cast<size_t>(header.particleCount);
+    checkpoint.particles.clear();
+    in.p = readParticleColumns(in.p, in.end, count, checkpoint.particles, error);
+    if (!in.p)
+    {
+        error = fileName + ": " + error;
+        return false;
+    }
+
+    std::string image;
+    if (!in.readBytes(image))
+    {
+        error = fileName + " is truncated";
+        return false;
+    }
+    checkpoint.interactions = InteractionSet();
+    if (!image.empty() && !checkpoint.interactions.loadFrom(image.data(), image.size(), fileName))
+    {
+        error = fileName + " holds a damaged interaction set";
+        return false;
+    }
+
+    uint64_t drawn;
+    if (!in.read(drawn) || static_cast<uint64_t>(in.end - in.p) / 24 < drawn)
+    {
+        error = fileName + " is truncated";
+        return false;
+    }
+    checkpoint.tally.reset(count);
+    checkpoint.tally.reserve(static_cast<size_t>(drawn));
+    for (uint64_t pair = 0; pair < drawn; ++pair, in.p += 24)
+    {
+        uint32_t i, j;
+        uint64_t draws, anomalies;
+        std::memcpy(&i, in.p, sizeof(i));
+        std::memcpy(&j, in.p + 4, sizeof(j));
+        std::memcpy(&draws, in.p + 8, sizeof(draws));
+        std::memcpy(&anomalies, in.p + 16, sizeof(anomalies));
+        if (i >= j || j >= count)
+        {
+            error = fileName + " holds a damaged pair tally";
+            return false;
+        }
+        checkpoint.tally.add(i, j, draws, anomalies);
+    }
+
+    OutputCheckpoint &outputs = checkpoint.outputs;
+    outputs.ok = in.read(outputs.csvBytes) && in.read(outputs.logBytes) && in.readBytes(outputs.anomalyFileTail) &&
+                 in.readBytes(outputs.compactFileTail);
+    if (!outputs.ok)
+    {
+        error = fileName + " is truncated";
+        return false;
+    }
+    return true;
+}
+
+bool restoreOutputs(const OutputCheckpoint &outputs, const std::string &csvFileName,
+                    const std::string &logFileName, const std::string &anomalyFileName,
+                    const std::string &compactFileName, std::string &error)
+{
+    if (!csvFileName.empty() && !truncateTo(csvFileName, outputs.csvBytes, error))
+        return false;
+    if (!logFileName.empty() && !truncateTo(logFileName, outputs.logBytes, error))
+        return false;
+    if (!anomalyFileName.empty() && !outputs.anomalyFileTail.empty() &&
+        !AnomalyFileWriter::restore(anomalyFileName, outputs.anomalyFileTail))
+    {
+        error = "cannot restore " + anomalyFileName;
+        return false;
+    }
+    if (!compactFileName.empty() && !outputs.compactFileTail.empty() &&
+        !CompactAnomalyFileWriter::restore(compactFileName, outputs.compactFileTail))
+    {
+        error = "cannot restore " + compactFileName;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,157 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "CollisionWriter.h"
+#include "InteractionSet.h"
+#include "MonteCarlo.h"
+#include "PairSweep.h"
+#include "ParticleStore.h"
+
+// Snapshot of a long run, from which --resume carries on where it stopped.
+//
+//   CheckpointHeader  64 bytes
+//   particles         the ParticleStore columns, laid out as in binary
+//                     catalogs (see appendParticleColumns() in Catalog.h)
+//   interactions      uint64 size, then an InteractionSet pair file (padded)
+//   tally             uint64 count, then (uint32 i, uint32 j, uint64 draws,
+//                     uint64 anomalies) for every pair drawn
+//   outputs           uint64 csvBytes, uint64 logBytes, then the .rta and .rtc
+//                     tails of OutputCheckpoint, each as uint64 size + bytes
+//
+// All values are little-endian. The RNG needs no state of its own: Monte
+// Carlo draw n depends only on the seed and n, so nextDraw is enough.
+
+constexpr char CHECKPOINT_MAGIC[8] = {'R', 'T', 'C', 'H', 'K', 'P', 'T', '1'};
+constexpr uint32_t CHECKPOINT_VERSION = 1;
+
+enum class CheckpointKind : uint8_t
+{
+    Sweep,
+    MonteCarlo
+};
+
+struct CheckpointHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint8_t kind;            // CheckpointKind
+    uint8_t reserved[3];
+    uint64_t settings;       // Fingerprint of the run's options; a resume must match it
+    uint64_t particleCount;
+    uint64_t row;            // Sweep: every pair before (row, column) is done
+    uint64_t column;
+    uint64_t nextDraw;       // Monte Carlo: first draw not yet tallied
+    uint64_t fileBytes;      // Size of the whole file
+};
+static_assert(sizeof(CheckpointHeader) == 64, "CheckpointHeader must stay 64 bytes");
+
+// What submit() snapshots; the pointers are only read during the call
+struct CheckpointState
+{
+    CheckpointKind kind = CheckpointKind::Sweep;
+    SweepPosition position;
+    uint64_t nextDraw = 0;
+    const ParticleStore *particles = nullptr;
+    const InteractionSet *interactions = nullptr; // Sweep
+    const PairTally *tally = nullptr;             // Monte Carlo
+};
+
+// Writes checkpoints on a background thread, double-buffered.
+//
+// submit() serializes the state into whichever of two buffers is free and
+// returns; the writer thread waits for the output files to reach the matching
+// point, then writes the buffer beside the checkpoint file, fsyncs it and
+// renames it into place, so a crash at any moment leaves the previous
+// checkpoint intact. While both buffers are busy due() is false and the run
+// carries on without checkpointing rather than waiting for the disk.
+// Particles may be appended between checkpoints but not changed; their
+// section is only rebuilt when the count differs.
+class CheckpointWriter
+{
+public:
+    CheckpointWriter(std::string fileName, uint64_t settings, std::chrono::milliseconds interval);
+    ~CheckpointWriter() { finish(); }
+
+    CheckpointWriter(const CheckpointWriter &) = delete;
+    CheckpointWriter &operator=(const CheckpointWriter &) = delete;
+
+    // True when the interval has passed since the last submit (or nothing has
+    // been submitted yet) and a buffer is free
+    bool due() const;
+
+    // Snapshot `state`. `outputs` is the CollisionWriter::checkpoint() mark
+    // queued after everything the state covers; without one (Monte Carlo) the
+    // outputs section is left empty.
+    void submit(const CheckpointState &state, std::future<OutputCheckpoint> outputs = {});
+
+    // Write out everything submitted and stop the writer thread
+    void finish();
+
+    uint64_t written() const;
+    uint64_t skipped() const;
+
+private:
+    struct Buffer
+    {
+        std::string bytes;
+        std::future<OutputCheckpoint> outputs;
+        bool busy = false;
+    };
+
+    void run();
+    bool writeFile(const std::string &bytes);
+
+    std::string fileName;
+    uint64_t settings;
+    std::chrono::milliseconds interval;
+    std::chrono::steady_clock::time_point lastSubmit;
+    bool submitted = false;
+
+    // Particle section of the last submit, reused while the count is unchanged
+    std::string particleSection;
+    size_t particleSectionCount = SIZE_MAX;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    Buffer buffers[2];
+    std::deque<size_t> pending;
+    uint64_t writtenCount = 0;
+    uint64_t skippedCount = 0;
+    bool stopping = false;
+
+    std::thread worker;
+};
+
+// A checkpoint read back for --resume
+struct RunCheckpoint
+{
+    CheckpointKind kind = CheckpointKind::Sweep;
+    uint64_t settings = 0;
+    SweepPosition position;
+    uint64_t nextDraw = 0;
+    ParticleStore particles;
+    InteractionSet interactions;
+    PairTally tally;
+    OutputCheckpoint outputs;
+};
+
+// Read `fileName` (memory-mapped) into `checkpoint`; on failure `error` says why
+bool loadCheckpoint(const std::string &fileName, RunCheckpoint &checkpoint, std::string &error);
+
+// Put the output files back the way they were at the checkpoint: cut the text
+// files to their recorded sizes and rewrite the binary files' tables. Empty
+// names are skipped.
+bool restoreOutputs(const OutputCheckpoint &outputs, const std::string &csvFileName,
+                    const std::string &logFileName, const std::string &anomalyFileName,
+                    const std::string &compactFileName, std::string &error);
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,83 @@
+#include "CoarseBreachDetector.h"
+#include "Metrics.h"
+#include "WaveBank.h"
+#include "WaveKernels.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+    // Relative slack for rounding the anchor and the final sums to float
+    constexpr double SUM_SLACK = 1.0 + 1.0 / (1 << 20);
+}
+
+CoarseBreachDetector::CoarseBreachDetector(const WaveBank &waves, float threshold, size_t stride)
+{
+    rebuild(waves, threshold, stride);
+}
+
+void CoarseBreachDetector::rebuild(const WaveBank &waves, float threshold, size_t stride)
+{
+    this->waves = &waves;
+    this->threshold = threshold;
+    blockStride = stride;
+    if (blockStride < 2)
+        return;
+
+    const size_t sampleCount = waves.sampleCount();
+    const double spacing = sampleSpacing(sampleCount);
+    const double blockSpan = spacing * static_cast<double>(blockStride - 1);
+    const double duration = spacing * static_cast<double>(sampleCount);
+
+    reach.resize(waves.size());
+    for (size_t p = 0; p < waves.size(); ++p)
+    {
+        const double a = std::abs(static_cast<double>(waves.amplitude(p)));
+        const double f = std::abs(static_cast<double>(waves.frequency(p)));
+
+        // Sample times and phases are rounded to float, so each phase can be
+        // off by about one float ulp of the largest phase; allow twice that
+        // for both ends of the difference, and a few ulps of |a| for the
+        // rounding of the samples themselves
+        const double phaseSlack = 4.0 * f * duration * FLT_EPSILON;
+        reach[p] = a * std::min(2.0, f * blockSpan + phaseSlack) + 4.0 * a * FLT_EPSILON;
+    }
+}
+
+bool CoarseBreachDetector::breaches(size_t i, size_t j) const
+{
+    const float *wave1 = waves->wave(i);
+    const float *wave2 = waves->wave(j);
+    const size_t sampleCount = waves->sampleCount();
+    if (blockStride < 2)
+        return combineAndDetectBreaches(wave1, wave2, sampleCount, threshold, nullptr, nullptr) > 0;
+
+    // Anchors first: any of them above the threshold settles it
+    for (size_t c = 0; c < sampleCount; c += blockStride)
+    {
+        if (std::abs(wave1[c] + wave2[c]) > threshold)
+            return true;
+    }
+
+    // If the bound cannot certify any block, one full pass is cheaper than
+    // refining block by block
+    const double pairReach = reach[i] + reach[j];
+    if (!(pairReach < threshold))
+        return combineAndDetectBreaches(wave1, wave2, sampleCount, threshold, nullptr, nullptr) > 0;
+
+    size_t refined = 0;
+    bool found = false;
+    for (size_t c = 0; c < sampleCount && !found; c += blockStride)
+    {
+        const double anchor = std::abs(wave1[c] + wave2[c]);
+        if ((anchor + pairReach) * SUM_SLACK <= threshold)
+            continue;
+        ++refined;
+        const size_t end = std::min(sampleCount, c + blockStride);
+        found = combineAndDetectBreaches(wave1 + c + 1, wave2 + c + 1, end - c - 1, threshold, nullptr, nullptr) > 0;
+    }
+    RATTRAP_COUNT(BlocksRefined, refined);
+    (void)refined;
+    return found;
+}
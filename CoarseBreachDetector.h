@@ -0,0 +1,46 @@
+#ifndef COARSE_BREACH_DETECTOR_H
+#define COARSE_BREACH_DETECTOR_H
+
+#include <cstddef>
+#include <vector>
+
+class WaveBank;
+
+// Decides whether a pair's combined wave breaches the threshold without
+// evaluating every sample, for waves with many samples.
+//
+// The wave is split into blocks of `stride` samples and the first sample of
+// each block (its anchor) is checked first. An anchor above the threshold
+// means the pair breaches. Otherwise a Lipschitz bound limits how far the
+// rest of the block can be from its anchor: a wave a * sin(f * t) moves by at
+// most |a| * min(2, |f| * dt) over a time dt, so the combined wave moves by at
+// most (|a1 f1| + |a2 f2|) * dt. Blocks where |anchor| plus that reach cannot
+// exceed the threshold are certified breach-free; only the remaining blocks
+// are evaluated at full resolution.
+//
+// The reach includes slack for the float rounding of sample times, phases
+// and samples, so the answer is always the one the full-resolution check
+// gives; the detector only skips work. With stride < 2 it is a plain
+// full-resolution check.
+class CoarseBreachDetector
+{
+public:
+    CoarseBreachDetector() = default;
+    CoarseBreachDetector(const WaveBank &waves, float threshold, size_t stride);
+
+    // Point the detector at `waves`, reusing the memory of the previous setup
+    void rebuild(const WaveBank &waves, float threshold, size_t stride);
+
+    // True if the combined wave of particles i and j breaches the threshold
+    bool breaches(size_t i, size_t j) const;
+
+    size_t stride() const { return blockStride; }
+
+private:
+    const WaveBank *waves = nullptr;
+    float threshold = 0.0f;
+    size_t blockStride = 0;
+    std::vector<float> reach; // Per particle: bound on |sample - block anchor|
+};
+
+#endif // COARSE_BREACH_DETECTOR_H
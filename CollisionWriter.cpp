@@ -0,0 +1,298 @@
+#include "CollisionWriter.h"
+#include "AnomalyCsv.h"
+#include "Metrics.h"
+#include "Particles.h"
+#include <algorithm>
+#include <charconv>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    // Same text as `stream << value` with the default stream precision (%g, 6 digits)
+    void appendNumber(std::string &out, float value)
+    {
+        char text[32];
+        auto result = std::to_chars(text, text + sizeof(text), value, std::chars_format::general, 6);
+        out.append(text, result.ptr);
+    }
+
+    void appendNumber(std::string &out, int value)
+    {
+        char text[16];
+        auto result = std::to_chars(text, text + sizeof(text), value);
+        out.append(text, result.ptr);
+    }
+}
+
+CollisionWriter::CollisionWriter(std::string csvFileName, std::string logFileName)
+    : CollisionWriter(std::move(csvFileName), std::move(logFileName), Options())
+{
+}
+
+CollisionWriter::CollisionWriter(std::string csvFileName, std::string logFileName, Options options)
+    : options(options), ring(std::max<size_t>(1, options.queueCapacity))
+{
+    csv.fileName = std::move(csvFileName);
+    log.fileName = std::move(logFileName);
+    worker = std::thread(&CollisionWriter::run, this);
+}
+
+CollisionWriter::~CollisionWriter()
+{
+    close();
+}
+
+void CollisionWriter::write(CollisionInfo collision)
+{
+    push(std::move(collision));
+}
+
+void CollisionWriter::write(CollisionLogEntry entry)
+{
+    push(std::move(entry));
+}
+
+std::future<OutputCheckpoint> CollisionWriter::checkpoint()
+{
+    CheckpointMark mark;
+    std::future<OutputCheckpoint> result = mark.done.get_future();
+    push(std::move(mark));
+    return result;
+}
+
+void CollisionWriter::push(Record record)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    notFull.wait(lock, [this] { return count < ring.size() || stopping; });
+    if (stopping)
+        return; // A dropped mark's future reports a broken promise
+
+    ring[(head + count) % ring.size()] = std::move(record);
+    ++count;
+    ++queued;
+    if (count == 1)
+        notEmpty.notify_one();
+}
+
+void CollisionWriter::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (closed)
+        return;
+    unsigned long long target = queued;
+    flushTarget = std::max(flushTarget, target);
+    notEmpty.notify_one();
+    flushed.wait(lock, [&] { return written >= target || closed; });
+}
+
+void CollisionWriter::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping)
+            return;
+        stopping = true;
+    }
+    notEmpty.notify_one();
+    notFull.notify_all();
+    worker.join();
+}
+
+void CollisionWriter::run()
+{
+    std::vector<Record> batch;
+    unsigned long long taken = 0;
+    auto lastWrite = std::chrono::steady_clock::now();
+
+    while (true)
+    {
+        bool stop;
+        bool flushRequested;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            notEmpty.wait_for(lock, options.flushInterval,
+                              [this] { return count > 0 || stopping || flushTarget > written; });
+
+            // Take everything queued so far as one batch
+            while (count > 0)
+            {
+                batch.push_back(std::move(ring[head]));
+                head = (head + 1) % ring.size();
+                --count;
+            }
+            taken = queued;
+            stop = stopping;
+            flushRequested = flushTarget > written;
+        }
+        notFull.notify_all();
+
+        for (Record &record : batch)
+        {
+            std::visit([this](auto &r) { format(r); }, record);
+        }
+        batch.clear();
+
+        auto now = std::chrono::steady_clock::now();
+        bool full = csv.buffer.size() >= options.flushBytes || log.buffer.size() >= options.flushBytes;
+        if (full || stop || flushRequested || now - lastWrite >= options.flushInterval)
+        {
+            writeOut(csv);
+            writeOut(log);
+            lastWrite = now;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            written = taken;
+            flushed.notify_all();
+        }
+
+        if (stop)
+            break;
+    }
+
+    for (Sink *sink : {&csv, &log})
+    {
+        if (sink->file)
+            std::fclose(sink->file);
+        sink->file = nullptr;
+    }
+    binary.close();
+    compact.close();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+    flushed.notify_all();
+}
+
+bool CollisionWriter::open(Sink &sink, const char *header)
+{
+    if (sink.file || sink.failed)
+        return sink.file != nullptr;
+
+    sink.file = std::fopen(sink.fileName.c_str(), "ab");
+    if (!sink.file)
+    {
+        sink.failed = true;
+        std::cerr << "Error opening file for logging." << std::endl;
+        return false;
+    }
+
+    // Check if file is empty (for headers)
+    std::fseek(sink.file, 0, SEEK_END);
+    sink.bytes = static_cast<uint64_t>(std::ftell(sink.file));
+    if (header && sink.bytes == 0)
+        sink.buffer += header;
+    return true;
+}
+
+void CollisionWriter::writeOut(Sink &sink)
+{
+    if (sink.file && !sink.buffer.empty())
+    {
+        RATTRAP_TIME(FileWrite);
+        RATTRAP_COUNT(BytesWritten, sink.buffer.size());
+        std::fwrite(sink.buffer.data(), 1, sink.buffer.size(), sink.file);
+        std::fflush(sink.file);
+        sink.bytes += sink.buffer.size();
+    }
+    sink.buffer.clear();
+}
+
+void CollisionWriter::format(CollisionInfo &collision)
+{
+    if (!options.anomalyFileName.empty() && !binaryFailed)
+    {
+        if (!binary.isOpen())
+            binaryFailed = !binary.open(options.anomalyFileName);
+        if (binary.isOpen())
+            binary.write(collision.particle1, collision.particle2, collision.interactionInfo,
+                         collision.waveData.data(), collision.waveData.size());
+    }
+
+    if (!options.compactFileName.empty() && !compactFailed)
+    {
+        if (!compact.isOpen())
+            compactFailed = !compact.open(options.compactFileName, options.compactSynthMode,
+                                          Particle::AMPLITUDE_THRESHOLD);
+        if (compact.isOpen())
+            compact.write(collision.particle1, collision.particle2, collision.interactionInfo,
+                          collision.amplitude1, collision.frequency1, collision.amplitude2, collision.frequency2,
+                          collision.waveData.data(), collision.waveData.size());
+    }
+
+    if (!options.writeCsv || !open(csv, ANOMALY_CSV_HEADER))
+        return;
+
+    appendAnomalyCsvRow(csv.buffer, collision.particle1, collision.particle2, collision.interactionInfo,
+                        collision.waveData.data(), collision.waveData.size());
+}
+
+uint64_t CollisionWriter::syncedSize(Sink &sink)
+{
+    writeOut(sink);
+    if (sink.file)
+        return fsync(fileno(sink.file)) == 0 ? sink.bytes : UINT64_MAX;
+
+    // Not opened yet: the file is whatever earlier runs left
+    struct stat info;
+    return stat(sink.fileName.c_str(), &info) == 0 ? static_cast<uint64_t>(info.st_size) : 0;
+}
+
+void CollisionWriter::format(CheckpointMark &mark)
+{
+    RATTRAP_TIME(FileWrite);
+    OutputCheckpoint outputs;
+    outputs.csvBytes = syncedSize(csv);
+    outputs.logBytes = syncedSize(log);
+    outputs.ok = outputs.csvBytes != UINT64_MAX && outputs.logBytes != UINT64_MAX;
+
+    // The binary files are opened now, if no record has done it yet, so the
+    // tail describes the file a resumed run will append to
+    if (!options.anomalyFileName.empty() && !binaryFailed)
+    {
+        if (!binary.isOpen())
+            binaryFailed = !binary.open(options.anomalyFileName);
+        outputs.ok = binary.isOpen() && binary.checkpoint(outputs.anomalyFileTail) && outputs.ok;
+    }
+    if (!options.compactFileName.empty() && !compactFailed)
+    {
+        if (!compact.isOpen())
+            compactFailed = !compact.open(options.compactFileName, options.compactSynthMode,
+                                          Particle::AMPLITUDE_THRESHOLD);
+        outputs.ok = compact.isOpen() && compact.checkpoint(outputs.compactFileTail) && outputs.ok;
+    }
+    mark.done.set_value(std::move(outputs));
+}
+
+void CollisionWriter::format(CollisionLogEntry &entry)
+{
+    if (!open(log, nullptr))
+        return;
+
+    std::string &out = log.buffer;
+    out += "Collision #";
+    appendNumber(out, ++collisionCount);
+    out += "\nInitial Energy: ";
+    appendNumber(out, entry.initialEnergy);
+    out += " GeV\nFinal Energy: ";
+    appendNumber(out, entry.finalEnergy);
+    out += " GeV\nEnergy Difference: ";
+    appendNumber(out, entry.finalEnergy - entry.initialEnergy);
+    out += " GeV\nInitial Mass: ";
+    appendNumber(out, entry.initialMass);
+    out += " GeV/c^2\nFinal Mass: ";
+    appendNumber(out, entry.finalMass);
+    out += " GeV/c^2\nMass Difference: ";
+    appendNumber(out, entry.finalMass - entry.initialMass);
+    out += " GeV/c^2\nAmplitude Breach Points:\n";
+    for (const auto &point : entry.breachPoints)
+    {
+        out += "  Index: ";
+        appendNumber(out, point.first);
+        out += ", Amplitude: ";
+        appendNumber(out, point.second);
+        out += '\n';
+    }
+    out += '\n';
+}
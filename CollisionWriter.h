@@ -0,0 +1,152 @@
+#ifndef COLLISION_WRITER_H
+#define COLLISION_WRITER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <variant>
+#include <vector>
+#include "AnomalyFile.h"
+#include "CompactAnomalyFile.h"
+
+// Struct for storing collision information to be written into CSV
+struct CollisionInfo
+{
+    std::string particle1;
+    std::string particle2;
+    std::string interactionInfo;
+    std::vector<float> waveData;
+
+    // Wave parameters of the two particles, for compact (.rtc) records
+    float amplitude1 = 0.0f;
+    float frequency1 = 0.0f;
+    float amplitude2 = 0.0f;
+    float frequency2 = 0.0f;
+};
+
+// Energy/mass summary of one collision, written to the collision log
+struct CollisionLogEntry
+{
+    float initialEnergy;
+    float finalEnergy;
+    float initialMass;
+    float finalMass;
+    std::vector<std::pair<int, float>> breachPoints;
+};
+
+// How far the output files had got at a checkpoint
+struct OutputCheckpoint
+{
+    bool ok = false;              // Everything before the mark reached the disk
+    uint64_t csvBytes = 0;        // Size of the CSV file
+    uint64_t logBytes = 0;        // Size of the collision log
+    std::string anomalyFileTail;  // AnomalyFileWriter::checkpoint(); empty without a .rta file
+    std::string compactFileTail;  // CompactAnomalyFileWriter::checkpoint(); empty without a .rtc file
+};
+
+// Background writer for collisions.csv and collision_log.txt.
+//
+// Simulation threads hand records to write(), which only copies them into a
+// bounded ring buffer (blocking while it is full). A dedicated thread drains
+// the ring in batches, formats with std::to_chars into one buffer per sink and
+// writes each buffer through a single open FILE handle once it passes
+// flushBytes or flushInterval has elapsed. The text is byte-for-byte what the
+// old iostream code produced. Anomalies can also (or instead) go to a binary
+// .rta file and to a parametric .rtc file. The destructor writes out
+// everything queued.
+class CollisionWriter
+{
+public:
+    struct Options
+    {
+        size_t queueCapacity = 4096;                       // Records buffered before write() blocks
+        size_t flushBytes = size_t(1) << 20;               // Buffered text that triggers a write
+        std::chrono::milliseconds flushInterval{250};      // Longest time text stays buffered
+        bool writeCsv = true;                              // Write rows to the CSV file
+        std::string anomalyFileName;                       // Also write a binary .rta file if set
+        std::string compactFileName;                       // Also write a parametric .rtc file if set
+        WaveSynthMode compactSynthMode = WaveSynthMode::Exact; // How the .rtc waves are rebuilt
+    };
+
+    CollisionWriter(std::string csvFileName, std::string logFileName);
+    CollisionWriter(std::string csvFileName, std::string logFileName, Options options);
+    ~CollisionWriter();
+
+    CollisionWriter(const CollisionWriter &) = delete;
+    CollisionWriter &operator=(const CollisionWriter &) = delete;
+
+    // Queue a row for the CSV file
+    void write(CollisionInfo collision);
+
+    // Queue an entry for the collision log; entries are numbered in queue order
+    void write(CollisionLogEntry entry);
+
+    // Block until everything queued so far has been written and flushed
+    void flush();
+
+    // Queue a checkpoint mark. Once every record queued before it is on disk
+    // (fsync'd), the writer thread fulfils the future with the file sizes and
+    // binary tails a resumed run restores; the caller does not wait for that.
+    std::future<OutputCheckpoint> checkpoint();
+
+    // Flush and stop the writer thread; further writes are dropped
+    void close();
+
+private:
+    struct CheckpointMark
+    {
+        std::promise<OutputCheckpoint> done;
+    };
+    using Record = std::variant<CollisionInfo, CollisionLogEntry, CheckpointMark>;
+
+    struct Sink
+    {
+        std::string fileName;
+        std::FILE *file = nullptr;
+        bool failed = false;
+        std::string buffer;
+        uint64_t bytes = 0; // File size once buffer is written out
+    };
+
+    void push(Record record);
+    void run();
+    void format(CollisionInfo &collision);
+    void format(CollisionLogEntry &entry);
+    void format(CheckpointMark &mark);
+    uint64_t syncedSize(Sink &sink);
+    bool open(Sink &sink, const char *header);
+    void writeOut(Sink &sink);
+
+    Options options;
+    Sink csv;
+    Sink log;
+    AnomalyFileWriter binary;
+    bool binaryFailed = false;
+    CompactAnomalyFileWriter compact;
+    bool compactFailed = false;
+    int collisionCount = 0;
+
+    // Ring buffer shared with producers
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::condition_variable flushed;
+    std::vector<Record> ring;
+    size_t head = 0;
+    size_t count = 0;
+    unsigned long long queued = 0;
+    unsigned long long written = 0;
+    unsigned long long flushTarget = 0;
+    bool stopping = false;
+    bool closed = false;
+
+    std::thread worker;
+};
+
+#endif // COLLISION_WRITER_H
@@ -0,0 +1,527 @@
+#include "CompactAnomalyFile.h"
+#include "AlignedAllocator.h"
+#include "AnomalyCsv.h"
+#include "AnomalyFile.h"
+#include "Metrics.h"
+#include "Wave.h"
+#include "WaveKernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace
+{
+    // start + count * size <= limit, without overflowing
+    bool fitsBefore(uint64_t start, uint64_t count, uint64_t size, uint64_t limit)
+    {
+        uint64_t bytes, end;
+        return !__builtin_mul_overflow(count, size, &bytes) && !__builtin_add_overflow(start, bytes, &end) &&
+               end <= limit;
+    }
+
+    // Header checks shared by the reader and the appending writer
+    bool validHeader(const CompactAnomalyFileHeader &header, uint64_t fileSize)
+    {
+        if (std::memcmp(header.magic, COMPACT_ANOMALY_FILE_MAGIC, sizeof(header.magic)) != 0)
+            return false;
+        if (header.version != COMPACT_ANOMALY_FILE_VERSION || header.recordOffset == 0)
+            return false;
+        if (header.synthMode > static_cast<uint8_t>(WaveSynthMode::Polynomial) ||
+            header.sampleCount > MAX_WAVE_SAMPLES)
+            return false;
+        return header.runOffset >= sizeof(CompactAnomalyFileHeader) &&
+               header.runOffset <= header.recordOffset &&
+               fitsBefore(header.recordOffset, header.recordCount, sizeof(CompactAnomalyRecord),
+                          header.stringOffset) &&
+               fitsBefore(header.stringOffset, 1, header.stringBytes, fileSize) &&
+               header.stringBytes >= sizeof(uint32_t);
+    }
+
+    // Unsigned LEB128: seven bits per byte, low bits first, high bit set on
+    // every byte but the last
+    void appendVarint(std::vector<uint8_t> &out, uint32_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    bool readVarint(const uint8_t *&data, const uint8_t *end, uint64_t &value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 35 && data < end; shift += 7)
+        {
+            const uint8_t byte = *data++;
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return true;
+        }
+        return false;
+    }
+}
+
+void reconstructAnomalyWave(float amplitude1, float frequency1, float amplitude2, float frequency2,
+                            size_t sampleCount, WaveSynthMode mode, float *combined)
+{
+    AlignedVector<float> wave1(sampleCount);
+    AlignedVector<float> wave2(sampleCount);
+    const float spacing = sampleSpacing(sampleCount);
+    synthesizeWave(amplitude1, frequency1, wave1.data(), sampleCount, mode, spacing);
+    synthesizeWave(amplitude2, frequency2, wave2.data(), sampleCount, mode, spacing);
+    combineAndDetectBreaches(wave1.data(), wave2.data(), sampleCount, 0.0f, nullptr, combined);
+}
+
+size_t encodeBreachRuns(const float *combined, size_t sampleCount, float threshold, std::vector<BreachRun> &runs)
+{
+    size_t breaches = 0;
+    size_t i = 0;
+    while (i < sampleCount)
+    {
+        if (!(std::abs(combined[i]) > threshold))
+        {
+            ++i;
+            continue;
+        }
+        const size_t start = i;
+        while (i < sampleCount && std::abs(combined[i]) > threshold)
+            ++i;
+        runs.push_back(BreachRun{static_cast<uint32_t>(start), static_cast<uint32_t>(i - start)});
+        breaches += i - start;
+    }
+    return breaches;
+}
+
+void packBreachRuns(const std::vector<BreachRun> &runs, std::vector<uint8_t> &out)
+{
+    uint32_t previousEnd = 0;
+    for (const BreachRun &run : runs)
+    {
+        appendVarint(out, run.start - previousEnd);
+        appendVarint(out, run.length);
+        previousEnd = run.start + run.length;
+    }
+}
+
+bool unpackBreachRuns(const uint8_t *data, const uint8_t *end, size_t runCount, std::vector<BreachRun> &runs)
+{
+    uint64_t previousEnd = 0;
+    for (size_t r = 0; r < runCount; ++r)
+    {
+        uint64_t gap;
+        uint64_t length;
+        if (!readVarint(data, end, gap) || !readVarint(data, end, length))
+            return false;
+        const uint64_t start = previousEnd + gap;
+        previousEnd = start + length;
+        if (previousEnd > UINT32_MAX)
+            return false;
+        runs.push_back(BreachRun{static_cast<uint32_t>(start), static_cast<uint32_t>(length)});
+    }
+    return true;
+}
+
+void expandBreachRuns(const std::vector<BreachRun> &runs, const float *combined, size_t sampleCount,
+                      std::vector<std::pair<int, float>> &breachPoints)
+{
+    for (const BreachRun &run : runs)
+    {
+        // Runs past the end of the wave come from a damaged file; keep what fits
+        const size_t start = std::min<size_t>(run.start, sampleCount);
+        const size_t end = std::min<size_t>(start + run.length, sampleCount);
+        for (size_t i = start; i < end; ++i)
+            breachPoints.emplace_back(static_cast<int>(i), combined[i]);
+    }
+}
+
+bool CompactAnomalyFileWriter::open(const std::string &fileName, WaveSynthMode mode, float threshold)
+{
+    close();
+    records.clear();
+    strings.clear();
+    stringIds.clear();
+    runBytes = 0;
+
+    if (!loadExisting(fileName))
+        return false;
+
+    if (file && (header.synthMode != static_cast<uint8_t>(mode) || header.threshold != threshold))
+    {
+        std::cerr << fileName << " was written with a different wave synthesis mode or threshold; "
+                  << "not appending to it." << std::endl;
+        std::fclose(file);
+        file = nullptr;
+        return false;
+    }
+
+    if (!file)
+    {
+        file = std::fopen(fileName.c_str(), "w+b");
+        if (!file)
+        {
+            std::cerr << "Error opening " << fileName << " for writing." << std::endl;
+            return false;
+        }
+        header = CompactAnomalyFileHeader{};
+        std::memcpy(header.magic, COMPACT_ANOMALY_FILE_MAGIC, sizeof(header.magic));
+        header.version = COMPACT_ANOMALY_FILE_VERSION;
+        header.synthMode = static_cast<uint8_t>(mode);
+        header.threshold = threshold;
+        header.runOffset = sizeof(CompactAnomalyFileHeader);
+    }
+
+    // Keep the file's current tail in the journal until close() replaces it
+    std::string tail;
+    finalTail(tail);
+    if (!writeAnomalyJournal(fileName, tail))
+    {
+        std::fclose(file);
+        file = nullptr;
+        return false;
+    }
+    journalName = anomalyJournalName(fileName);
+
+    // Mark the file as open (recordOffset == 0) until close() writes the tables
+    CompactAnomalyFileHeader openHeader = header;
+    openHeader.recordOffset = 0;
+    std::fseek(file, 0, SEEK_SET);
+    std::fwrite(&openHeader, sizeof(openHeader), 1, file);
+    fseeko(file, off_t(header.runOffset + runBytes), SEEK_SET);
+    return true;
+}
+
+bool CompactAnomalyFileWriter::prepareAppend(const std::string &fileName)
+{
+    CompactAnomalyFileReader existing;
+    if (existing.open(fileName))
+        return true;
+
+    // Missing and empty files are started from scratch
+    {
+        std::ifstream probe(fileName, std::ios::binary | std::ios::ate);
+        if (!probe.is_open() || probe.tellg() == 0)
+            return true;
+    }
+
+    // Left open by a run that died: go back to the tail in the journal
+    std::string tail;
+    CompactAnomalyFileHeader closed;
+    if (readAnomalyJournal(fileName, tail) && tail.size() >= sizeof(closed))
+    {
+        std::memcpy(&closed, tail.data(), sizeof(closed));
+        if (validHeader(closed, closed.recordOffset + (tail.size() - sizeof(closed))) && restore(fileName, tail) &&
+            existing.open(fileName))
+        {
+            std::cerr << fileName << " was left incomplete by an interrupted run; restored its " << existing.size()
+                      << " earlier records." << std::endl;
+            return true;
+        }
+    }
+    std::cerr << fileName << " is not a complete compact anomaly file and has no usable journal; "
+              << "not appending to it." << std::endl;
+    return false;
+}
+
+bool CompactAnomalyFileWriter::loadExisting(const std::string &fileName)
+{
+    if (!prepareAppend(fileName))
+        return false;
+
+    // Missing and empty files are started from scratch
+    CompactAnomalyFileReader existing;
+    if (!existing.open(fileName))
+        return true;
+
+    header = existing.fileHeader();
+    runBytes = header.recordOffset - header.runOffset;
+    for (size_t i = 0; i < existing.size(); ++i)
+        records.push_back(existing.record(i));
+    for (uint32_t id = 0; id < existing.stringTableSize(); ++id)
+    {
+        strings.emplace_back(existing.string(id));
+        stringIds.emplace(strings.back(), id);
+    }
+
+    file = std::fopen(fileName.c_str(), "r+b");
+    if (!file)
+    {
+        std::cerr << "Error opening " << fileName << " for writing." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+uint32_t CompactAnomalyFileWriter::intern(const std::string &text)
+{
+    auto found = stringIds.find(text);
+    if (found != stringIds.end())
+        return found->second;
+
+    uint32_t id = static_cast<uint32_t>(strings.size());
+    strings.push_back(text);
+    stringIds.emplace(text, id);
+    return id;
+}
+
+bool CompactAnomalyFileWriter::write(const std::string &particle1, const std::string &particle2,
+                                     const std::string &interactionInfo, float amplitude1, float frequency1,
+                                     float amplitude2, float frequency2, const float *combined, size_t sampleCount)
+{
+    if (!file)
+        return false;
+
+    if (header.recordCount == 0)
+    {
+        header.sampleCount = static_cast<uint32_t>(sampleCount);
+    }
+    else if (sampleCount != header.sampleCount)
+    {
+        std::cerr << "Anomaly wave has " << sampleCount << " samples, file expects "
+                  << header.sampleCount << "; record skipped." << std::endl;
+        return false;
+    }
+
+    CompactAnomalyRecord record{};
+    record.particle1 = intern(particle1);
+    record.particle2 = intern(particle2);
+    record.interactionInfo = intern(interactionInfo);
+    record.amplitude1 = amplitude1;
+    record.frequency1 = frequency1;
+    record.amplitude2 = amplitude2;
+    record.frequency2 = frequency2;
+    record.runData = runBytes;
+
+    runs.clear();
+    packed.clear();
+    record.breachCount = static_cast<uint32_t>(encodeBreachRuns(combined, sampleCount, header.threshold, runs));
+    record.runCount = static_cast<uint32_t>(runs.size());
+    packBreachRuns(runs, packed);
+    for (size_t i = 0; i < sampleCount; ++i)
+        record.peakAmplitude = std::max(record.peakAmplitude, std::abs(combined[i]));
+
+    RATTRAP_TIME(FileWrite);
+    RATTRAP_COUNT(BytesWritten, packed.size());
+    std::fwrite(packed.data(), 1, packed.size(), file);
+    runBytes += packed.size();
+
+    records.push_back(record);
+    ++header.recordCount;
+    return true;
+}
+
+void CompactAnomalyFileWriter::finalTables(CompactAnomalyFileHeader &closed, std::string &tables) const
+{
+    closed = header;
+    closed.recordOffset = header.runOffset + runBytes;
+    tables.assign(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(CompactAnomalyRecord));
+
+    // String table: count, offsets, bytes
+    std::vector<uint32_t> offsets;
+    offsets.reserve(strings.size() + 1);
+    uint32_t offset = 0;
+    for (const std::string &text : strings)
+    {
+        offsets.push_back(offset);
+        offset += static_cast<uint32_t>(text.size());
+    }
+    offsets.push_back(offset);
+
+    uint32_t stringCount = static_cast<uint32_t>(strings.size());
+    closed.stringOffset = closed.recordOffset + tables.size();
+    tables.append(reinterpret_cast<const char *>(&stringCount), sizeof(stringCount));
+    tables.append(reinterpret_cast<const char *>(offsets.data()), offsets.size() * sizeof(uint32_t));
+    for (const std::string &text : strings)
+        tables += text;
+    closed.stringBytes = sizeof(uint32_t) * (offsets.size() + 1) + offset;
+}
+
+void CompactAnomalyFileWriter::finalTail(std::string &tail) const
+{
+    CompactAnomalyFileHeader closed;
+    std::string tables;
+    finalTables(closed, tables);
+    tail.assign(reinterpret_cast<const char *>(&closed), sizeof(closed));
+    tail += tables;
+}
+
+bool CompactAnomalyFileWriter::close()
+{
+    if (!file)
+        return true;
+
+    RATTRAP_TIME(FileWrite);
+    std::string tables;
+    finalTables(header, tables);
+    fseeko(file, off_t(header.recordOffset), SEEK_SET);
+    std::fwrite(tables.data(), 1, tables.size(), file);
+    RATTRAP_COUNT(BytesWritten, tables.size());
+
+    std::fseek(file, 0, SEEK_SET);
+    std::fwrite(&header, sizeof(header), 1, file);
+    bool ok = std::ferror(file) == 0 && std::fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = std::fclose(file) == 0 && ok;
+    file = nullptr;
+
+    // The file is complete again; a failed close keeps the journal to roll back to
+    if (ok)
+        std::remove(journalName.c_str());
+    return ok;
+}
+
+bool CompactAnomalyFileWriter::checkpoint(std::string &tail)
+{
+    if (!file)
+        return false;
+
+    finalTail(tail);
+    return std::fflush(file) == 0 && fsync(fileno(file)) == 0;
+}
+
+bool CompactAnomalyFileWriter::restore(const std::string &fileName, const std::string &tail)
+{
+    CompactAnomalyFileHeader closed;
+    if (tail.size() < sizeof(closed))
+        return false;
+    std::memcpy(&closed, tail.data(), sizeof(closed));
+
+    // The runs must still all be there; anything after them is from after the checkpoint
+    std::FILE *output = std::fopen(fileName.c_str(), "r+b");
+    if (!output)
+        return false;
+    bool ok = fseeko(output, 0, SEEK_END) == 0 && static_cast<uint64_t>(ftello(output)) >= closed.recordOffset &&
+              ftruncate(fileno(output), off_t(closed.recordOffset)) == 0;
+    if (ok)
+    {
+        fseeko(output, off_t(closed.recordOffset), SEEK_SET);
+        std::fwrite(tail.data() + sizeof(closed), 1, tail.size() - sizeof(closed), output);
+        std::fseek(output, 0, SEEK_SET);
+        std::fwrite(&closed, sizeof(closed), 1, output);
+        ok = std::ferror(output) == 0;
+    }
+    ok = std::fclose(output) == 0 && ok;
+    return ok;
+}
+
+bool CompactAnomalyFileReader::isCompactAnomalyFile(const std::string &fileName)
+{
+    std::ifstream probe(fileName, std::ios::binary);
+    char magic[sizeof(COMPACT_ANOMALY_FILE_MAGIC)] = {};
+    probe.read(magic, sizeof(magic));
+    return probe.gcount() == sizeof(magic) && std::memcmp(magic, COMPACT_ANOMALY_FILE_MAGIC, sizeof(magic)) == 0;
+}
+
+bool CompactAnomalyFileReader::open(const std::string &fileName)
+{
+    header = nullptr;
+    if (!file.open(fileName) || file.size() < sizeof(CompactAnomalyFileHeader))
+        return false;
+
+    const auto *candidate = reinterpret_cast<const CompactAnomalyFileHeader *>(file.data());
+    if (!validHeader(*candidate, file.size()))
+        return false;
+
+    const char *table = file.data() + candidate->stringOffset;
+    std::memcpy(&stringCount, table, sizeof(stringCount));
+    uint64_t offsetBytes = (uint64_t(stringCount) + 1) * sizeof(uint32_t);
+    if (sizeof(uint32_t) + offsetBytes > candidate->stringBytes)
+        return false;
+
+    // Strings must run in order and end inside the table
+    stringOffsets = table + sizeof(uint32_t);
+    stringData = table + sizeof(uint32_t) + offsetBytes;
+    if (stringOffset(stringCount) > candidate->stringBytes - sizeof(uint32_t) - offsetBytes)
+        return false;
+    for (uint32_t id = 0; id < stringCount; ++id)
+    {
+        if (stringOffset(id) > stringOffset(id + 1))
+            return false;
+    }
+
+    runData = reinterpret_cast<const uint8_t *>(file.data() + candidate->runOffset);
+    runBytes = candidate->recordOffset - candidate->runOffset;
+    records = file.data() + candidate->recordOffset;
+    header = candidate;
+    return true;
+}
+
+Anomaly CompactAnomalyFileReader::decode(size_t index) const
+{
+    Anomaly anomaly;
+    const CompactAnomalyRecord entry = record(index);
+    anomaly.particle1 = std::string(string(entry.particle1));
+    anomaly.particle2 = std::string(string(entry.particle2));
+    anomaly.interactionInfo = std::string(string(entry.interactionInfo));
+
+    anomaly.waveData.resize(header->sampleCount);
+    reconstructAnomalyWave(entry.amplitude1, entry.frequency1, entry.amplitude2, entry.frequency2,
+                           header->sampleCount, synthMode(), anomaly.waveData.data());
+
+    std::vector<BreachRun> runs;
+    if (breachRuns(index, runs))
+    {
+        anomaly.breachPoints.reserve(entry.breachCount);
+        expandBreachRuns(runs, anomaly.waveData.data(), anomaly.waveData.size(), anomaly.breachPoints);
+    }
+    return anomaly;
+}
+
+bool CompactAnomalyFileReader::breachRuns(size_t index, std::vector<BreachRun> &runs) const
+{
+    const CompactAnomalyRecord entry = record(index);
+    if (entry.runData > runBytes)
+        return false;
+    runs.reserve(runs.size() + entry.runCount);
+    return unpackBreachRuns(runData + entry.runData, runData + runBytes, entry.runCount, runs);
+}
+
+bool convertCompactAnomalyFileToCsv(const std::string &compactFileName, const std::string &csvFileName)
+{
+    CompactAnomalyFileReader reader;
+    if (!reader.open(compactFileName))
+        return false;
+
+    std::FILE *output = std::fopen(csvFileName.c_str(), "wb");
+    if (!output)
+        return false;
+
+    std::string buffer = ANOMALY_CSV_HEADER;
+    for (size_t i = 0; i < reader.size(); ++i)
+    {
+        const Anomaly anomaly = reader.decode(i);
+        appendAnomalyCsvRow(buffer, anomaly.particle1, anomaly.particle2, anomaly.interactionInfo,
+                            anomaly.waveData.data(), anomaly.waveData.size());
+        if (buffer.size() >= (size_t(1) << 20))
+        {
+            std::fwrite(buffer.data(), 1, buffer.size(), output);
+            buffer.clear();
+        }
+    }
+    std::fwrite(buffer.data(), 1, buffer.size(), output);
+    return std::fclose(output) == 0;
+}
+
+bool convertCompactAnomalyFileToAnomalyFile(const std::string &compactFileName, const std::string &anomalyFileName)
+{
+    CompactAnomalyFileReader reader;
+    if (!reader.open(compactFileName))
+        return false;
+
+    std::remove(anomalyFileName.c_str());
+    AnomalyFileWriter writer;
+    if (!writer.open(anomalyFileName))
+        return false;
+
+    for (size_t i = 0; i < reader.size(); ++i)
+    {
+        const Anomaly anomaly = reader.decode(i);
+        writer.write(anomaly.particle1, anomaly.particle2, anomaly.interactionInfo, anomaly.waveData.data(),
+                     anomaly.waveData.size());
+    }
+    return writer.close();
+}
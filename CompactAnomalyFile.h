@@ -0,0 +1,211 @@
+#ifndef COMPACT_ANOMALY_FILE_H
+#define COMPACT_ANOMALY_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Anomaly.h"
+#include "MappedFile.h"
+#include "WaveSynth.h"
+
+// Parametric anomaly file (.rtc). A combined wave is fully determined by the
+// two particles' amplitude and frequency, the sample count and the synthesis
+// mode, so instead of samples each record keeps those parameters plus where
+// the wave breaches, as runs of consecutive samples. Samples are rebuilt with
+// reconstructAnomalyWave() only when a record is read.
+//
+//   CompactAnomalyFileHeader  64 bytes
+//   packed runs               the breach runs of every record, back to back;
+//                             each run is two LEB128 varints, the gap since the
+//                             end of the previous run and the run length
+//   CompactAnomalyRecord[]    one per anomaly; each points at its runs
+//   string table              uint32 count, uint32 offsets[count + 1], then the
+//                             bytes of every string back to back (no NULs)
+//
+// All values are little-endian. A file whose recordOffset is 0 was not closed
+// properly and is rejected by the reader.
+
+constexpr char COMPACT_ANOMALY_FILE_MAGIC[8] = {'R', 'T', 'C', 'O', 'M', 'P', 'C', 'T'};
+constexpr uint32_t COMPACT_ANOMALY_FILE_VERSION = 1;
+
+struct CompactAnomalyFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t sampleCount;    // Samples in every combined wave
+    uint8_t synthMode;       // WaveSynthMode the waves were generated with
+    uint8_t reserved[3];
+    float threshold;         // A sample breaches when its magnitude is above this
+    uint64_t recordCount;
+    uint64_t runOffset;      // Packed runs
+    uint64_t recordOffset;   // CompactAnomalyRecord table
+    uint64_t stringOffset;   // String table
+    uint64_t stringBytes;    // Size of the string table
+};
+static_assert(sizeof(CompactAnomalyFileHeader) == 64, "CompactAnomalyFileHeader must stay 64 bytes");
+
+// Samples start, start + 1, ..., start + length - 1 all breach
+struct BreachRun
+{
+    uint32_t start;
+    uint32_t length;
+};
+
+struct CompactAnomalyRecord
+{
+    uint32_t particle1;        // String table index
+    uint32_t particle2;        // String table index
+    uint32_t interactionInfo;  // String table index
+    uint32_t runCount;
+    uint64_t runData;          // Offset of the record's packed runs from runOffset
+    float amplitude1;
+    float frequency1;
+    float amplitude2;
+    float frequency2;
+    uint32_t breachCount;      // Samples above the threshold
+    float peakAmplitude;       // Largest |sample|
+};
+static_assert(sizeof(CompactAnomalyRecord) == 48, "CompactAnomalyRecord must stay 48 bytes");
+
+// The one routine that turns parameters back into samples. It runs the same
+// two steps as the sweep: each particle's wave is synthesized the way WaveBank
+// generates it, then the two are summed by the pair kernel, so on the machine
+// that wrote a record the result is bit-identical to the logged wave.
+void reconstructAnomalyWave(float amplitude1, float frequency1, float amplitude2, float frequency2,
+                            size_t sampleCount, WaveSynthMode mode, float *combined);
+
+// Append the runs of samples in `combined` whose magnitude is above
+// `threshold` to `runs`; returns how many samples breach
+size_t encodeBreachRuns(const float *combined, size_t sampleCount, float threshold, std::vector<BreachRun> &runs);
+
+// Append `runs`, which must be in order and not overlap, to `out` in the
+// packed file encoding
+void packBreachRuns(const std::vector<BreachRun> &runs, std::vector<uint8_t> &out);
+
+// Read `runCount` packed runs from [data, end) into `runs`; false if the data
+// ends early
+bool unpackBreachRuns(const uint8_t *data, const uint8_t *end, size_t runCount, std::vector<BreachRun> &runs);
+
+// (index, sample) of every sample in `runs`, read from the rebuilt wave
+void expandBreachRuns(const std::vector<BreachRun> &runs, const float *combined, size_t sampleCount,
+                      std::vector<std::pair<int, float>> &breachPoints);
+
+// Streams parametric anomalies into a .rtc file. Runs go straight to disk; the
+// record and string tables are kept in memory and written by close(). Opening
+// an existing, properly closed file appends to it if it was written with the
+// same synthesis mode and threshold.
+class CompactAnomalyFileWriter
+{
+public:
+    CompactAnomalyFileWriter() = default;
+    ~CompactAnomalyFileWriter() { close(); }
+
+    CompactAnomalyFileWriter(const CompactAnomalyFileWriter &) = delete;
+    CompactAnomalyFileWriter &operator=(const CompactAnomalyFileWriter &) = delete;
+
+    bool open(const std::string &fileName, WaveSynthMode mode, float threshold);
+    bool isOpen() const { return file != nullptr; }
+
+    // Same as AnomalyFileWriter::prepareAppend(): roll back a run that died
+    // before close() from the journal, false if the file cannot be appended to
+    static bool prepareAppend(const std::string &fileName);
+
+    // Append one anomaly: the two particles' wave parameters and the combined
+    // wave the sweep logged, from which only the breach runs are kept. Every
+    // record in a file has the same sample count; the first fixes it.
+    bool write(const std::string &particle1, const std::string &particle2, const std::string &interactionInfo,
+               float amplitude1, float frequency1, float amplitude2, float frequency2,
+               const float *combined, size_t sampleCount);
+
+    // Write the tables and the final header, then close the file
+    bool close();
+
+    // Same as AnomalyFileWriter::checkpoint() and restore(), for the runs
+    bool checkpoint(std::string &tail);
+    static bool restore(const std::string &fileName, const std::string &tail);
+
+private:
+    // The header and tables close() would write
+    void finalTables(CompactAnomalyFileHeader &closed, std::string &tables) const;
+    void finalTail(std::string &tail) const;
+    uint32_t intern(const std::string &text);
+    bool loadExisting(const std::string &fileName);
+
+    std::FILE *file = nullptr;
+    std::string journalName;
+    CompactAnomalyFileHeader header{};
+    uint64_t runBytes = 0;
+    std::vector<CompactAnomalyRecord> records;
+    std::vector<BreachRun> runs;
+    std::vector<uint8_t> packed;
+    std::vector<std::string> strings;
+    std::unordered_map<std::string, uint32_t> stringIds;
+};
+
+// Zero-copy view of a .rtc file; samples are rebuilt by decode(). open()
+// checks that the tables lie inside the file, that strings run in order and
+// that the sample count is one a run could have used.
+class CompactAnomalyFileReader
+{
+public:
+    // True if the file starts with the .rtc magic
+    static bool isCompactAnomalyFile(const std::string &fileName);
+
+    bool open(const std::string &fileName);
+    bool isOpen() const { return header != nullptr; }
+
+    const CompactAnomalyFileHeader &fileHeader() const { return *header; }
+    size_t size() const { return header ? header->recordCount : 0; }
+    uint32_t stringTableSize() const { return stringCount; }
+    uint32_t sampleCount() const { return header ? header->sampleCount : 0; }
+    WaveSynthMode synthMode() const { return static_cast<WaveSynthMode>(header->synthMode); }
+
+    // Records and string offsets are copied out of the map, as the packed runs
+    // before them leave the tables at any alignment
+    CompactAnomalyRecord record(size_t index) const
+    {
+        CompactAnomalyRecord entry;
+        std::memcpy(&entry, records + index * sizeof(CompactAnomalyRecord), sizeof(entry));
+        return entry;
+    }
+    // Unpack the breach runs of record `index`; false if they are damaged
+    bool breachRuns(size_t index, std::vector<BreachRun> &runs) const;
+    std::string_view string(uint32_t id) const
+    {
+        if (id >= stringCount)
+            return std::string_view();
+        return std::string_view(stringData + stringOffset(id), stringOffset(id + 1) - stringOffset(id));
+    }
+
+    // Rebuild record `index` into an Anomaly, wave and breach points included
+    Anomaly decode(size_t index) const;
+
+private:
+    uint32_t stringOffset(uint32_t id) const
+    {
+        uint32_t offset;
+        std::memcpy(&offset, stringOffsets + id * sizeof(uint32_t), sizeof(offset));
+        return offset;
+    }
+
+    MappedFile file;
+    const CompactAnomalyFileHeader *header = nullptr;
+    const uint8_t *runData = nullptr;
+    uint64_t runBytes = 0;
+    const char *records = nullptr;
+    const char *stringOffsets = nullptr;
+    const char *stringData = nullptr;
+    uint32_t stringCount = 0;
+};
+
+// Rebuild every record of a .rtc file and write it as collisions.csv or .rta
+bool convertCompactAnomalyFileToCsv(const std::string &compactFileName, const std::string &csvFileName);
+bool convertCompactAnomalyFileToAnomalyFile(const std::string &compactFileName, const std::string &anomalyFileName);
+
+#endif // COMPACT_ANOMALY_FILE_H
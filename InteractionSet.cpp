@@ -0,0 +1,289 @@
+#include "InteractionSet.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+    constexpr char PAIR_FILE_MAGIC[8] = {'R', 'T', 'P', 'A', 'I', 'R', 'S', '1'};
+    constexpr uint32_t PAIR_FILE_VERSION = 1;
+
+    struct PairFileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t nameCount;
+        uint64_t pairCount;
+    };
+    static_assert(sizeof(PairFileHeader) == 32, "PairFileHeader layout is part of the file format");
+
+    // splitmix64 finalizer; spreads the packed (lo, hi) keys over the table
+    uint64_t mix(uint64_t key)
+    {
+        key ^= key >> 30;
+        key *= 0xbf58476d1ce4e5b9ull;
+        key ^= key >> 27;
+        key *= 0x94d049bb133111ebull;
+        key ^= key >> 31;
+        return key;
+    }
+}
+
+PairSet::PairSet(Mode mode) : mode(mode), dense(mode == Mode::Dense)
+{
+}
+
+bool PairSet::insert(uint32_t a, uint32_t b)
+{
+    const uint64_t lo = std::min(a, b);
+    const uint64_t hi = std::max(a, b);
+    if (hi + 1 > idLimit)
+        idLimit = static_cast<uint32_t>(hi + 1);
+
+    if (dense)
+        return insertDense(lo, hi);
+
+    if (!insertSparse(lo << 32 | hi))
+        return false;
+
+    // Switch once the table outweighs a bitset covering every ID seen so far
+    if (mode == Mode::Auto && slots.size() * sizeof(uint64_t) > denseBytes(idLimit))
+        switchToDense();
+    return true;
+}
+
+bool PairSet::contains(uint32_t a, uint32_t b) const
+{
+    const uint64_t lo = std::min(a, b);
+    const uint64_t hi = std::max(a, b);
+    if (hi >= idLimit)
+        return false;
+
+    if (dense)
+    {
+        const uint64_t index = triangleIndex(lo, hi);
+        return index / 64 < bits.size() && ((bits[index / 64] >> (index % 64)) & 1);
+    }
+
+    if (slots.empty())
+        return false;
+    const uint64_t key = lo << 32 | hi;
+    const size_t mask = slots.size() - 1;
+    for (size_t slot = mix(key) & mask;; slot = (slot + 1) & mask)
+    {
+        if (slots[slot] == key)
+            return true;
+        if (slots[slot] == EMPTY)
+            return false;
+    }
+}
+
+void PairSet::clear()
+{
+    bits.clear();
+    slots.clear();
+    count = 0;
+    idLimit = 0;
+    dense = mode == Mode::Dense;
+}
+
+bool PairSet::insertDense(uint64_t lo, uint64_t hi)
+{
+    const uint64_t index = triangleIndex(lo, hi);
+    if (index / 64 >= bits.size())
+        bits.resize(std::max<size_t>(index / 64 + 1, bits.size() * 2), 0);
+
+    uint64_t &word = bits[index / 64];
+    const uint64_t bit = uint64_t(1) << (index % 64);
+    if (word & bit)
+        return false;
+    word |= bit;
+    ++count;
+    return true;
+}
+
+bool PairSet::insertSparse(uint64_t key)
+{
+    if ((count + 1) * 2 > slots.size())
+        growSparse();
+
+    const size_t mask = slots.size() - 1;
+    for (size_t slot = mix(key) & mask;; slot = (slot + 1) & mask)
+    {
+        if (slots[slot] == key)
+            return false;
+        if (slots[slot] == EMPTY)
+        {
+            slots[slot] = key;
+            ++count;
+            return true;
+        }
+    }
+}
+
+void PairSet::growSparse()
+{
+    std::vector<uint64_t> old(std::max<size_t>(16, slots.size() * 2), EMPTY);
+    old.swap(slots);
+
+    const size_t mask = slots.size() - 1;
+    for (uint64_t key : old)
+    {
+        if (key == EMPTY)
+            continue;
+        size_t slot = mix(key) & mask;
+        while (slots[slot] != EMPTY)
+            slot = (slot + 1) & mask;
+        slots[slot] = key;
+    }
+}
+
+void PairSet::switchToDense()
+{
+    std::vector<uint64_t> old;
+    old.swap(slots);
+    dense = true;
+    count = 0;
+    bits.assign(denseBytes(idLimit) / sizeof(uint64_t), 0);
+    for (uint64_t key : old)
+    {
+        if (key != EMPTY)
+            insertDense(key >> 32, key & 0xffffffffu);
+    }
+}
+
+bool InteractionSet::insert(const std::string &name1, const std::string &name2)
+{
+    return pairs.insert(names.intern(name1), names.intern(name2));
+}
+
+bool InteractionSet::contains(const std::string &name1, const std::string &name2) const
+{
+    const uint32_t a = names.find(name1);
+    const uint32_t b = names.find(name2);
+    return a != NameInterner::NOT_FOUND && b != NameInterner::NOT_FOUND && pairs.contains(a, b);
+}
+
+bool InteractionSet::load(const std::string &fileName)
+{
+    // A missing or empty file is an empty set
+    MappedFile file;
+    if (!file.open(fileName) || file.size() == 0)
+        return true;
+    return loadFrom(file.data(), file.size(), fileName);
+}
+
+bool InteractionSet::loadFrom(const char *data, size_t size, const std::string &source)
+{
+    PairFileHeader header;
+    if (size < sizeof(header))
+    {
+        std::cerr << source << " is not an interaction file." << std::endl;
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, PAIR_FILE_MAGIC, sizeof(header.magic)) != 0 || header.version != PAIR_FILE_VERSION)
+    {
+        std::cerr << source << " is not an interaction file." << std::endl;
+        return false;
+    }
+
+    // Every name takes at least its length field and every pair 8 bytes, so
+    // counts the rest of the file cannot hold are refused before anything is
+    // reserved or multiplied
+    const char *p = data + sizeof(header);
+    const char *end = data + size;
+    const uint64_t remaining = static_cast<uint64_t>(end - p);
+    if (header.nameCount > remaining / sizeof(uint32_t) || header.pairCount > remaining / (2 * sizeof(uint32_t)))
+    {
+        std::cerr << source << " is truncated." << std::endl;
+        return false;
+    }
+
+    // Map the file's IDs onto ours
+    std::vector<uint32_t> idMap;
+    idMap.reserve(header.nameCount);
+    for (uint64_t i = 0; i < header.nameCount; ++i)
+    {
+        uint32_t length;
+        if (end - p < static_cast<ptrdiff_t>(sizeof(length)))
+            break;
+        std::memcpy(&length, p, sizeof(length));
+        p += sizeof(length);
+        if (static_cast<uint64_t>(end - p) < length)
+            break;
+        idMap.push_back(names.intern(std::string_view(p, length)));
+        p += length;
+    }
+
+    const uint64_t pairBytes = header.pairCount * 2 * sizeof(uint32_t);
+    if (idMap.size() != header.nameCount || static_cast<uint64_t>(end - p) < pairBytes)
+    {
+        std::cerr << source << " is truncated." << std::endl;
+        return false;
+    }
+
+    for (uint64_t i = 0; i < header.pairCount; ++i, p += 2 * sizeof(uint32_t))
+    {
+        uint32_t ids[2];
+        std::memcpy(ids, p, sizeof(ids));
+        if (ids[0] >= idMap.size() || ids[1] >= idMap.size())
+        {
+            std::cerr << source << " refers to an unknown name." << std::endl;
+            return false;
+        }
+        pairs.insert(idMap[ids[0]], idMap[ids[1]]);
+    }
+    return true;
+}
+
+void InteractionSet::saveTo(std::string &out) const
+{
+    PairFileHeader header{};
+    std::memcpy(header.magic, PAIR_FILE_MAGIC, sizeof(header.magic));
+    header.version = PAIR_FILE_VERSION;
+    header.nameCount = names.size();
+    header.pairCount = pairs.size();
+    out.append(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    for (uint32_t id = 0; id < names.size(); ++id)
+    {
+        const std::string &name = names.name(id);
+        uint32_t length = static_cast<uint32_t>(name.size());
+        out.append(reinterpret_cast<const char *>(&length), sizeof(length));
+        out.append(name.data(), length);
+    }
+
+    pairs.forEach([&](uint32_t lo, uint32_t hi) {
+        const uint32_t ids[2] = {lo, hi};
+        out.append(reinterpret_cast<const char *>(ids), sizeof(ids));
+    });
+}
+
+bool InteractionSet::save(const std::string &fileName) const
+{
+    std::string bytes;
+    saveTo(bytes);
+
+    // Write beside the target and rename, so an interrupted save keeps the old file
+    const std::string tempName = fileName + ".tmp";
+    {
+        std::ofstream output(tempName, std::ios::binary | std::ios::trunc);
+        if (!output)
+        {
+            std::cerr << "Error opening " << tempName << " for writing." << std::endl;
+            return false;
+        }
+        output.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        if (!output.flush())
+        {
+            std::cerr << "Error writing " << tempName << "." << std::endl;
+            return false;
+        }
+    }
+    return std::rename(tempName.c_str(), fileName.c_str()) == 0;
+}
@@ -0,0 +1,133 @@
+#ifndef INTERACTION_SET_H
+#define INTERACTION_SET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "NameInterner.h"
+
+// Set of unordered ID pairs. (a, b) and (b, a) are the same entry.
+//
+// Two representations:
+//  - dense: one bit per pair in a lower-triangular bitset, pair (lo, hi) at
+//    bit hi * (hi + 1) / 2 + lo. Rows are appended as IDs grow, so existing
+//    bits never move. Costs n^2 / 16 bytes for n IDs whatever the fill.
+//  - sparse: open-addressing hash set of 64-bit (lo << 32 | hi) keys with
+//    linear probing, kept at most half full. Costs 16 bytes per entry.
+// In Auto mode the set starts sparse and switches to dense once the hash
+// table would take more memory than the bitset.
+class PairSet
+{
+public:
+    enum class Mode
+    {
+        Auto,
+        Dense,
+        Sparse
+    };
+
+    explicit PairSet(Mode mode = Mode::Auto);
+
+    // Add the pair; false if it was already present
+    bool insert(uint32_t a, uint32_t b);
+    bool contains(uint32_t a, uint32_t b) const;
+
+    size_t size() const { return count; }
+    bool isDense() const { return dense; }
+    size_t memoryBytes() const { return (bits.capacity() + slots.capacity()) * sizeof(uint64_t); }
+    void clear();
+
+    // Every pair as (lo, hi), lo <= hi; dense sets visit them in index order
+    template <typename Visit>
+    void forEach(Visit visit) const
+    {
+        if (dense)
+        {
+            uint64_t hi = 0;
+            for (size_t w = 0; w < bits.size(); ++w)
+            {
+                for (uint64_t word = bits[w]; word != 0; word &= word - 1)
+                {
+                    const uint64_t index = w * 64 + static_cast<uint64_t>(__builtin_ctzll(word));
+                    while (triangleIndex(0, hi + 1) <= index)
+                        ++hi;
+                    visit(static_cast<uint32_t>(index - triangleIndex(0, hi)), static_cast<uint32_t>(hi));
+                }
+            }
+            return;
+        }
+        for (uint64_t key : slots)
+        {
+            if (key != EMPTY)
+                visit(static_cast<uint32_t>(key >> 32), static_cast<uint32_t>(key));
+        }
+    }
+
+private:
+    static constexpr uint64_t EMPTY = UINT64_MAX;
+
+    static uint64_t triangleIndex(uint64_t lo, uint64_t hi) { return hi * (hi + 1) / 2 + lo; }
+    static uint64_t denseBytes(uint64_t idCount) { return (triangleIndex(0, idCount) + 63) / 64 * 8; }
+
+    bool insertDense(uint64_t lo, uint64_t hi);
+    bool insertSparse(uint64_t key);
+    void growSparse();
+    void switchToDense();
+
+    Mode mode;
+    bool dense;
+    size_t count = 0;
+    uint32_t idLimit = 0; // One past the largest ID inserted
+    std::vector<uint64_t> bits;
+    std::vector<uint64_t> slots;
+};
+
+// The interactions logged so far, keyed by particle name.
+//
+// Names are interned to dense IDs once per particle, so checking a pair is an
+// integer lookup rather than building and hashing a "<name1>-<name2>" string.
+// The set can be saved and loaded to skip pairs logged by earlier runs; the
+// file stores the names, so IDs do not need to match between runs.
+//
+// File layout (little-endian): magic "RTPAIRS1", uint32 version, uint32
+// reserved, uint64 nameCount, uint64 pairCount, then nameCount names as
+// (uint32 length, bytes) and pairCount (uint32 lo, uint32 hi) ID pairs.
+class InteractionSet
+{
+public:
+    explicit InteractionSet(PairSet::Mode mode = PairSet::Mode::Auto) : pairs(mode) {}
+
+    uint32_t intern(const std::string &name) { return names.intern(name); }
+
+    // Record the interaction between two interned IDs; false if already logged
+    bool insert(uint32_t a, uint32_t b) { return pairs.insert(a, b); }
+    bool contains(uint32_t a, uint32_t b) const { return pairs.contains(a, b); }
+
+    // Same, by name
+    bool insert(const std::string &name1, const std::string &name2);
+    bool contains(const std::string &name1, const std::string &name2) const;
+
+    size_t size() const { return pairs.size(); }
+    const NameInterner &interner() const { return names; }
+    const PairSet &pairSet() const { return pairs; }
+
+    // Merge the pairs saved in `fileName` into this set. A missing or empty
+    // file adds nothing; false (with a message on std::cerr) if the file is
+    // not a pair file or is truncated.
+    bool load(const std::string &fileName);
+
+    // Replace `fileName` with the current set
+    bool save(const std::string &fileName) const;
+
+    // Same as load() and save(), from and to the bytes of a pair file held in
+    // memory; `source` names the bytes in messages
+    bool loadFrom(const char *data, size_t size, const std::string &source);
+    void saveTo(std::string &out) const;
+
+private:
+    NameInterner names;
+    PairSet pairs;
+};
+
+#endif // INTERACTION_SET_H
@@ -0,0 +1,38 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file (POSIX mmap). Empty files map to
+// an empty view. Movable, not copyable; the mapping is released on destruction.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string &fileName) { open(fileName); }
+    ~MappedFile() { close(); }
+
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // Map `fileName`, replacing any current mapping; returns false if it cannot be opened
+    bool open(const std::string &fileName);
+    void close();
+
+    bool isOpen() const { return opened; }
+    const char *data() const { return bytes; }
+    size_t size() const { return length; }
+
+    // Tell the kernel the file will be read front to back
+    void adviseSequential() const;
+
+private:
+    const char *bytes = nullptr;
+    size_t length = 0;
+    bool opened = false;
+};
+
+#endif // MAPPED_FILE_H
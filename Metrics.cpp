@@ -0,0 +1,256 @@
+#include "Metrics.h"
+#include <cstdio>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+    const char *const COUNTER_NAMES[] = {
+        "pairs_evaluated", "pairs_pruned", "breaches_found", "blocks_refined", "collisions_drawn",
+        "anomalies_logged", "duplicates_skipped", "bytes_written", "anomalies_loaded"};
+    const char *const STAGE_NAMES[] = {
+        "wave_generation", "sweep", "pair_evaluation", "dedup", "logging",
+        "file_write", "interact", "load", "decode", "sampling", "checkpoint"};
+    static_assert(sizeof(COUNTER_NAMES) / sizeof(COUNTER_NAMES[0]) == METRIC_COUNTERS,
+                  "COUNTER_NAMES must name every MetricCounter");
+    static_assert(sizeof(STAGE_NAMES) / sizeof(STAGE_NAMES[0]) == METRIC_STAGES,
+                  "STAGE_NAMES must name every MetricStage");
+
+    // Blocks of live threads, plus the totals of threads that have exited
+    struct Registry
+    {
+        std::mutex mutex;
+        std::vector<ThreadMetrics *> live;
+        MetricsSnapshot retired;
+        size_t retiredThreads = 0;
+
+        // Reference points for converting ticks to seconds
+        uint64_t startTicks = metricsNow();
+        std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+    };
+
+    // Never destroyed, so threads exiting during static destruction can still retire
+    Registry &registry()
+    {
+        static Registry *instance = new Registry;
+        return *instance;
+    }
+
+    // Touch the registry during static initialization so uptime counts from startup
+    const Registry &registryAtStartup = registry();
+
+    void accumulate(MetricsSnapshot &total, const ThreadMetrics &metrics)
+    {
+        for (size_t c = 0; c < METRIC_COUNTERS; ++c)
+            total.counters[c] += metrics.counters[c].load(std::memory_order_relaxed);
+        for (size_t s = 0; s < METRIC_STAGES; ++s)
+        {
+            const ThreadMetrics::StageData &from = metrics.stages[s];
+            MetricsSnapshot::Stage &to = total.stages[s];
+            to.count += from.count.load(std::memory_order_relaxed);
+            to.ticks += from.ticks.load(std::memory_order_relaxed);
+            for (size_t b = 0; b < METRIC_HISTOGRAM_BUCKETS; ++b)
+                to.buckets[b] += from.buckets[b].load(std::memory_order_relaxed);
+        }
+    }
+
+    // Owns a thread's block; folds it into the registry when the thread exits
+    struct ThreadSlot
+    {
+        std::unique_ptr<ThreadMetrics> metrics{new ThreadMetrics};
+
+        ThreadSlot()
+        {
+            Registry &r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            r.live.push_back(metrics.get());
+        }
+
+        ~ThreadSlot()
+        {
+            Registry &r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            accumulate(r.retired, *metrics);
+            ++r.retiredThreads;
+            for (size_t i = 0; i < r.live.size(); ++i)
+            {
+                if (r.live[i] == metrics.get())
+                {
+                    r.live[i] = r.live.back();
+                    r.live.pop_back();
+                    break;
+                }
+            }
+        }
+    };
+
+    // Upper bound of histogram bucket `b`, in seconds
+    double bucketBound(const MetricsSnapshot &snapshot, size_t b)
+    {
+        return static_cast<double>(uint64_t(2) << b) * snapshot.secondsPerTick;
+    }
+
+    bool endsWith(const std::string &text, const char *suffix)
+    {
+        const std::string tail(suffix);
+        return text.size() >= tail.size() && text.compare(text.size() - tail.size(), tail.size(), tail) == 0;
+    }
+}
+
+const char *metricCounterName(MetricCounter counter)
+{
+    return COUNTER_NAMES[static_cast<size_t>(counter)];
+}
+
+const char *metricStageName(MetricStage stage)
+{
+    return STAGE_NAMES[static_cast<size_t>(stage)];
+}
+
+ThreadMetrics &threadMetrics()
+{
+    thread_local ThreadSlot slot;
+    return *slot.metrics;
+}
+
+MetricsSnapshot takeMetricsSnapshot()
+{
+    Registry &r = registry();
+    MetricsSnapshot snapshot;
+    {
+        std::lock_guard<std::mutex> lock(r.mutex);
+        snapshot = r.retired;
+        for (const ThreadMetrics *metrics : r.live)
+            accumulate(snapshot, *metrics);
+        snapshot.threads = r.live.size() + r.retiredThreads;
+    }
+
+    const uint64_t ticks = metricsNow() - r.startTicks;
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - r.startTime).count();
+    snapshot.uptimeSeconds = seconds;
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(RATTRAP_METRICS_STEADY_CLOCK)
+    // Calibrate the TSC against steady_clock over the whole uptime
+    snapshot.secondsPerTick = ticks > 0 ? seconds / static_cast<double>(ticks) : 0;
+#else
+    (void)ticks;
+    snapshot.secondsPerTick = 1e-9;
+#endif
+    return snapshot;
+}
+
+std::string formatMetricsJson(const MetricsSnapshot &snapshot)
+{
+    std::ostringstream out;
+    out.precision(9);
+    out << "{\n";
+    out << "  \"uptime_seconds\": " << snapshot.uptimeSeconds << ",\n";
+    out << "  \"threads\": " << snapshot.threads << ",\n";
+
+    out << "  \"counters\": {";
+    for (size_t c = 0; c < METRIC_COUNTERS; ++c)
+        out << (c ? ", " : "") << "\"" << COUNTER_NAMES[c] << "\": " << snapshot.counters[c];
+    out << "},\n";
+
+    out << "  \"stages\": {\n";
+    for (size_t s = 0; s < METRIC_STAGES; ++s)
+    {
+        const MetricsSnapshot::Stage &stage = snapshot.stages[s];
+        const double total = static_cast<double>(stage.ticks) * snapshot.secondsPerTick;
+        out << "    \"" << STAGE_NAMES[s] << "\": {\"count\": " << stage.count
+            << ", \"total_seconds\": " << total
+            << ", \"mean_seconds\": " << (stage.count ? total / stage.count : 0.0)
+            << ", \"histogram\": [";
+        bool first = true;
+        for (size_t b = 0; b < METRIC_HISTOGRAM_BUCKETS; ++b)
+        {
+            if (stage.buckets[b] == 0)
+                continue;
+            out << (first ? "" : ", ") << "{\"le_seconds\": " << bucketBound(snapshot, b)
+                << ", \"count\": " << stage.buckets[b] << "}";
+            first = false;
+        }
+        out << "]}" << (s + 1 < METRIC_STAGES ? "," : "") << "\n";
+    }
+    out << "  }\n";
+    out << "}\n";
+    return out.str();
+}
+
+std::string formatMetricsPrometheus(const MetricsSnapshot &snapshot)
+{
+    std::ostringstream out;
+    out.precision(9);
+    out << "# TYPE rattrap_uptime_seconds gauge\n";
+    out << "rattrap_uptime_seconds " << snapshot.uptimeSeconds << "\n";
+    for (size_t c = 0; c < METRIC_COUNTERS; ++c)
+    {
+        out << "# TYPE rattrap_" << COUNTER_NAMES[c] << "_total counter\n";
+        out << "rattrap_" << COUNTER_NAMES[c] << "_total " << snapshot.counters[c] << "\n";
+    }
+
+    out << "# TYPE rattrap_stage_seconds histogram\n";
+    for (size_t s = 0; s < METRIC_STAGES; ++s)
+    {
+        const MetricsSnapshot::Stage &stage = snapshot.stages[s];
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b + 1 < METRIC_HISTOGRAM_BUCKETS; ++b)
+        {
+            if (stage.buckets[b] == 0)
+                continue;
+            cumulative += stage.buckets[b];
+            out << "rattrap_stage_seconds_bucket{stage=\"" << STAGE_NAMES[s] << "\",le=\""
+                << bucketBound(snapshot, b) << "\"} " << cumulative << "\n";
+        }
+        out << "rattrap_stage_seconds_bucket{stage=\"" << STAGE_NAMES[s] << "\",le=\"+Inf\"} " << stage.count << "\n";
+        out << "rattrap_stage_seconds_sum{stage=\"" << STAGE_NAMES[s] << "\"} "
+            << static_cast<double>(stage.ticks) * snapshot.secondsPerTick << "\n";
+        out << "rattrap_stage_seconds_count{stage=\"" << STAGE_NAMES[s] << "\"} " << stage.count << "\n";
+    }
+    return out.str();
+}
+
+bool writeMetricsFile(const std::string &fileName)
+{
+    const MetricsSnapshot snapshot = takeMetricsSnapshot();
+    const std::string text = endsWith(fileName, ".prom") || endsWith(fileName, ".txt")
+                                 ? formatMetricsPrometheus(snapshot)
+                                 : formatMetricsJson(snapshot);
+
+    // Write beside the target and rename, so readers never see a partial file
+    const std::string tempName = fileName + ".tmp";
+    std::FILE *file = std::fopen(tempName.c_str(), "wb");
+    if (!file)
+        return false;
+    bool ok = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+    ok = std::fclose(file) == 0 && ok;
+    return ok && std::rename(tempName.c_str(), fileName.c_str()) == 0;
+}
+
+MetricsExporter::MetricsExporter(std::string fileName, std::chrono::milliseconds interval)
+    : fileName(std::move(fileName)), interval(interval)
+{
+    thread = std::thread(&MetricsExporter::run, this);
+}
+
+MetricsExporter::~MetricsExporter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+    writeMetricsFile(fileName);
+}
+
+void MetricsExporter::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!wake.wait_for(lock, interval, [this] { return stopping; }))
+    {
+        lock.unlock();
+        writeMetricsFile(fileName);
+        lock.lock();
+    }
+}
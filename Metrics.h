@@ -0,0 +1,200 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Run-time instrumentation: event counters and per-stage timers.
+//
+// Every thread updates its own block of counters and histograms, so recording
+// is a plain relaxed load/store with no sharing between threads; snapshots sum
+// the blocks of live threads plus everything left behind by threads that have
+// exited. Timers read the TSC where available (steady_clock otherwise, or with
+// RATTRAP_METRICS_STEADY_CLOCK) and are converted to seconds when a snapshot
+// is taken. Durations go into log2-scale histograms of ticks.
+//
+// Instrumentation points use RATTRAP_COUNT and RATTRAP_TIME. Without
+// RATTRAP_METRICS defined both expand to nothing.
+
+enum class MetricCounter
+{
+    PairsEvaluated,    // Pairs whose combined wave was checked
+    PairsPruned,       // Pairs ruled out by the amplitude bound without sampling
+    BreachesFound,     // Pairs that breached the threshold
+    BlocksRefined,     // Coarse blocks the Lipschitz bound could not certify
+    CollisionsDrawn,   // Random collisions tallied in Monte Carlo mode
+    AnomaliesLogged,   // Anomalies handed to the writer after dedup
+    DuplicatesSkipped, // Anomalies dropped by dedup
+    BytesWritten,      // Bytes written to the CSV, log and binary files
+    AnomaliesLoaded,   // Records indexed or parsed when reading anomaly files
+    Count
+};
+
+enum class MetricStage
+{
+    WaveGeneration, // WaveBank::sync
+    Sweep,          // checkAndLogInteractions, start to finish
+    PairEvaluation, // One chunk of pairs on a worker
+    Dedup,          // Interaction ID lookup
+    Logging,        // logNewCollision, including waiting for queue space
+    FileWrite,      // Writer thread output
+    Interact,       // Coil::interact
+    Load,           // Opening or parsing an anomaly file or catalog
+    Decode,         // Decoding one stored anomaly
+    Sampling,       // One task's range of Monte Carlo draws
+    Checkpoint,     // Snapshotting run state on the calling thread
+    Count
+};
+
+constexpr size_t METRIC_COUNTERS = static_cast<size_t>(MetricCounter::Count);
+constexpr size_t METRIC_STAGES = static_cast<size_t>(MetricStage::Count);
+
+// Bucket k holds durations of [2^k, 2^(k+1)) ticks; the last bucket is open-ended
+constexpr size_t METRIC_HISTOGRAM_BUCKETS = 48;
+
+constexpr bool metricsEnabled()
+{
+#ifdef RATTRAP_METRICS
+    return true;
+#else
+    return false;
+#endif
+}
+
+const char *metricCounterName(MetricCounter counter);
+const char *metricStageName(MetricStage stage);
+
+// Timestamp in ticks
+inline uint64_t metricsNow()
+{
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(RATTRAP_METRICS_STEADY_CLOCK)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now().time_since_epoch())
+                                     .count());
+#endif
+}
+
+struct ThreadMetrics
+{
+    struct StageData
+    {
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> ticks{0};
+        std::atomic<uint64_t> buckets[METRIC_HISTOGRAM_BUCKETS] = {};
+    };
+
+    std::atomic<uint64_t> counters[METRIC_COUNTERS] = {};
+    StageData stages[METRIC_STAGES];
+};
+
+// The calling thread's block, registered on first use
+ThreadMetrics &threadMetrics();
+
+// Only the owning thread writes its block, so no read-modify-write is needed
+inline void metricsBump(std::atomic<uint64_t> &value, uint64_t amount)
+{
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+inline void metricsAdd(MetricCounter counter, uint64_t amount)
+{
+    metricsBump(threadMetrics().counters[static_cast<size_t>(counter)], amount);
+}
+
+inline void metricsRecord(MetricStage stage, uint64_t ticks)
+{
+    ThreadMetrics::StageData &data = threadMetrics().stages[static_cast<size_t>(stage)];
+    size_t bucket = ticks == 0 ? 0 : 63 - static_cast<size_t>(__builtin_clzll(ticks));
+    if (bucket >= METRIC_HISTOGRAM_BUCKETS)
+        bucket = METRIC_HISTOGRAM_BUCKETS - 1;
+    metricsBump(data.count, 1);
+    metricsBump(data.ticks, ticks);
+    metricsBump(data.buckets[bucket], 1);
+}
+
+// Records the time from construction to destruction against a stage
+class StageTimer
+{
+public:
+    explicit StageTimer(MetricStage stage) : stage(stage), start(metricsNow()) {}
+    ~StageTimer() { metricsRecord(stage, metricsNow() - start); }
+
+    StageTimer(const StageTimer &) = delete;
+    StageTimer &operator=(const StageTimer &) = delete;
+
+private:
+    MetricStage stage;
+    uint64_t start;
+};
+
+// Totals over every thread since the process started
+struct MetricsSnapshot
+{
+    struct Stage
+    {
+        uint64_t count = 0;
+        uint64_t ticks = 0;
+        uint64_t buckets[METRIC_HISTOGRAM_BUCKETS] = {};
+    };
+
+    double uptimeSeconds = 0;
+    double secondsPerTick = 0;
+    size_t threads = 0;
+    uint64_t counters[METRIC_COUNTERS] = {};
+    Stage stages[METRIC_STAGES];
+};
+
+MetricsSnapshot takeMetricsSnapshot();
+std::string formatMetricsJson(const MetricsSnapshot &snapshot);
+std::string formatMetricsPrometheus(const MetricsSnapshot &snapshot);
+
+// Write a snapshot to `fileName`, replacing it atomically. Files ending in
+// .prom or .txt get the Prometheus text format, anything else JSON.
+bool writeMetricsFile(const std::string &fileName);
+
+// Rewrites a metrics file every `interval` on a background thread, and once
+// more when destroyed
+class MetricsExporter
+{
+public:
+    MetricsExporter(std::string fileName, std::chrono::milliseconds interval);
+    ~MetricsExporter();
+
+    MetricsExporter(const MetricsExporter &) = delete;
+    MetricsExporter &operator=(const MetricsExporter &) = delete;
+
+private:
+    void run();
+
+    std::string fileName;
+    std::chrono::milliseconds interval;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread thread;
+};
+
+#define RATTRAP_METRICS_CONCAT_(a, b) a##b
+#define RATTRAP_METRICS_CONCAT(a, b) RATTRAP_METRICS_CONCAT_(a, b)
+
+#ifdef RATTRAP_METRICS
+#define RATTRAP_COUNT(counter, amount) metricsAdd(MetricCounter::counter, (amount))
+#define RATTRAP_TIME(stage) StageTimer RATTRAP_METRICS_CONCAT(stageTimer_, __LINE__)(MetricStage::stage)
+#else
+#define RATTRAP_COUNT(counter, amount) ((void)0)
+#define RATTRAP_TIME(stage) ((void)0)
+#endif
+
+#endif // METRICS_H
@@ -0,0 +1,338 @@
+#include "MonteCarlo.h"
+#include "AliasTable.h"
+#include "AmplitudeBound.h"
+#include "Metrics.h"
+#include "ParticleStore.h"
+#include "Philox.h"
+#include "ThreadPool.h"
+#include "WaveBank.h"
+#include "WaveKernels.h"
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+    // Draws per task; every task's range is fixed by its index alone
+    constexpr uint64_t DRAWS_PER_TASK = uint64_t(1) << 18;
+
+    // Redraws when both particles come out the same before the draw is dropped
+    constexpr uint32_t MAX_ATTEMPTS = 64;
+
+    // Largest offset table, in bits, kept to answer repeated (pair, offset) draws
+    constexpr size_t MAX_OFFSET_TABLE_BITS = size_t(1) << 28;
+
+    // Philox counter word 3 separates the independent streams of one draw
+    constexpr uint32_t PAIR_STREAM = 0;
+    constexpr uint32_t OFFSET_STREAM = 1;
+
+    bool breachesAtOffset(const WaveBank &waves, size_t i, size_t j, size_t offset, float threshold)
+    {
+        const float *wave1 = waves.wave(i);
+        const float *wave2 = waves.wave(j);
+        const size_t sampleCount = waves.sampleCount();
+        if (combineAndDetectBreaches(wave1, wave2 + offset, sampleCount - offset, threshold, nullptr, nullptr) > 0)
+            return true;
+        return offset != 0 &&
+               combineAndDetectBreaches(wave1 + sampleCount - offset, wave2, offset, threshold, nullptr, nullptr) > 0;
+    }
+
+    bool buildWeights(const ParticleStore &particles, DrawWeight weight, std::vector<double> &weights)
+    {
+        const size_t count = particles.size();
+        weights.assign(count, 1.0);
+        if (weight == DrawWeight::Energy)
+        {
+            for (size_t p = 0; p < count; ++p)
+                weights[p] = std::abs(particles.energy(static_cast<ParticleHandle>(p)));
+        }
+        else if (weight == DrawWeight::Type)
+        {
+            std::array<size_t, 256> members{};
+            for (size_t p = 0; p < count; ++p)
+                ++members[static_cast<uint8_t>(particles.type(static_cast<ParticleHandle>(p)))];
+            for (size_t p = 0; p < count; ++p)
+                weights[p] = 1.0 / static_cast<double>(members[static_cast<uint8_t>(particles.type(static_cast<ParticleHandle>(p)))]);
+        }
+
+        size_t positive = 0;
+        for (double w : weights)
+            positive += std::isfinite(w) && w > 0.0;
+        return positive >= 2;
+    }
+}
+
+const char *drawWeightName(DrawWeight weight)
+{
+    switch (weight)
+    {
+    case DrawWeight::Uniform:
+        return "uniform";
+    case DrawWeight::Energy:
+        return "energy";
+    case DrawWeight::Type:
+        return "type";
+    }
+    return "unknown";
+}
+
+bool parseDrawWeight(const std::string &name, DrawWeight &weight)
+{
+    for (DrawWeight candidate : {DrawWeight::Uniform, DrawWeight::Energy, DrawWeight::Type})
+    {
+        if (name == drawWeightName(candidate))
+        {
+            weight = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void PairTally::reset(size_t count)
+{
+    particleCount = count;
+    const size_t pairCount = count < 2 ? 0 : count * (count - 1) / 2;
+    dense = pairCount <= DENSE_PAIRS;
+    if (dense)
+    {
+        denseCounts.assign(pairCount, Counts());
+        slots.clear();
+        slotsUsed = 0;
+        slotShift = 64;
+    }
+    else
+    {
+        denseCounts.clear();
+        if (slots.empty())
+        {
+            slots.resize(size_t(1) << 12);
+            slotShift = 64 - 12;
+        }
+        else if (slotsUsed != 0)
+        {
+            std::fill(slots.begin(), slots.end(), Slot());
+        }
+        slotsUsed = 0;
+    }
+    totalDraws = 0;
+    totalAnomalies = 0;
+}
+
+void PairTally::grow()
+{
+    std::vector<Slot> old(slots.size() * 2);
+    old.swap(slots);
+    --slotShift;
+    slotsUsed = 0;
+    for (const Slot &slot : old)
+    {
+        if (slot.key != EMPTY_KEY)
+            sparseCounts(slot.key) = slot.counts;
+    }
+}
+
+void PairTally::merge(const PairTally &other)
+{
+    auto add = [&](uint32_t i, uint32_t j, const Counts &counts) {
+        Counts &mine = dense ? denseCounts[denseIndex(i, j)] : sparseCounts(sparseKey(i, j));
+        mine.draws += counts.draws;
+        mine.anomalies += counts.anomalies;
+    };
+
+    if (other.dense)
+    {
+        for (uint32_t j = 1; j < other.particleCount; ++j)
+        {
+            for (uint32_t i = 0; i < j; ++i)
+            {
+                const Counts &counts = other.denseCounts[denseIndex(i, j)];
+                if (counts.draws != 0)
+                    add(i, j, counts);
+            }
+        }
+    }
+    else
+    {
+        // Size the table for the union first; inserting in the other table's
+        // slot order into a smaller table would pile keys into long runs
+        reserve(slotsUsed + other.slotsUsed);
+        for (const Slot &slot : other.slots)
+        {
+            if (slot.key != EMPTY_KEY)
+                add(static_cast<uint32_t>(slot.key >> 32), static_cast<uint32_t>(slot.key), slot.counts);
+        }
+    }
+    totalDraws += other.totalDraws;
+    totalAnomalies += other.totalAnomalies;
+}
+
+void PairTally::reserve(size_t pairs)
+{
+    while (!dense && pairs * 2 > slots.size())
+        grow();
+}
+
+size_t PairTally::pairsDrawn() const
+{
+    if (!dense)
+        return slotsUsed;
+    size_t drawn = 0;
+    for (const Counts &counts : denseCounts)
+        drawn += counts.draws != 0;
+    return drawn;
+}
+
+bool runMonteCarlo(ThreadPool &pool, const ParticleStore &particles, const WaveBank &waves, float threshold,
+                   const MonteCarloOptions &options, PairTally &tally, std::string &error,
+                   const std::function<void(uint64_t, const PairTally &)> &progress)
+{
+    const size_t count = particles.size();
+    if (options.firstDraw == 0)
+        tally.reset(count);
+
+    std::vector<double> weights;
+    AliasTable picker;
+    if (!buildWeights(particles, options.weight, weights) || !picker.build(weights))
+    {
+        error = std::string("need at least two particles with a positive ") + drawWeightName(options.weight) +
+                " weight to draw collisions";
+        return false;
+    }
+
+    const AmplitudeBound bound(waves, threshold);
+    const size_t sampleCount = waves.sampleCount();
+    const size_t pairCount = count * (count - 1) / 2;
+
+    // When there are at least as many draws as (pair, offset) combinations,
+    // deciding every combination once up front is cheaper than deciding each
+    // draw. One row of bits per pair, padded to whole words so rows can be
+    // filled in parallel.
+    const size_t offsetWords = (sampleCount + 63) / 64;
+    std::vector<uint64_t> offsetTable;
+    if (pairCount <= PairTally::DENSE_PAIRS && pairCount * sampleCount <= options.draws &&
+        pairCount * sampleCount <= MAX_OFFSET_TABLE_BITS)
+    {
+        RATTRAP_TIME(PairEvaluation);
+        offsetTable.assign(pairCount * offsetWords, 0);
+        pool.run(count, [&](size_t j) {
+            for (size_t i = 0; i < j; ++i)
+            {
+                if (!bound.mayBreach(i, j))
+                    continue;
+                uint64_t *row = offsetTable.data() + (j * (j - 1) / 2 + i) * offsetWords;
+                for (size_t offset = 0; offset < sampleCount; ++offset)
+                {
+                    if (breachesAtOffset(waves, i, j, offset, threshold))
+                        row[offset / 64] |= uint64_t(1) << (offset % 64);
+                }
+            }
+        });
+    }
+
+    const PhiloxKey key = philoxKey(options.seed);
+    const size_t tasksPerBatch = pool.size() * 4;
+    std::vector<PairTally> local(tasksPerBatch);
+
+    for (uint64_t batchStart = options.firstDraw; batchStart < options.draws;)
+    {
+        const uint64_t remaining = options.draws - batchStart;
+        const size_t taskCount = static_cast<size_t>(
+            std::min<uint64_t>(tasksPerBatch, (remaining + DRAWS_PER_TASK - 1) / DRAWS_PER_TASK));
+
+        pool.run(taskCount, [&](size_t task) {
+            RATTRAP_TIME(Sampling);
+            PairTally &mine = local[task];
+            mine.reset(count);
+
+            const uint64_t begin = batchStart + task * DRAWS_PER_TASK;
+            const uint64_t end = std::min(options.draws, begin + DRAWS_PER_TASK);
+            size_t evaluated = 0;
+            size_t pruned = 0;
+            for (uint64_t n = begin; n < end; ++n)
+            {
+                const uint32_t low = static_cast<uint32_t>(n);
+                const uint32_t high = static_cast<uint32_t>(n >> 32);
+
+                uint32_t i = 0;
+                uint32_t j = 0;
+                for (uint32_t attempt = 0; attempt < MAX_ATTEMPTS && i == j; ++attempt)
+                {
+                    const PhiloxCounter bits = philox4x32({low, high, attempt, PAIR_STREAM}, key);
+                    i = picker.sample(bits[0], bits[1]);
+                    j = picker.sample(bits[2], bits[3]);
+                }
+                if (i == j)
+                    continue; // Dropped; the caller sees fewer draws than asked for
+                if (i > j)
+                    std::swap(i, j);
+
+                bool anomaly = false;
+                if (bound.mayBreach(i, j))
+                {
+                    const PhiloxCounter bits = philox4x32({low, high, 0, OFFSET_STREAM}, key);
+                    const size_t offset = philoxBelow(bits[0], static_cast<uint32_t>(sampleCount));
+                    if (offsetTable.empty())
+                    {
+                        anomaly = breachesAtOffset(waves, i, j, offset, threshold);
+                        ++evaluated;
+                    }
+                    else
+                    {
+                        const uint64_t *row = offsetTable.data() + (static_cast<size_t>(j) * (j - 1) / 2 + i) * offsetWords;
+                        anomaly = (row[offset / 64] >> (offset % 64)) & 1;
+                    }
+                }
+                else
+                {
+                    ++pruned;
+                }
+                mine.add(i, j, anomaly);
+            }
+
+            RATTRAP_COUNT(CollisionsDrawn, mine.draws());
+            RATTRAP_COUNT(PairsEvaluated, evaluated);
+            RATTRAP_COUNT(PairsPruned, pruned);
+            RATTRAP_COUNT(BreachesFound, mine.anomalies());
+            (void)evaluated;
+            (void)pruned;
+        });
+
+        // Merged in task order on this thread; the sums do not depend on it
+        for (size_t task = 0; task < taskCount; ++task)
+            tally.merge(local[task]);
+        batchStart = std::min(options.draws, batchStart + taskCount * DRAWS_PER_TASK);
+        if (progress)
+            progress(batchStart, tally);
+    }
+    return true;
+}
+
+bool writePairRates(const std::string &fileName, const ParticleStore &particles, const PairTally &tally)
+{
+    // Write beside the target and rename, so an interrupted run keeps the old table
+    const std::string tempName = fileName + ".tmp";
+    {
+        std::ofstream output(tempName, std::ios::binary | std::ios::trunc);
+        if (!output)
+        {
+            std::cerr << "Error opening " << tempName << " for writing." << std::endl;
+            return false;
+        }
+
+        output << PAIR_RATE_CSV_HEADER;
+        tally.forEach([&](uint32_t i, uint32_t j, uint64_t draws, uint64_t anomalies) {
+            output << particles.name(i) << ',' << particles.name(j) << ',' << draws << ',' << anomalies << ','
+                   << static_cast<double>(anomalies) / static_cast<double>(draws) << '\n';
+        });
+
+        if (!output.flush())
+        {
+            std::cerr << "Error writing " << tempName << "." << std::endl;
+            return false;
+        }
+    }
+    return std::rename(tempName.c_str(), fileName.c_str()) == 0;
+}
@@ -0,0 +1,214 @@
+#ifndef MONTE_CARLO_H
+#define MONTE_CARLO_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class ParticleStore;
+class ThreadPool;
+class WaveBank;
+
+// How the two particles of a random collision are picked
+enum class DrawWeight : uint8_t
+{
+    Uniform, // Every particle equally likely
+    Energy,  // In proportion to |energy|
+    Type     // Every ParticleType in the catalog equally likely, then uniform within it
+};
+
+const char *drawWeightName(DrawWeight weight);
+bool parseDrawWeight(const std::string &name, DrawWeight &weight);
+
+struct MonteCarloOptions
+{
+    uint64_t draws = 0;
+    uint64_t seed = 1;
+    DrawWeight weight = DrawWeight::Uniform;
+    uint64_t firstDraw = 0; // > 0: continue a tally that already holds draws [0, firstDraw)
+};
+
+// Draw and anomaly counts per unordered pair.
+//
+// Catalogs with up to DENSE_PAIRS pairs use a flat triangular table; larger
+// ones keep only the pairs actually drawn in an open-addressing hash table
+// whose memory is reused when the tally is reset. Counts are integers, so
+// merging tallies gives the same totals in any order.
+class PairTally
+{
+public:
+    static constexpr size_t DENSE_PAIRS = size_t(1) << 16;
+
+    explicit PairTally(size_t particleCount = 0) { reset(particleCount); }
+
+    // Drop every count and size the tally for `particleCount` particles
+    void reset(size_t particleCount);
+
+    // Record one draw of pair (i, j), i < j
+    void add(uint32_t i, uint32_t j, bool anomaly)
+    {
+        Counts &counts = dense ? denseCounts[denseIndex(i, j)] : sparseCounts(sparseKey(i, j));
+        ++counts.draws;
+        counts.anomalies += anomaly;
+        ++totalDraws;
+        totalAnomalies += anomaly;
+    }
+
+    // Record `draws` draws of pair (i, j), i < j, `anomalies` of them anomalous
+    void add(uint32_t i, uint32_t j, uint64_t draws, uint64_t anomalies)
+    {
+        Counts &counts = dense ? denseCounts[denseIndex(i, j)] : sparseCounts(sparseKey(i, j));
+        counts.draws += draws;
+        counts.anomalies += anomalies;
+        totalDraws += draws;
+        totalAnomalies += anomalies;
+    }
+
+    void merge(const PairTally &other);
+
+    // Make room for `pairs` distinct pairs in total, so adding them does not
+    // rehash (and adding them in another table's slot order does not cluster)
+    void reserve(size_t pairs);
+
+    uint64_t draws() const { return totalDraws; }
+    uint64_t anomalies() const { return totalAnomalies; }
+
+    // Number of distinct pairs drawn at least once
+    size_t pairsDrawn() const;
+
+    // Call visit(i, j, draws, anomalies) for every pair drawn at least once,
+    // in (i, j) order
+    template <typename Visit>
+    void forEach(Visit visit) const
+    {
+        if (dense)
+        {
+            for (uint32_t i = 0; i < particleCount; ++i)
+            {
+                for (uint32_t j = i + 1; j < particleCount; ++j)
+                {
+                    const Counts &counts = denseCounts[denseIndex(i, j)];
+                    if (counts.draws != 0)
+                        visit(i, j, counts.draws, counts.anomalies);
+                }
+            }
+            return;
+        }
+
+        std::vector<const Slot *> drawn;
+        drawn.reserve(slotsUsed);
+        for (const Slot &slot : slots)
+        {
+            if (slot.key != EMPTY_KEY)
+                drawn.push_back(&slot);
+        }
+        std::sort(drawn.begin(), drawn.end(), [](const Slot *a, const Slot *b) { return a->key < b->key; });
+        for (const Slot *slot : drawn)
+            visit(static_cast<uint32_t>(slot->key >> 32), static_cast<uint32_t>(slot->key), slot->counts.draws,
+                  slot->counts.anomalies);
+    }
+
+    // Same, in storage order, which is cheaper when the order does not matter
+    template <typename Visit>
+    void forEachUnordered(Visit visit) const
+    {
+        if (dense)
+        {
+            forEach(visit);
+            return;
+        }
+        for (const Slot &slot : slots)
+        {
+            if (slot.key != EMPTY_KEY)
+                visit(static_cast<uint32_t>(slot.key >> 32), static_cast<uint32_t>(slot.key), slot.counts.draws,
+                      slot.counts.anomalies);
+        }
+    }
+
+private:
+    struct Counts
+    {
+        uint64_t draws = 0;
+        uint64_t anomalies = 0;
+    };
+
+    // Open-addressing slot; i < j, so no pair's key is all ones
+    static constexpr uint64_t EMPTY_KEY = ~uint64_t(0);
+    struct Slot
+    {
+        uint64_t key = EMPTY_KEY;
+        Counts counts;
+    };
+
+    static size_t denseIndex(uint32_t i, uint32_t j) { return static_cast<size_t>(j) * (j - 1) / 2 + i; }
+    static uint64_t sparseKey(uint32_t i, uint32_t j) { return (static_cast<uint64_t>(i) << 32) | j; }
+
+    // Counts for `key`, inserting it if needed (linear probing, at most half full)
+    Counts &sparseCounts(uint64_t key)
+    {
+        uint64_t hash = (key ^ (key >> 31)) * 0xBF58476D1CE4E5B9ull; // splitmix64 finalizer
+        hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBull;
+        size_t slot = static_cast<size_t>((hash ^ (hash >> 31)) >> slotShift);
+        while (true)
+        {
+            if (slots[slot].key == key)
+                return slots[slot].counts;
+            if (slots[slot].key == EMPTY_KEY)
+                break;
+            slot = (slot + 1) & (slots.size() - 1);
+        }
+        if ((slotsUsed + 1) * 2 > slots.size())
+        {
+            grow();
+            return sparseCounts(key);
+        }
+        ++slotsUsed;
+        slots[slot].key = key;
+        return slots[slot].counts;
+    }
+    void grow();
+
+    size_t particleCount = 0;
+    bool dense = true;
+    std::vector<Counts> denseCounts;
+    std::vector<Slot> slots; // Sparse mode: power-of-two table, kept across reset()
+    size_t slotsUsed = 0;
+    unsigned slotShift = 64;
+    uint64_t totalDraws = 0;
+    uint64_t totalAnomalies = 0;
+};
+
+// Random collisions, as opposed to the all-pairs sweep.
+//
+// Each draw picks two distinct particles with the chosen weights and a random
+// time offset for the second wave, uniform over the sample count, then checks
+// whether the combined wave
+//     w_i[k] + w_j[(k + offset) mod samples]
+// breaches the threshold. Offset 0 is exactly the sweep's check; the offset
+// stands in for the relative phase at which two particles meet, which is what
+// makes the anomaly rate of a pair something other than always 0 or always 1.
+//
+// Draw n's randomness comes from Philox4x32-10 with the seed as key and n as
+// counter, so draws do not depend on which thread runs them or in what order.
+// Each task tallies a fixed range of draws and the tallies are summed, which
+// makes the result bit-identical for any thread count. Returns false, with
+// `error` set, if the weights leave fewer than two particles to draw from.
+//
+// The same property lets a run be continued: with options.firstDraw > 0,
+// `tally` must already hold draws [0, firstDraw) and only the rest are drawn.
+// progress(nextDraw, tally), if given, is called on the calling thread after
+// each batch has been merged.
+bool runMonteCarlo(ThreadPool &pool, const ParticleStore &particles, const WaveBank &waves, float threshold,
+                   const MonteCarloOptions &options, PairTally &tally, std::string &error,
+                   const std::function<void(uint64_t, const PairTally &)> &progress = nullptr);
+
+// Header row of the pair rate table
+constexpr const char *PAIR_RATE_CSV_HEADER = "Particle1,Particle2,Draws,Anomalies,Rate\n";
+
+// Write one row per drawn pair, in (i, j) order, replacing `fileName`
+bool writePairRates(const std::string &fileName, const ParticleStore &particles, const PairTally &tally);
+
+#endif // MONTE_CARLO_H
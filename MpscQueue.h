@@ -0,0 +1,105 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+// Bounded lock-free multi-producer, single-consumer queue (after Dmitry
+// Vyukov's bounded MPMC queue).
+//
+// Every cell carries a sequence number that says whose turn it is: a producer
+// may fill cell `pos` when its sequence equals pos, and the consumer may
+// empty it when the sequence equals pos + 1. Producers claim positions with
+// one compare-and-swap on the tail; the single consumer owns the head and
+// needs no atomic read-modify-write at all. Neither side ever blocks: a full
+// or empty queue is reported to the caller, who decides whether to wait or
+// give up.
+template <typename T>
+class MpscQueue
+{
+public:
+    // Capacity is rounded up to a power of two (at least 2)
+    explicit MpscQueue(size_t capacity)
+    {
+        size_t rounded = 2;
+        while (rounded < capacity)
+            rounded *= 2;
+        mask = rounded - 1;
+        cells.reset(new Cell[rounded]);
+        for (size_t i = 0; i < rounded; ++i)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    size_t capacity() const { return mask + 1; }
+
+    // Any thread. Moves `value` in and returns true, or returns false and
+    // leaves `value` alone if the queue is full.
+    bool tryPush(T &value)
+    {
+        size_t position = tail.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true)
+        {
+            cell = &cells[position & mask];
+            const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (difference == 0)
+            {
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (difference < 0)
+            {
+                return false; // The consumer has not emptied this cell yet
+            }
+            else
+            {
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer thread only: true if tryPop() would find nothing
+    bool empty() const
+    {
+        const size_t sequence = cells[head & mask].sequence.load(std::memory_order_acquire);
+        return static_cast<intptr_t>(sequence) - static_cast<intptr_t>(head + 1) < 0;
+    }
+
+    // Consumer thread only. Moves the oldest element into `value`, or returns
+    // false if there is none.
+    bool tryPop(T &value)
+    {
+        Cell &cell = cells[head & mask];
+        const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(sequence) - static_cast<intptr_t>(head + 1) < 0)
+            return false;
+        value = std::move(cell.value);
+        cell.sequence.store(head + mask + 1, std::memory_order_release);
+        ++head;
+        return true;
+    }
+
+private:
+    struct alignas(64) Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) size_t head = 0;
+};
+
+#endif // MPSC_QUEUE_H
@@ -0,0 +1,43 @@
+#include "NameInterner.h"
+#include <utility>
+
+NameInterner::NameInterner(const NameInterner &other) : names(other.names)
+{
+    ids.reserve(names.size());
+    for (uint32_t id = 0; id < names.size(); ++id)
+        ids.emplace(names[id], id);
+}
+
+NameInterner &NameInterner::operator=(const NameInterner &other)
+{
+    if (this != &other)
+    {
+        NameInterner copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+uint32_t NameInterner::intern(std::string_view name)
+{
+    auto found = ids.find(name);
+    if (found != ids.end())
+        return found->second;
+
+    const uint32_t id = static_cast<uint32_t>(names.size());
+    names.emplace_back(name);
+    ids.emplace(names.back(), id);
+    return id;
+}
+
+uint32_t NameInterner::find(std::string_view name) const
+{
+    auto found = ids.find(name);
+    return found != ids.end() ? found->second : NOT_FOUND;
+}
+
+void NameInterner::clear()
+{
+    ids.clear();
+    names.clear();
+}
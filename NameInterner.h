@@ -0,0 +1,43 @@
+#ifndef NAME_INTERNER_H
+#define NAME_INTERNER_H
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Maps particle names to dense integer IDs (0, 1, 2, ... in order of first
+// appearance) and back. Each distinct name is stored once.
+class NameInterner
+{
+public:
+    static constexpr uint32_t NOT_FOUND = UINT32_MAX;
+
+    NameInterner() = default;
+    NameInterner(NameInterner &&) = default;
+    NameInterner &operator=(NameInterner &&) = default;
+
+    // The map's keys point into `names`, so a copy rebuilds it
+    NameInterner(const NameInterner &other);
+    NameInterner &operator=(const NameInterner &other);
+
+    // ID of `name`, assigning the next free one if it is new
+    uint32_t intern(std::string_view name);
+
+    // ID of `name`, or NOT_FOUND
+    uint32_t find(std::string_view name) const;
+
+    const std::string &name(uint32_t id) const { return names[id]; }
+    size_t size() const { return names.size(); }
+    void clear();
+
+    // Make room for `count` names in total without rehashing
+    void reserve(size_t count) { ids.reserve(count); }
+
+private:
+    std::deque<std::string> names; // Stable addresses for the map's keys
+    std::unordered_map<std::string_view, uint32_t> ids;
+};
+
+#endif // NAME_INTERNER_H
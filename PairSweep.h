@@ -0,0 +1,443 @@
+#ifndef PAIR_SWEEP_H
+#define PAIR_SWEEP_H
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <vector>
+#include "AmplitudeBound.h"
+#include "CoarseBreachDetector.h"
+#include "Metrics.h"
+#include "SpatialGrid.h"
+#include "ThreadPool.h"
+#include "Wave.h"
+#include "WaveBank.h"
+#include "WaveKernels.h"
+
+// How far a sweep has got: every pair before (row, column) in canonical order
+// has been consumed. sweepRows() only stops between rows and reports column 0.
+struct SweepPosition
+{
+    size_t row = 0;
+    size_t column = 0;
+};
+
+struct SweepWorkspace;
+
+// Tuning for sweepPairs()
+struct SweepOptions
+{
+    size_t pairsPerChunk = 4096;  // Pairs handed to a worker at a time
+    size_t chunksPerBatch = 64;   // Chunks evaluated before results are merged
+    bool prune = true;            // Skip pairs AmplitudeBound proves cannot breach
+    size_t coarseStride = 0;      // > 1: check pairs coarse-to-fine (CoarseBreachDetector)
+    const SpatialGrid *grid = nullptr; // Radius > 0: only pair particles within it (sweepAnomalies)
+    SweepPosition resumeFrom;     // Skip the pairs before it (a position the same sweep reported)
+    SweepWorkspace *workspace = nullptr; // Scratch kept between sweepAnomalies() calls
+};
+
+// Walks the pairs (i, j), i < j < count, j >= firstNew in canonical order:
+// row by row, columns ascending. firstNew == 0 is the full triangle; a larger
+// value restricts the sweep to pairs that involve a particle at or after it.
+struct PairCursor
+{
+    size_t count = 0;
+    size_t firstNew = 0;
+    size_t row = 0;
+    size_t column = 0;
+
+    PairCursor(size_t count, size_t firstNew)
+        : count(count), firstNew(firstNew), row(0), column(std::max<size_t>(1, firstNew))
+    {
+        skipEmptyRows();
+    }
+
+    bool done() const { return row >= count || column >= count; }
+
+    // Move forward to the first pair at or after (toRow, toColumn)
+    void seek(size_t toRow, size_t toColumn)
+    {
+        if (toRow < row || (toRow == row && toColumn <= column))
+            return;
+        row = toRow;
+        column = std::max(toColumn, std::max(row + 1, firstNew));
+        if (column >= count)
+        {
+            ++row;
+            column = std::max(row + 1, firstNew);
+        }
+        skipEmptyRows();
+    }
+
+    // Advance by up to `maxPairs` pairs; returns how many were skipped over
+    size_t advance(size_t maxPairs)
+    {
+        size_t taken = 0;
+        while (taken < maxPairs && !done())
+        {
+            size_t step = std::min(maxPairs - taken, count - column);
+            column += step;
+            taken += step;
+            if (column >= count)
+            {
+                ++row;
+                column = std::max(row + 1, firstNew);
+                skipEmptyRows();
+            }
+        }
+        return taken;
+    }
+
+private:
+    void skipEmptyRows()
+    {
+        if (column >= count)
+            row = count;
+    }
+};
+
+// A run of work handed to one worker, and the results it produced.
+// sweepPairs() uses start/pairs, sweepRows() firstRow/endRow.
+template <typename Hit>
+struct SweepChunk
+{
+    PairCursor start{0, 0};
+    size_t pairs = 0;
+    size_t firstRow = 0;
+    size_t endRow = 0;
+    std::vector<Hit> hits;
+};
+
+// The chunks of one batch. Passing the same batch to every sweep keeps its
+// result vectors, so a sweep only allocates while they are still growing.
+template <typename Hit>
+using SweepBatch = std::vector<SweepChunk<Hit>>;
+
+// Evaluates every pair a PairCursor visits on `pool` and hands the results to
+// `consume` in canonical (i, j) order, exactly as a single-threaded double loop
+// would produce them.
+//
+// evaluate(i, j, std::vector<Hit> &out) runs on worker threads and appends any
+// results for the pair to a chunk-local vector. consume(Hit &) runs on the
+// calling thread. Work is done in batches of chunks, so only one batch of
+// results is held in memory at a time. Chunks and their result vectors are
+// reused from batch to batch, and from sweep to sweep when the caller passes
+// its own `batch`, so once they have grown to size the sweep itself does not
+// allocate.
+//
+// The sweep starts at options.resumeFrom. After each chunk's results have been
+// consumed, progress(SweepPosition) is called on the calling thread with the
+// position reached, which is where a later sweep can resume. Reporting per
+// chunk rather than per batch keeps it frequent even when a batch produces
+// so many results that consuming them takes a long time.
+template <typename Hit, typename Evaluate, typename Consume, typename Progress>
+void sweepPairs(ThreadPool &pool, size_t count, size_t firstNew, const SweepOptions &options,
+                Evaluate evaluate, Consume consume, Progress progress, SweepBatch<Hit> &batch)
+{
+    PairCursor cursor(count, firstNew);
+    cursor.seek(options.resumeFrom.row, options.resumeFrom.column);
+
+    while (!cursor.done())
+    {
+        size_t used = 0;
+        while (used < options.chunksPerBatch && !cursor.done())
+        {
+            if (used == batch.size())
+                batch.emplace_back();
+            SweepChunk<Hit> &chunk = batch[used++];
+            chunk.start = cursor;
+            chunk.pairs = cursor.advance(options.pairsPerChunk);
+            chunk.hits.clear();
+        }
+
+        // Passed by reference so std::function never copies it to the heap
+        auto task = [&](size_t index) {
+            RATTRAP_TIME(PairEvaluation);
+            SweepChunk<Hit> &chunk = batch[index];
+            RATTRAP_COUNT(PairsEvaluated, chunk.pairs);
+            PairCursor walk = chunk.start;
+            for (size_t n = 0; n < chunk.pairs; ++n)
+            {
+                evaluate(walk.row, walk.column, chunk.hits);
+                walk.advance(1);
+            }
+        };
+        pool.run(used, std::ref(task));
+
+        for (size_t c = 0; c < used; ++c)
+        {
+            for (Hit &hit : batch[c].hits)
+                consume(hit);
+            const PairCursor &next = c + 1 < used ? batch[c + 1].start : cursor;
+            progress(SweepPosition{next.row, next.column});
+        }
+    }
+}
+
+template <typename Hit, typename Evaluate, typename Consume, typename Progress>
+void sweepPairs(ThreadPool &pool, size_t count, size_t firstNew, const SweepOptions &options,
+                Evaluate evaluate, Consume consume, Progress progress)
+{
+    SweepBatch<Hit> batch;
+    sweepPairs<Hit>(pool, count, firstNew, options, evaluate, consume, progress, batch);
+}
+
+template <typename Hit, typename Evaluate, typename Consume>
+void sweepPairs(ThreadPool &pool, size_t count, size_t firstNew, const SweepOptions &options,
+                Evaluate evaluate, Consume consume)
+{
+    sweepPairs<Hit>(pool, count, firstNew, options, evaluate, consume, [](const SweepPosition &) {});
+}
+
+// Like sweepPairs(), but work is handed out as runs of whole rows, for sweeps
+// that do not visit every pair. rowCost(i) estimates the work in row i; rows
+// are grouped until a chunk reaches options.pairsPerChunk. evaluateRow(i, out)
+// runs on a worker and must append row i's results in column order; results
+// reach consume(Hit &) on the calling thread in row order. The sweep starts
+// at row options.resumeFrom.row and reports progress as sweepPairs() does.
+template <typename Hit, typename RowCost, typename EvaluateRow, typename Consume, typename Progress>
+void sweepRows(ThreadPool &pool, size_t rowCount, const SweepOptions &options,
+               RowCost rowCost, EvaluateRow evaluateRow, Consume consume, Progress progress,
+               SweepBatch<Hit> &batch)
+{
+    size_t row = options.resumeFrom.row;
+
+    while (row < rowCount)
+    {
+        size_t used = 0;
+        while (used < options.chunksPerBatch && row < rowCount)
+        {
+            if (used == batch.size())
+                batch.emplace_back();
+            SweepChunk<Hit> &chunk = batch[used++];
+            chunk.firstRow = row;
+            size_t cost = 0;
+            while (row < rowCount && (row == chunk.firstRow || cost < options.pairsPerChunk))
+                cost += rowCost(row++);
+            chunk.endRow = row;
+            chunk.hits.clear();
+        }
+
+        auto task = [&](size_t index) {
+            RATTRAP_TIME(PairEvaluation);
+            SweepChunk<Hit> &chunk = batch[index];
+            for (size_t r = chunk.firstRow; r < chunk.endRow; ++r)
+                evaluateRow(r, chunk.hits);
+        };
+        pool.run(used, std::ref(task));
+
+        for (size_t c = 0; c < used; ++c)
+        {
+            for (Hit &hit : batch[c].hits)
+                consume(hit);
+            progress(SweepPosition{batch[c].endRow, 0});
+        }
+    }
+}
+
+template <typename Hit, typename RowCost, typename EvaluateRow, typename Consume, typename Progress>
+void sweepRows(ThreadPool &pool, size_t rowCount, const SweepOptions &options,
+               RowCost rowCost, EvaluateRow evaluateRow, Consume consume, Progress progress)
+{
+    SweepBatch<Hit> batch;
+    sweepRows<Hit>(pool, rowCount, options, rowCost, evaluateRow, consume, progress, batch);
+}
+
+template <typename Hit, typename RowCost, typename EvaluateRow, typename Consume>
+void sweepRows(ThreadPool &pool, size_t rowCount, const SweepOptions &options,
+               RowCost rowCost, EvaluateRow evaluateRow, Consume consume)
+{
+    sweepRows<Hit>(pool, rowCount, options, rowCost, evaluateRow, consume, [](const SweepPosition &) {});
+}
+
+// A pair whose combined wave breaches the amplitude threshold. waveData points
+// into a buffer owned by the sweep and is only valid during the consume call.
+struct PairAnomaly
+{
+    size_t first;
+    size_t second;
+    ConstWaveSpan waveData;
+};
+
+// What sweepAnomalies() workers record: a pair whose combined wave breaches
+struct BreachedPair
+{
+    size_t first;
+    size_t second;
+};
+
+// Scratch memory for sweepAnomalies(). A caller that sweeps repeatedly can
+// keep one and point SweepOptions::workspace at it; once its buffers have
+// grown to size, a sweep makes no heap allocations at all.
+struct SweepWorkspace
+{
+    SweepBatch<BreachedPair> batch;
+    DynamicWave combined{0};
+    AmplitudeBound bound;
+    CoarseBreachDetector detector;
+};
+
+// Sweep the pairs a PairCursor(waves.size(), firstNew) visits and pass each
+// pair whose combined wave breaches `threshold`, with that wave, to `consume`
+// in canonical order.
+//
+// With options.prune, pairs that AmplitudeBound rules out are never sampled
+// and work is proportional to the candidate pairs. With options.coarseStride,
+// pairs are checked coarse-to-fine. Neither changes the results.
+//
+// With options.grid (and a radius > 0), only pairs within the grid's radius
+// are considered at all, and each row only looks at its 27 neighbouring
+// cells, so the sweep costs O(N * k) for k neighbours instead of O(N^2).
+// Particles the grid has not indexed are not paired.
+//
+// Workers only record which pairs breached; the combined wave is rebuilt into
+// one reused buffer on the calling thread just before it is consumed, so no
+// pair costs a heap allocation. The buffers live in options.workspace when
+// one is given, otherwise in a workspace local to the call.
+//
+// The sweep starts at options.resumeFrom, and progress(SweepPosition) reports
+// where it could be resumed after each chunk; see sweepPairs().
+template <typename Consume, typename Progress>
+void sweepAnomalies(ThreadPool &pool, const WaveBank &waves, size_t firstNew, float threshold,
+                    const SweepOptions &options, Consume consume, Progress progress)
+{
+    SweepWorkspace local;
+    SweepWorkspace &workspace = options.workspace ? *options.workspace : local;
+
+    const size_t count = waves.size();
+    const size_t sampleCount = waves.sampleCount();
+    DynamicWave &combined = workspace.combined;
+    combined.resize(sampleCount);
+    CoarseBreachDetector &detector = workspace.detector;
+    detector.rebuild(waves, threshold, options.coarseStride);
+
+    auto evaluate = [&](size_t i, size_t j, std::vector<BreachedPair> &out) {
+        if (detector.breaches(i, j))
+            out.push_back(BreachedPair{i, j});
+    };
+    auto merge = [&](BreachedPair &pair) {
+        RATTRAP_COUNT(BreachesFound, 1);
+        combineAndDetectBreaches(waves.wave(pair.first), waves.wave(pair.second), sampleCount, threshold,
+                                 nullptr, combined.data());
+        PairAnomaly anomaly{pair.first, pair.second, combined.span()};
+        consume(anomaly);
+    };
+
+    const SpatialGrid *grid = options.grid;
+    const bool useGrid = grid && grid->radius() > 0.0f;
+    if (!options.prune && !useGrid)
+    {
+        sweepPairs<BreachedPair>(pool, count, firstNew, options, evaluate, merge, progress, workspace.batch);
+        return;
+    }
+
+    AmplitudeBound &bound = workspace.bound;
+    bound.rebuild(waves, threshold);
+    auto firstColumn = [&](size_t i) { return std::max(i + 1, firstNew); };
+
+    if (useGrid)
+    {
+        const size_t indexed = std::min(count, grid->size());
+        sweepRows<BreachedPair>(
+            pool, indexed, options,
+            [&](size_t i) { return grid->neighbourEstimate(i) + 1; },
+            [&](size_t i, std::vector<BreachedPair> &out) {
+                // Gather the row's neighbours in `out`, put them in column
+                // order, then keep the ones that breach
+                const size_t begin = out.size();
+                grid->forEachNeighbour(i, firstColumn(i), [&](size_t j) {
+                    if (j < indexed)
+                        out.push_back(BreachedPair{i, j});
+                });
+                std::sort(out.begin() + begin, out.end(),
+                          [](const BreachedPair &a, const BreachedPair &b) { return a.second < b.second; });
+                size_t kept = begin;
+                size_t sampled = 0;
+                for (size_t n = begin; n < out.size(); ++n)
+                {
+                    if (options.prune && !bound.mayBreach(i, out[n].second))
+                        continue;
+                    ++sampled;
+                    if (detector.breaches(i, out[n].second))
+                        out[kept++] = out[n];
+                }
+                out.resize(kept);
+                RATTRAP_COUNT(PairsEvaluated, sampled);
+                RATTRAP_COUNT(PairsPruned, indexed - std::min(indexed, firstColumn(i)) - sampled);
+                (void)sampled;
+            },
+            merge, progress, workspace.batch);
+        return;
+    }
+
+    sweepRows<BreachedPair>(
+        pool, count, options,
+        [&](size_t i) { return bound.candidateEstimate(i, firstColumn(i)) + 1; },
+        [&](size_t i, std::vector<BreachedPair> &out) {
+            const size_t from = firstColumn(i);
+            if (from >= count)
+                return;
+            size_t sampled = 0;
+            bound.forEachCandidate(i, from, [&](size_t j) {
+                ++sampled;
+                evaluate(i, j, out);
+            });
+            RATTRAP_COUNT(PairsEvaluated, sampled);
+            RATTRAP_COUNT(PairsPruned, count - from - sampled);
+            (void)sampled;
+        },
+        merge, progress, workspace.batch);
+}
+
+template <typename Consume>
+void sweepAnomalies(ThreadPool &pool, const WaveBank &waves, size_t firstNew, float threshold,
+                    const SweepOptions &options, Consume consume)
+{
+    sweepAnomalies(pool, waves, firstNew, threshold, options, consume, [](const SweepPosition &) {});
+}
+
+// Compare the breach decision of every pair between two banks synced from the
+// same particles, typically a fast WaveSynthMode against a WaveSynthMode::Exact
+// reference. report(i, j, breachesInReference) is called on the calling
+// thread, in canonical order, for each pair on which the banks disagree;
+// returns how many there were. The banks share amplitudes, so one
+// AmplitudeBound prunes for both.
+template <typename Report>
+size_t compareBreachDecisions(ThreadPool &pool, const WaveBank &reference, const WaveBank &candidate,
+                              float threshold, const SweepOptions &options, Report report)
+{
+    struct Disagreement
+    {
+        size_t first;
+        size_t second;
+        bool breachesInReference;
+    };
+
+    const size_t count = std::min(reference.size(), candidate.size());
+    const size_t sampleCount = std::min(reference.sampleCount(), candidate.sampleCount());
+    const AmplitudeBound bound(reference, threshold);
+    size_t disagreements = 0;
+
+    sweepRows<Disagreement>(
+        pool, count, options,
+        [&](size_t i) { return bound.candidateEstimate(i, i + 1) + 1; },
+        [&](size_t i, std::vector<Disagreement> &out) {
+            bound.forEachCandidate(i, i + 1, [&](size_t j) {
+                if (j >= count)
+                    return;
+                const bool inReference = combineAndDetectBreaches(reference.wave(i), reference.wave(j), sampleCount,
+                                                                  threshold, nullptr, nullptr) > 0;
+                const bool inCandidate = combineAndDetectBreaches(candidate.wave(i), candidate.wave(j), sampleCount,
+                                                                  threshold, nullptr, nullptr) > 0;
+                if (inReference != inCandidate)
+                    out.push_back(Disagreement{i, j, inReference});
+            });
+        },
+        [&](Disagreement &d) {
+            ++disagreements;
+            report(d.first, d.second, d.breachesInReference);
+        });
+    return disagreements;
+}
+
+#endif // PAIR_SWEEP_H
@@ -0,0 +1,112 @@
+#include "ParticleStore.h"
+#include "Particles.h"
+
+ParticleStore::ParticleStore(const std::vector<Particle> &particles)
+{
+    reserve(particles.size());
+    for (const Particle &particle : particles)
+        add(particle);
+}
+
+ParticleHandle ParticleStore::add(const Particle &particle)
+{
+    return add(particle.type, particle.name, particle.mass, particle.charge, particle.energy,
+               particle.x, particle.y, particle.z, particle.amplitude, particle.frequency);
+}
+
+ParticleHandle ParticleStore::add(ParticleType type, std::string_view name, double mass, double charge, double energy,
+                                  float x, float y, float z, float amplitude, float frequency)
+{
+    const ParticleHandle handle = static_cast<ParticleHandle>(size());
+    typeColumn.push_back(type);
+    xColumn.push_back(x);
+    yColumn.push_back(y);
+    zColumn.push_back(z);
+    amplitudeColumn.push_back(amplitude);
+    frequencyColumn.push_back(frequency);
+    massColumn.push_back(mass);
+    chargeColumn.push_back(charge);
+    energyColumn.push_back(energy);
+    nameColumn.push_back(names.intern(name));
+    return handle;
+}
+
+ParticleStore::Columns ParticleStore::appendColumns(size_t count)
+{
+    const size_t first = size();
+    typeColumn.resize(first + count);
+    xColumn.resize(first + count);
+    yColumn.resize(first + count);
+    zColumn.resize(first + count);
+    amplitudeColumn.resize(first + count);
+    frequencyColumn.resize(first + count);
+    massColumn.resize(first + count);
+    chargeColumn.resize(first + count);
+    energyColumn.resize(first + count);
+    nameColumn.resize(first + count, names.intern(std::string_view()));
+    return Columns{typeColumn.data() + first, xColumn.data() + first, yColumn.data() + first,
+                   zColumn.data() + first, amplitudeColumn.data() + first, frequencyColumn.data() + first,
+                   massColumn.data() + first, chargeColumn.data() + first, energyColumn.data() + first};
+}
+
+void ParticleStore::reserve(size_t count)
+{
+    typeColumn.reserve(count);
+    xColumn.reserve(count);
+    yColumn.reserve(count);
+    zColumn.reserve(count);
+    amplitudeColumn.reserve(count);
+    frequencyColumn.reserve(count);
+    massColumn.reserve(count);
+    chargeColumn.reserve(count);
+    energyColumn.reserve(count);
+    nameColumn.reserve(count);
+}
+
+void ParticleStore::clear()
+{
+    typeColumn.clear();
+    xColumn.clear();
+    yColumn.clear();
+    zColumn.clear();
+    amplitudeColumn.clear();
+    frequencyColumn.clear();
+    massColumn.clear();
+    chargeColumn.clear();
+    energyColumn.clear();
+    nameColumn.clear();
+    names.clear();
+}
+
+void ParticleStore::setPosition(ParticleHandle h, float x, float y, float z)
+{
+    xColumn[h] = x;
+    yColumn[h] = y;
+    zColumn[h] = z;
+}
+
+void ParticleStore::setWave(ParticleHandle h, float amplitude, float frequency)
+{
+    amplitudeColumn[h] = amplitude;
+    frequencyColumn[h] = frequency;
+}
+
+Particle ParticleView::toParticle() const
+{
+    return store->get(index);
+}
+
+Particle ParticleStore::get(ParticleHandle h) const
+{
+    return Particle(typeColumn[h], name(h), massColumn[h], chargeColumn[h], energyColumn[h],
+                    xColumn[h], yColumn[h], zColumn[h], amplitudeColumn[h], frequencyColumn[h]);
+}
+
+std::vector<Particle> ParticleStore::toVector() const
+{
+    std::vector<Particle> particles;
+    particles.reserve(size());
+    for (ParticleHandle h = 0; h < size(); ++h)
+        particles.push_back(get(h));
+    return particles;
+}
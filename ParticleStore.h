@@ -0,0 +1,152 @@
+#ifndef PARTICLE_STORE_H
+#define PARTICLE_STORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "AlignedAllocator.h"
+#include "NameInterner.h"
+
+enum class ParticleType : uint8_t;
+class Particle;
+class ParticleStore;
+
+// A particle's position in a ParticleStore. Appending particles never moves
+// existing ones, so handles stay valid until the store is cleared.
+using ParticleHandle = uint32_t;
+
+// Read-only view of one stored particle, with the same field names as Particle
+class ParticleView
+{
+public:
+    ParticleView(const ParticleStore &store, ParticleHandle handle) : store(&store), index(handle) {}
+
+    ParticleHandle handle() const { return index; }
+    ParticleType type() const;
+    const std::string &name() const;
+    double mass() const;
+    double charge() const;
+    double energy() const;
+    float x() const;
+    float y() const;
+    float z() const;
+    float amplitude() const;
+    float frequency() const;
+
+    // Full copy, for code written against Particle
+    Particle toParticle() const;
+
+private:
+    const ParticleStore *store;
+    ParticleHandle index;
+};
+
+// Structure-of-arrays particle storage.
+//
+// The fields the pair loops read (type, position, amplitude, frequency) are
+// kept in separate cache-line aligned arrays, so a sweep over amplitudes or
+// frequencies touches 4 bytes per particle instead of a whole Particle with
+// its std::string and doubles. Mass, charge and energy, which are only needed
+// when something is printed or logged, are plain arrays of their own. Names
+// are interned: each particle holds the ID of its name, and a name shared by
+// many particles (as in generated catalogs) is stored once.
+// Particle remains the value type for building and printing particles.
+class ParticleStore
+{
+public:
+    ParticleStore() = default;
+    explicit ParticleStore(const std::vector<Particle> &particles);
+
+    ParticleHandle add(const Particle &particle);
+    ParticleHandle add(ParticleType type, std::string_view name, double mass, double charge, double energy,
+                       float x, float y, float z, float amplitude, float frequency);
+
+    // First new entry of every column, from appendColumns()
+    struct Columns
+    {
+        ParticleType *types;
+        float *xs;
+        float *ys;
+        float *zs;
+        float *amplitudes;
+        float *frequencies;
+        double *masses;
+        double *charges;
+        double *energies;
+    };
+
+    // Bulk loading: append `count` particles whose fields the caller then
+    // writes through the returned pointers, from any number of threads,
+    // before the store is read. Their names are empty until setName().
+    Columns appendColumns(size_t count);
+
+    // Name IDs can be kept and reused by loaders that see the same name often
+    uint32_t internName(std::string_view name) { return names.intern(name); }
+    void setName(ParticleHandle h, uint32_t nameId) { nameColumn[h] = nameId; }
+    void reserveNames(size_t count) { names.reserve(count); }
+    size_t nameCount() const { return names.size(); }
+
+    void reserve(size_t count);
+    void clear();
+    size_t size() const { return amplitudeColumn.size(); }
+    bool empty() const { return amplitudeColumn.empty(); }
+
+    // Hot columns, one entry per particle
+    const ParticleType *types() const { return typeColumn.data(); }
+    const float *xs() const { return xColumn.data(); }
+    const float *ys() const { return yColumn.data(); }
+    const float *zs() const { return zColumn.data(); }
+    const float *amplitudes() const { return amplitudeColumn.data(); }
+    const float *frequencies() const { return frequencyColumn.data(); }
+    const double *masses() const { return massColumn.data(); }
+    const double *charges() const { return chargeColumn.data(); }
+    const double *energies() const { return energyColumn.data(); }
+
+    ParticleType type(ParticleHandle h) const { return typeColumn[h]; }
+    float x(ParticleHandle h) const { return xColumn[h]; }
+    float y(ParticleHandle h) const { return yColumn[h]; }
+    float z(ParticleHandle h) const { return zColumn[h]; }
+    float amplitude(ParticleHandle h) const { return amplitudeColumn[h]; }
+    float frequency(ParticleHandle h) const { return frequencyColumn[h]; }
+
+    void setPosition(ParticleHandle h, float x, float y, float z);
+    void setWave(ParticleHandle h, float amplitude, float frequency);
+
+    // Cold columns
+    const std::string &name(ParticleHandle h) const { return names.name(nameColumn[h]); }
+    double mass(ParticleHandle h) const { return massColumn[h]; }
+    double charge(ParticleHandle h) const { return chargeColumn[h]; }
+    double energy(ParticleHandle h) const { return energyColumn[h]; }
+
+    ParticleView operator[](ParticleHandle h) const { return ParticleView(*this, h); }
+    Particle get(ParticleHandle h) const;
+    std::vector<Particle> toVector() const;
+
+private:
+    AlignedVector<ParticleType> typeColumn;
+    AlignedVector<float> xColumn;
+    AlignedVector<float> yColumn;
+    AlignedVector<float> zColumn;
+    AlignedVector<float> amplitudeColumn;
+    AlignedVector<float> frequencyColumn;
+    std::vector<double> massColumn;
+    std::vector<double> chargeColumn;
+    std::vector<double> energyColumn;
+    std::vector<uint32_t> nameColumn;
+    NameInterner names;
+};
+
+inline ParticleType ParticleView::type() const { return store->type(index); }
+inline const std::string &ParticleView::name() const { return store->name(index); }
+inline double ParticleView::mass() const { return store->mass(index); }
+inline double ParticleView::charge() const { return store->charge(index); }
+inline double ParticleView::energy() const { return store->energy(index); }
+inline float ParticleView::x() const { return store->x(index); }
+inline float ParticleView::y() const { return store->y(index); }
+inline float ParticleView::z() const { return store->z(index); }
+inline float ParticleView::amplitude() const { return store->amplitude(index); }
+inline float ParticleView::frequency() const { return store->frequency(index); }
+
+#endif // PARTICLE_STORE_H
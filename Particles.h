@@ -6,10 +6,19 @@
 #include <cmath>
 #include <iostream>
 #include <iomanip>
+#include <memory>
+#include <algorithm>
+#include "ParticleStore.h"
+#include "Wave.h"
+#include "WaveBank.h"
+#include "WaveKernels.h"
+#include "WaveSynth.h"
+#include "PairSweep.h"
+#include "Metrics.h"
 
 
 // Enum for Particle Types
-enum class ParticleType
+enum class ParticleType : uint8_t
 {
     // Quarks
     QuarkUp,
@@ -57,35 +66,67 @@ public:
     float frequency; // Frequency of the waveform
 
 // Add this near the top of the file, with other constant definitions
-    const float AMPLITUDE_THRESHOLD = 1.0f;
+    static constexpr float AMPLITUDE_THRESHOLD = 1.0f;
+
+    // Number of samples in every generated wave
+    static constexpr int WAVE_SAMPLES = static_cast<int>(DEFAULT_WAVE_SAMPLES);
 
     Particle(ParticleType type, std::string name, double mass, double charge, double energy,
              float x, float y, float z, float amplitude, float frequency)
         : type(type), name(name), mass(mass), charge(charge), energy(energy), x(x), y(y), z(z),
           amplitude(amplitude), frequency(frequency) {}
 
+    // Single sample of a particle's wave (WaveSynthMode::Exact); a WaveBank in
+    // Exact mode produces the same samples bit for bit
+    static float waveSample(float amplitude, float frequency, int i)
+    {
+        return exactWaveSample(amplitude, frequency, i); // Sinusoidal wave based on frequency and amplitude
+    }
+
+    // Fill `out` with this particle's wave, one sample per element; the
+    // samples span WAVE_DURATION whatever out.size() is
+    void generateWave(WaveSpan out, WaveSynthMode mode = WaveSynthMode::Exact) const
+    {
+        synthesizeWave(amplitude, frequency, out.data(), out.size(), mode, sampleSpacing(out.size()));
+    }
+
+    // This particle's wave at a compile-time resolution, without touching the heap
+    template <size_t N = DEFAULT_WAVE_SAMPLES>
+    Wave<N> wave() const
+    {
+        Wave<N> result;
+        generateWave(result);
+        return result;
+    }
+
     // Function to generate a wave based on particle attributes
     std::vector<float> generateWave() const
     {
-        std::vector<float> wave;
-        for (int i = 0; i < 360; i++)
-        {
-            float value = amplitude * sin(frequency * i); // Sinusoidal wave based on frequency and amplitude
-            wave.push_back(value);
-        }
+        std::vector<float> wave(WAVE_SAMPLES);
+        generateWave(WaveSpan(wave));
         return wave;
     }
 
+    // Add two waves element-wise into `out`; returns the number of samples written
+    static size_t combineWaves(ConstWaveSpan wave1, ConstWaveSpan wave2, WaveSpan out);
     static std::vector<float> combineWaves(const std::vector<float>& wave1, const std::vector<float>& wave2);
 
-    
-    static std::vector<std::pair<int, float>> checkAmplitudeBreach(const std::vector<float>& wave) {
-        std::vector<std::pair<int, float>> breachPoints;
-        for (int i = 0; i < wave.size(); ++i) {
-            if (std::abs(wave[i]) > 1.0f) {
-                breachPoints.push_back({i, wave[i]});
+    // Write the samples of `wave` above the threshold to `out` (which should
+    // have room for wave.size() points); returns how many were found
+    static size_t checkAmplitudeBreach(ConstWaveSpan wave, BreachSpan out)
+    {
+        size_t found = 0;
+        for (size_t i = 0; i < wave.size() && found < out.size(); ++i) {
+            if (std::abs(wave[i]) > AMPLITUDE_THRESHOLD) {
+                out[found++] = {static_cast<int>(i), wave[i]};
             }
         }
+        return found;
+    }
+
+    static std::vector<std::pair<int, float>> checkAmplitudeBreach(const std::vector<float>& wave) {
+        std::vector<std::pair<int, float>> breachPoints(wave.size());
+        breachPoints.resize(checkAmplitudeBreach(ConstWaveSpan(wave), BreachSpan(breachPoints)));
         return breachPoints;
     }
 
@@ -161,17 +202,19 @@ public:
 };
 
 
-std::vector<float> Particle::combineWaves(const std::vector<float> &wave1, const std::vector<float> &wave2)
+inline size_t Particle::combineWaves(ConstWaveSpan wave1, ConstWaveSpan wave2, WaveSpan out)
 {
     // Example of combining the waves by adding them element-wise.
-    size_t size = std::min(wave1.size(), wave2.size());
-    std::vector<float> combinedWave(size);
-
-    for (size_t i = 0; i < size; ++i)
-    {
-        combinedWave[i] = wave1[i] + wave2[i]; // Simple addition of waves
-    }
+    size_t size = std::min({wave1.size(), wave2.size(), out.size()});
+    combineAndDetectBreaches(wave1.data(), wave2.data(), size, Particle::AMPLITUDE_THRESHOLD,
+                             nullptr, out.data());
+    return size;
+}
 
+inline std::vector<float> Particle::combineWaves(const std::vector<float> &wave1, const std::vector<float> &wave2)
+{
+    std::vector<float> combinedWave(std::min(wave1.size(), wave2.size()));
+    combineWaves(ConstWaveSpan(wave1), ConstWaveSpan(wave2), WaveSpan(combinedWave));
     return combinedWave;
 }
 
@@ -179,37 +222,103 @@ std::vector<float> Particle::combineWaves(const std::vector<float> &wave1, const
 class Coil
 {
 public:
-    std::vector<Particle> particles;
+    // Wave parameters and positions in flat arrays, names on the side
+    ParticleStore particles;
+
+    // Each particle's wave, generated once and refreshed only when it changes
+    WaveBank waves{Particle::WAVE_SAMPLES};
+
+    // Generational state for interact(): particles before frontierBegin have
+    // already been paired with each other
+    size_t frontierBegin = 0;
+    size_t generation = 0;
+
+    // Limits for interact()/runCascade(); 0 disables a limit
+    size_t maxGenerations = 16;
+    size_t particleBudget = 100000;
+
+    // Threads used to evaluate a generation; 0 uses every core
+    size_t threadCount = 1;
+
+    // Chunking, pruning and coarse-to-fine settings for the pair sweep
+    SweepOptions sweepOptions;
+
+    // > 0: only particles at most this far apart interact. The grid behind it
+    // indexes each particle once, when the first generation after it was
+    // added runs.
+    float interactionRadius = 0.0f;
+    SpatialGrid grid;
 
     // Adds particles to the system
     void addParticle(const Particle &p)
     {
-        particles.push_back(p);
+        particles.add(p);
     }
 
     // Function to simulate coil interaction
-    void interact()
+    //
+    // Interactions run in generations. Particles in [frontierBegin, size())
+    // form the frontier: the ones that have not been paired yet (everything on
+    // the first call, afterwards the anomalies created by the previous
+    // generation plus anything added since). One call evaluates only the pairs
+    // that involve a frontier particle, so a generation costs O(new * N)
+    // instead of re-sweeping the whole triangle. Particles created during the
+    // call are appended afterwards and become the next frontier.
+    //
+    // Returns the number of particles created.
+    size_t interact()
     {
-        for (size_t i = 0; i < particles.size(); ++i)
+        RATTRAP_TIME(Interact);
+        const size_t end = particles.size();
+        if (frontierBegin >= end || (maxGenerations != 0 && generation >= maxGenerations))
+            return 0;
+
+        waves.sync(particles);
+        std::vector<Particle> created;
+
+        SweepOptions options = sweepOptions;
+        options.workspace = &workspace;
+        if (interactionRadius > 0.0f)
         {
-            for (size_t j = i + 1; j < particles.size(); ++j)
-            {
-                // Interaction logic (energy redirection, amplitude breach, etc.)
-                std::vector<float> wave1 = particles[i].generateWave();
-                std::vector<float> wave2 = particles[j].generateWave();
-                std::vector<float> resultingWave = Particle::combineWaves(wave1, wave2);
-
-                // Check for amplitude breach
-                if (!Particle::checkAmplitudeBreach(resultingWave).empty())
-
-                {
-                    // Create a new particle or anomaly based on the resulting wave
-                    Particle newParticle = createNewParticle(resultingWave);
-                    particles.push_back(newParticle);
-                    recordAnomaly(resultingWave);
-                }
-            }
+            if (grid.radius() != interactionRadius)
+                grid.setRadius(interactionRadius);
+            grid.sync(particles);
+            options.grid = &grid;
+        }
+
+        // Evaluate the pairs in parallel; anomalies come back in (i, j) order
+        sweepAnomalies(threadPool(), waves, frontierBegin, Particle::AMPLITUDE_THRESHOLD, options,
+                       [&](PairAnomaly &anomaly) {
+                           // Create a new particle or anomaly based on the resulting wave,
+                           // as long as the particle budget allows it
+                           if (particleBudget == 0 || end + created.size() < particleBudget)
+                               created.push_back(createNewParticle(anomaly.waveData));
+                           recordAnomaly(anomaly.waveData);
+                       });
+
+        for (const Particle &p : created)
+            particles.add(p);
+        frontierBegin = end;
+        ++generation;
+        return created.size();
+    }
+
+    // Run generations until the frontier is empty or a limit is reached.
+    // Returns the total number of particles created.
+    size_t runCascade()
+    {
+        size_t total = 0;
+        while (frontierSize() > 0 && (maxGenerations == 0 || generation < maxGenerations))
+        {
+            total += interact();
         }
+        return total;
+    }
+
+    // Number of particles still waiting for their first interaction
+    size_t frontierSize() const
+    {
+        return particles.size() > frontierBegin ? particles.size() - frontierBegin : 0;
     }
 
     // Combine the waves generated by two particles (simple addition for now)
@@ -225,14 +334,14 @@ public:
     // }
 
     // Create a new particle based on the resulting wave
-    Particle createNewParticle(const std::vector<float> &wave)
+    Particle createNewParticle(ConstWaveSpan wave)
     {
         return Particle(ParticleType::Unknown, "New Anomalous Particle", 1.0e-28, 1.0e-19, 1.0e-13,
                         0.0f, 0.0f, 0.0f, 1.0f, 0.1f);
     }
 
     // Record anomalies by printing out the wave data and associated particle details
-    void recordAnomaly(const std::vector<float> &wave)
+    void recordAnomaly(ConstWaveSpan wave)
     {
         std::cout << "Anomaly detected! Recording wave: ";
         for (float value : wave)
@@ -241,6 +350,26 @@ public:
         }
         std::cout << std::endl;
     }
+
+private:
+    // The pool interact() runs on; kept between generations and only rebuilt
+    // when threadCount changes, so a generation does not start new threads
+    ThreadPool &threadPool()
+    {
+        if (!pool || poolThreadCount != threadCount)
+        {
+            pool.reset(); // Join the old workers before starting new ones
+            pool.reset(new ThreadPool(threadCount));
+            poolThreadCount = threadCount;
+        }
+        return *pool;
+    }
+
+    std::unique_ptr<ThreadPool> pool;
+    size_t poolThreadCount = 0;
+
+    // Sweep buffers reused by every generation
+    SweepWorkspace workspace;
 };
 
 #endif // PARTICLES_H
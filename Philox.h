@@ -0,0 +1,50 @@
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <array>
+#include <cstdint>
+
+// Philox4x32-10 counter-based random number generator (Salmon et al., "Parallel
+// Random Numbers: As Easy as 1, 2, 3", SC 2011).
+//
+// The output is a pure function of a 128-bit counter and a 64-bit key, so any
+// draw can be generated on any thread in any order: numbering the draws and
+// using the number as the counter gives one reproducible stream per key that
+// splits across threads without coordination.
+using PhiloxCounter = std::array<uint32_t, 4>;
+using PhiloxKey = std::array<uint32_t, 2>;
+
+inline PhiloxCounter philox4x32(PhiloxCounter counter, PhiloxKey key)
+{
+    constexpr uint32_t MULTIPLIER0 = 0xD2511F53u;
+    constexpr uint32_t MULTIPLIER1 = 0xCD9E8D57u;
+    constexpr uint32_t WEYL0 = 0x9E3779B9u;
+    constexpr uint32_t WEYL1 = 0xBB67AE85u;
+
+    for (int round = 0; round < 10; ++round)
+    {
+        const uint64_t product0 = static_cast<uint64_t>(MULTIPLIER0) * counter[0];
+        const uint64_t product1 = static_cast<uint64_t>(MULTIPLIER1) * counter[2];
+        counter = {static_cast<uint32_t>(product1 >> 32) ^ counter[1] ^ key[0],
+                   static_cast<uint32_t>(product1),
+                   static_cast<uint32_t>(product0 >> 32) ^ counter[3] ^ key[1],
+                   static_cast<uint32_t>(product0)};
+        key[0] += WEYL0;
+        key[1] += WEYL1;
+    }
+    return counter;
+}
+
+inline PhiloxKey philoxKey(uint64_t seed)
+{
+    return {static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)};
+}
+
+// Uniform integer in [0, range) from 32 random bits (multiply-shift; the bias
+// is below range / 2^32)
+inline uint32_t philoxBelow(uint32_t bits, uint32_t range)
+{
+    return static_cast<uint32_t>((static_cast<uint64_t>(bits) * range) >> 32);
+}
+
+#endif // PHILOX_H
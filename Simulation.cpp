@@ -0,0 +1,624 @@
+#include "Simulation.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include "Catalog.h"
+#include "Checkpoint.h"
+#include "Metrics.h"
+#include "PairSweep.h"
+
+namespace
+{
+    // Flags that take a value accept both "--flag value" and "--flag=value"
+    bool takeValue(int argc, char **argv, int &i, const char *flag, std::string &value)
+    {
+        const size_t length = std::strlen(flag);
+        if (std::strncmp(argv[i], flag, length) != 0)
+            return false;
+        if (argv[i][length] == '=')
+        {
+            value = argv[i] + length + 1;
+            return true;
+        }
+        if (argv[i][length] != '\0' || i + 1 >= argc)
+            return false;
+        value = argv[++i];
+        return true;
+    }
+
+    // Default binary file for a CSV: runs/a.csv -> runs/a.rta, so runs with
+    // different --output files do not append to the same .rta
+    std::string binaryFileNameFor(const std::string &csvFileName)
+    {
+        const size_t slash = csvFileName.find_last_of('/');
+        const size_t dot = csvFileName.find_last_of('.');
+        const bool hasExtension = dot != std::string::npos && (slash == std::string::npos || dot > slash + 1);
+        return (hasExtension ? csvFileName.substr(0, dot) : csvFileName) + ".rta";
+    }
+
+    // Closes the live stream however runSimulation() returns
+    struct StreamCloser
+    {
+        AnomalyStream *stream;
+        ~StreamCloser()
+        {
+            if (stream)
+                stream->close();
+        }
+    };
+
+    // Fingerprint (FNV-1a) of every option a checkpoint's contents depend on,
+    // so a resume with different settings is refused rather than mixed in
+    uint64_t checkpointSettings(const RunOptions &options, const CollisionWriter::Options &writerOptions)
+    {
+        std::ostringstream text;
+        text << std::hexfloat << options.samples << '|' << waveSynthModeName(options.waveSynth) << '|'
+             << options.interactionRadius << '|' << Particle::AMPLITUDE_THRESHOLD << '|';
+        if (options.monteCarlo.draws > 0)
+            text << "mc|" << options.monteCarlo.draws << '|' << options.monteCarlo.seed << '|'
+                 << drawWeightName(options.monteCarlo.weight);
+        else
+            text << "sweep|" << (writerOptions.writeCsv ? options.outputFileName : "") << '|'
+                 << writerOptions.anomalyFileName << '|' << writerOptions.compactFileName << '|'
+                 << options.logFileName;
+
+        uint64_t hash = 0xCBF29CE484222325ull;
+        for (char c : text.str())
+            hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001B3ull;
+        return hash;
+    }
+
+    // Rebuild the waves with WaveSynthMode::Exact and report every pair whose
+    // breach decision differs from the ones in `waves`
+    void reportSynthDifferences(const ParticleStore &particles, const WaveBank &waves, ThreadPool &pool)
+    {
+        WaveBank exact(waves.sampleCount(), WaveSynthMode::Exact);
+        exact.sync(particles);
+
+        float maxError = 0.0f;
+        for (size_t i = 0; i < waves.size(); ++i)
+        {
+            for (size_t s = 0; s < waves.sampleCount(); ++s)
+                maxError = std::max(maxError, std::abs(waves.wave(i)[s] - exact.wave(i)[s]));
+        }
+
+        const char *mode = waveSynthModeName(waves.synthMode());
+        const size_t differing = compareBreachDecisions(
+            pool, exact, waves, Particle::AMPLITUDE_THRESHOLD, SweepOptions(),
+            [&](size_t i, size_t j, bool breachesExactly) {
+                std::cerr << "Synthesis mismatch: " << particles.name(i) << " + " << particles.name(j)
+                          << " breaches only with " << (breachesExactly ? "exact" : mode) << " waves" << std::endl;
+            });
+        std::cout << "Wave synthesis check (" << mode << " vs exact): " << differing
+                  << " pair(s) with a different breach decision, largest sample difference " << maxError
+                  << std::endl;
+    }
+}
+
+bool parseRunOptions(int argc, char **argv, RunOptions &options, std::string &error)
+{
+    bool binaryNamed = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        std::string value;
+
+        if (arg == "-h" || arg == "--help")
+            options.showHelp = true;
+        else if (arg == "--no-viz")
+            options.visualize = false;
+        else if (arg == "--no-binary")
+        {
+            options.anomalyFileName.clear();
+            binaryNamed = true;
+        }
+        else if (arg == "--validate-synth")
+            options.validateSynth = true;
+        else if (arg == "--live")
+            options.live = true;
+        else if (arg == "--resume")
+            options.resume = true;
+        else if (takeValue(argc, argv, i, "--catalog", value))
+            options.catalogFileName = value;
+        else if (takeValue(argc, argv, i, "--output", value))
+            options.outputFileName = value;
+        else if (takeValue(argc, argv, i, "--binary", value))
+        {
+            options.anomalyFileName = value;
+            binaryNamed = true;
+        }
+        else if (takeValue(argc, argv, i, "--compact", value))
+            options.compactFileName = value;
+        else if (takeValue(argc, argv, i, "--log", value))
+            options.logFileName = value;
+        else if (takeValue(argc, argv, i, "--seen", value))
+            options.seenFileName = value;
+        else if (takeValue(argc, argv, i, "--metrics-interval", value))
+        {
+            std::istringstream number(value);
+            int interval;
+            if (!(number >> interval) || !number.eof() || interval <= 0)
+            {
+                error = "invalid metrics interval: " + value;
+                return false;
+            }
+            options.metricsIntervalMs = static_cast<unsigned>(interval);
+        }
+        else if (takeValue(argc, argv, i, "--metrics", value))
+            options.metricsFileName = value;
+        else if (takeValue(argc, argv, i, "--samples", value))
+        {
+            std::istringstream number(value);
+            long long samples;
+            if (!(number >> samples) || !number.eof() || samples <= 0 ||
+                samples > static_cast<long long>(MAX_WAVE_SAMPLES))
+            {
+                error = "invalid sample count: " + value;
+                return false;
+            }
+            options.samples = static_cast<size_t>(samples);
+        }
+        else if (takeValue(argc, argv, i, "--coarse-stride", value))
+        {
+            std::istringstream number(value);
+            long long stride;
+            if (!(number >> stride) || !number.eof() || stride < 0)
+            {
+                error = "invalid coarse stride: " + value;
+                return false;
+            }
+            options.coarseStride = static_cast<size_t>(stride);
+        }
+        else if (takeValue(argc, argv, i, "--radius", value))
+        {
+            std::istringstream number(value);
+            float radius;
+            if (!(number >> radius) || !number.eof() || !(radius >= 0.0f) || !std::isfinite(radius))
+            {
+                error = "invalid interaction radius: " + value;
+                return false;
+            }
+            options.interactionRadius = radius;
+        }
+        else if (takeValue(argc, argv, i, "--wave-synth", value))
+        {
+            if (!parseWaveSynthMode(value, options.waveSynth))
+            {
+                error = "unknown wave synthesis mode: " + value;
+                return false;
+            }
+        }
+        else if (takeValue(argc, argv, i, "--mc-draws", value))
+        {
+            std::istringstream number(value);
+            long long draws;
+            if (!(number >> draws) || !number.eof() || draws < 0)
+            {
+                error = "invalid draw count: " + value;
+                return false;
+            }
+            options.monteCarlo.draws = static_cast<uint64_t>(draws);
+        }
+        else if (takeValue(argc, argv, i, "--seed", value))
+        {
+            std::istringstream number(value);
+            unsigned long long seed;
+            if (value.empty() || value[0] == '-' || !(number >> seed) || !number.eof())
+            {
+                error = "invalid seed: " + value;
+                return false;
+            }
+            options.monteCarlo.seed = seed;
+        }
+        else if (takeValue(argc, argv, i, "--mc-weight", value))
+        {
+            if (!parseDrawWeight(value, options.monteCarlo.weight))
+            {
+                error = "unknown draw weighting: " + value;
+                return false;
+            }
+        }
+        else if (takeValue(argc, argv, i, "--rates", value))
+            options.rateFileName = value;
+        else if (takeValue(argc, argv, i, "--live-queue", value))
+        {
+            std::istringstream number(value);
+            long long capacity;
+            if (!(number >> capacity) || !number.eof() || capacity <= 0 || capacity > (1 << 24))
+            {
+                error = "invalid live queue size: " + value;
+                return false;
+            }
+            options.liveQueue = static_cast<size_t>(capacity);
+        }
+        else if (takeValue(argc, argv, i, "--live-policy", value))
+        {
+            if (!parseStreamPolicy(value, options.livePolicy))
+            {
+                error = "unknown live policy: " + value;
+                return false;
+            }
+        }
+        else if (takeValue(argc, argv, i, "--checkpoint-interval", value))
+        {
+            std::istringstream number(value);
+            int interval;
+            if (!(number >> interval) || !number.eof() || interval <= 0)
+            {
+                error = "invalid checkpoint interval: " + value;
+                return false;
+            }
+            options.checkpointInterval = static_cast<unsigned>(interval);
+        }
+        else if (takeValue(argc, argv, i, "--checkpoint", value))
+            options.checkpointFileName = value;
+        else if (takeValue(argc, argv, i, "--threads", value))
+        {
+            std::istringstream number(value);
+            int threads;
+            if (!(number >> threads) || !number.eof() || threads < 0)
+            {
+                error = "invalid thread count: " + value;
+                return false;
+            }
+            options.threads = static_cast<unsigned>(threads);
+        }
+        else
+        {
+            error = "unknown or incomplete option: " + arg;
+            return false;
+        }
+    }
+
+    if (options.outputFileName.empty())
+    {
+        error = "output file name must not be empty";
+        return false;
+    }
+    if (!binaryNamed)
+        options.anomalyFileName = binaryFileNameFor(options.outputFileName);
+    if (options.monteCarlo.draws > 0 && options.rateFileName.empty())
+    {
+        error = "rate file name must not be empty";
+        return false;
+    }
+    if (options.resume && options.checkpointFileName.empty())
+    {
+        error = "--resume needs --checkpoint FILE";
+        return false;
+    }
+    return true;
+}
+
+void printUsage(std::ostream &out, const char *program)
+{
+    out << "Usage: " << program << " [options]\n"
+        << "  --catalog FILE   read particles from FILE, a binary .rtp catalog or a CSV\n"
+        << "                   (Type,Name,Mass,Charge,Energy,X,Y,Z,Amplitude,Frequency)\n"
+        << "  --output FILE    anomaly CSV to append to (default collisions.csv)\n"
+        << "  --binary FILE    binary anomaly file to append to (default: the --output name\n"
+        << "                   with .rta in place of its extension)\n"
+        << "  --no-binary      write the CSV only\n"
+        << "  --compact FILE   write parametric anomaly records to FILE instead of the CSV and\n"
+        << "                   binary files; waves are rebuilt from them when read\n"
+        << "  --log FILE       collision log (default collision_log.txt)\n"
+        << "  --seen FILE      skip pairs recorded in FILE by earlier runs, then add this run's\n"
+        << "  --threads N      worker threads, 0 for one per core (default 0)\n"
+        << "  --metrics FILE   write counters and stage timings to FILE (.prom: Prometheus, else JSON)\n"
+        << "  --metrics-interval MS  how often the metrics file is rewritten (default 1000)\n"
+        << "  --samples N      samples per wave (default 360); more samples resolve the same span finer\n"
+        << "  --coarse-stride N  check every Nth sample first, refine only where needed\n"
+        << "                   (default samples / 360, 1 turns it off)\n"
+        << "  --radius R       only pair particles at most R apart (default 0: every pair)\n"
+        << "  --wave-synth MODE  exact, recurrence or polynomial wave generation (default exact)\n"
+        << "  --validate-synth   report pairs whose breach decision differs from exact generation\n"
+        << "  --mc-draws N     draw N random collisions and write per-pair rates instead of\n"
+        << "                   sweeping every pair once\n"
+        << "  --seed S         random seed for --mc-draws (default 1)\n"
+        << "  --mc-weight W    uniform, energy or type: how particles are picked (default uniform)\n"
+        << "  --rates FILE     per-pair draw and anomaly table (default pair_rates.csv)\n"
+        << "  --live           open the visualizer right away and show anomalies as they are found\n"
+        << "  --live-queue N   anomalies buffered for the visualizer (default 1024)\n"
+        << "  --live-policy P  block (slow the sweep down) or drop when the visualizer falls behind\n"
+        << "  --checkpoint FILE  snapshot the run to FILE as it goes; removed when the run completes\n"
+        << "  --checkpoint-interval S  seconds between checkpoints (default 60)\n"
+        << "  --resume         carry on from the --checkpoint file, if there is one\n"
+        << "  --no-viz         do not open the visualizer\n"
+        << "  -h, --help       show this help\n";
+}
+
+void logNewCollision(CollisionInfo collision, CollisionWriter &writer)
+{
+    RATTRAP_TIME(Logging);
+    RATTRAP_COUNT(AnomaliesLogged, 1);
+
+    // Queued for the writer thread, which adds the header row to an empty file
+    writer.write(std::move(collision));
+}
+
+// Pairs are evaluated on the pool's threads; anomalies are logged here, on the
+// calling thread, in (i, j) order so the output matches a single-threaded run.
+void checkAndLogInteractions(const ParticleStore &particles, const WaveBank &waves,
+                             ThreadPool &pool,
+                             InteractionSet &loggedInteractions,
+                             CollisionWriter &writer,
+                             const SweepOptions &sweepOptions,
+                             AnomalyStream *live,
+                             CheckpointWriter *checkpoints)
+{
+    RATTRAP_TIME(Sweep);
+
+    // Intern every particle's name once; pairs are then checked by ID
+    std::vector<uint32_t> ids(particles.size());
+    for (size_t i = 0; i < particles.size(); ++i)
+        ids[i] = loggedInteractions.intern(particles.name(i));
+
+    // Between chunks every anomaly before the position has been deduplicated
+    // and queued, so the writer mark queued next covers exactly those
+    CheckpointState state;
+    state.particles = &particles;
+    state.interactions = &loggedInteractions;
+    auto progress = [&](const SweepPosition &position) {
+        if (!checkpoints || !checkpoints->due())
+            return;
+        state.position = position;
+        checkpoints->submit(state, writer.checkpoint());
+    };
+    progress(sweepOptions.resumeFrom);
+
+    sweepAnomalies(pool, waves, 0, Particle::AMPLITUDE_THRESHOLD, sweepOptions, [&](PairAnomaly &anomaly) {
+        {
+            RATTRAP_TIME(Dedup);
+
+            // Same particles in either order are the same interaction
+            if (!loggedInteractions.insert(ids[anomaly.first], ids[anomaly.second]))
+            {
+                RATTRAP_COUNT(DuplicatesSkipped, 1);
+                return; // Interaction has been logged before
+            }
+        }
+
+        CollisionInfo collision;
+        collision.particle1 = particles.name(anomaly.first);
+        collision.particle2 = particles.name(anomaly.second);
+        collision.interactionInfo = "Anomaly Detected";
+        collision.waveData.assign(anomaly.waveData.begin(), anomaly.waveData.end());
+        collision.amplitude1 = particles.amplitudes()[anomaly.first];
+        collision.frequency1 = particles.frequencies()[anomaly.first];
+        collision.amplitude2 = particles.amplitudes()[anomaly.second];
+        collision.frequency2 = particles.frequencies()[anomaly.second];
+
+        if (live)
+        {
+            // The viewer gets its own copy, breach points already worked out
+            Anomaly record;
+            record.particle1 = collision.particle1;
+            record.particle2 = collision.particle2;
+            record.interactionInfo = collision.interactionInfo;
+            record.waveData = collision.waveData;
+            record.breachPoints.resize(record.waveData.size());
+            record.breachPoints.resize(Particle::checkAmplitudeBreach(ConstWaveSpan(record.waveData),
+                                                                      BreachSpan(record.breachPoints)));
+            live->publish(record);
+        }
+
+        // Log the new collision
+        logNewCollision(std::move(collision), writer);
+    }, progress);
+}
+
+void logCollisionData(float initialEnergy, float finalEnergy, float initialMass, float finalMass,
+                      const std::vector<std::pair<int, float>> &breachPoints, CollisionWriter &writer)
+{
+    // The writer numbers the entries and appends them to collision_log.txt
+    writer.write(CollisionLogEntry{initialEnergy, finalEnergy, initialMass, finalMass, breachPoints});
+}
+
+bool runSimulation(const RunOptions &options, AnomalyStream *live)
+{
+    const StreamCloser closer{live};
+
+    // Snapshots are written periodically and once more when the run ends
+    std::unique_ptr<MetricsExporter> exporter;
+    if (!options.metricsFileName.empty())
+    {
+        if (metricsEnabled())
+            exporter.reset(new MetricsExporter(options.metricsFileName,
+                                               std::chrono::milliseconds(options.metricsIntervalMs)));
+        else
+            std::cerr << "Warning: built without RATTRAP_METRICS; --metrics ignored." << std::endl;
+    }
+
+    CollisionWriter::Options writerOptions;
+    writerOptions.anomalyFileName = options.anomalyFileName;
+    if (!options.compactFileName.empty())
+    {
+        writerOptions.writeCsv = false;
+        writerOptions.anomalyFileName.clear();
+        writerOptions.compactFileName = options.compactFileName;
+        writerOptions.compactSynthMode = options.waveSynth;
+    }
+
+    // Pick up where an interrupted run left off: its particles, interactions
+    // and position come from the checkpoint, and the outputs are cut back to it
+    const bool monteCarlo = options.monteCarlo.draws > 0;
+    const uint64_t settings = checkpointSettings(options, writerOptions);
+    RunCheckpoint resumed;
+    bool resuming = false;
+    if (options.resume)
+    {
+        std::ifstream probe(options.checkpointFileName, std::ios::binary);
+        resuming = probe.is_open();
+        if (!resuming)
+            std::cout << "No checkpoint at " << options.checkpointFileName << "; starting from the beginning."
+                      << std::endl;
+    }
+    if (resuming)
+    {
+        std::string error;
+        if (!loadCheckpoint(options.checkpointFileName, resumed, error))
+        {
+            std::cerr << "Error: " << error << std::endl;
+            return false;
+        }
+        if (resumed.kind != (monteCarlo ? CheckpointKind::MonteCarlo : CheckpointKind::Sweep) ||
+            resumed.settings != settings)
+        {
+            std::cerr << "Error: " << options.checkpointFileName
+                      << " was written by a run with different settings." << std::endl;
+            return false;
+        }
+        if (!monteCarlo &&
+            !restoreOutputs(resumed.outputs, writerOptions.writeCsv ? options.outputFileName : std::string(),
+                            options.logFileName, writerOptions.anomalyFileName, writerOptions.compactFileName,
+                            error))
+        {
+            std::cerr << "Error: " << error << std::endl;
+            return false;
+        }
+    }
+
+    // The binary outputs are opened by the writer thread, which could only
+    // skip one that cannot be appended to; refuse to start instead
+    if (!monteCarlo)
+    {
+        if (!writerOptions.anomalyFileName.empty() && !AnomalyFileWriter::prepareAppend(writerOptions.anomalyFileName))
+            return false;
+        if (!writerOptions.compactFileName.empty() &&
+            !CompactAnomalyFileWriter::prepareAppend(writerOptions.compactFileName))
+            return false;
+    }
+
+    // Create the particles
+    ThreadPool pool(options.threads);
+    ParticleStore particles;
+    if (resuming)
+    {
+        particles = std::move(resumed.particles);
+    }
+    else if (options.catalogFileName.empty())
+    {
+        particles = ParticleStore(defaultCatalog());
+    }
+    else
+    {
+        std::string error;
+        if (!loadCatalog(options.catalogFileName, particles, error, &pool))
+        {
+            std::cerr << "Error: " << error << std::endl;
+            return false;
+        }
+    }
+
+    // Set to track logged interactions, seeded from earlier runs if asked
+    InteractionSet loggedInteractions;
+    if (resuming)
+        loggedInteractions = std::move(resumed.interactions);
+    else if (!options.seenFileName.empty() && !loggedInteractions.load(options.seenFileName))
+        return false;
+
+    // Generate every particle's wave once up front
+    WaveBank waves(options.samples, options.waveSynth);
+    waves.sync(particles);
+
+    if (options.validateSynth)
+        reportSynthDifferences(particles, waves, pool);
+
+    std::unique_ptr<CheckpointWriter> checkpoints;
+    if (!options.checkpointFileName.empty())
+        checkpoints.reset(new CheckpointWriter(options.checkpointFileName, settings,
+                                               std::chrono::seconds(options.checkpointInterval)));
+
+    if (monteCarlo)
+    {
+        PairTally tally;
+        MonteCarloOptions monteCarloOptions = options.monteCarlo;
+        if (resuming)
+        {
+            tally = std::move(resumed.tally);
+            monteCarloOptions.firstDraw = resumed.nextDraw;
+            std::cout << "Resuming from " << options.checkpointFileName << " at draw " << resumed.nextDraw
+                      << "." << std::endl;
+        }
+
+        // Draw n depends only on the seed and n, so the next draw number is all the RNG state there is
+        CheckpointState state;
+        state.kind = CheckpointKind::MonteCarlo;
+        state.particles = &particles;
+        state.tally = &tally;
+        std::function<void(uint64_t, const PairTally &)> progress;
+        if (checkpoints)
+        {
+            progress = [&](uint64_t nextDraw, const PairTally &) {
+                if (!checkpoints->due())
+                    return;
+                state.nextDraw = nextDraw;
+                checkpoints->submit(state);
+            };
+            progress(monteCarloOptions.firstDraw, tally);
+        }
+
+        std::string error;
+        if (!runMonteCarlo(pool, particles, waves, Particle::AMPLITUDE_THRESHOLD, monteCarloOptions, tally, error,
+                           progress))
+        {
+            std::cerr << "Error: " << error << std::endl;
+            return false;
+        }
+        if (!writePairRates(options.rateFileName, particles, tally))
+            return false;
+        if (checkpoints)
+        {
+            checkpoints->finish();
+            std::remove(options.checkpointFileName.c_str());
+        }
+
+        std::cout << "Monte Carlo: " << tally.draws() << " collisions over " << tally.pairsDrawn() << " pairs, "
+                  << tally.anomalies() << " anomalous (rate "
+                  << (tally.draws() ? static_cast<double>(tally.anomalies()) / tally.draws() : 0.0) << ")";
+        if (tally.draws() < options.monteCarlo.draws)
+            std::cout << "; " << options.monteCarlo.draws - tally.draws()
+                      << " draws dropped after repeatedly picking the same particle twice";
+        std::cout << std::endl;
+        return true;
+    }
+
+    // Check all pairs of particles for new interactions
+    {
+        CollisionWriter writer(options.outputFileName, options.logFileName, writerOptions);
+        SweepOptions sweepOptions;
+        sweepOptions.coarseStride = options.coarseStride != 0 ? options.coarseStride
+                                                              : options.samples / DEFAULT_WAVE_SAMPLES;
+        SpatialGrid grid(options.interactionRadius);
+        if (options.interactionRadius > 0.0f)
+        {
+            grid.sync(particles);
+            sweepOptions.grid = &grid;
+        }
+        if (resuming)
+        {
+            sweepOptions.resumeFrom = resumed.position;
+            std::cout << "Resuming from " << options.checkpointFileName << " at row " << resumed.position.row
+                      << " of " << particles.size() << "." << std::endl;
+        }
+        checkAndLogInteractions(particles, waves, pool, loggedInteractions, writer, sweepOptions, live,
+                                checkpoints.get());
+        if (checkpoints)
+            checkpoints->finish();
+    } // The writer flushes everything to disk before anyone reads it
+
+    if (!options.seenFileName.empty())
+        loggedInteractions.save(options.seenFileName);
+    if (checkpoints)
+        std::remove(options.checkpointFileName.c_str());
+
+    if (live && live->dropped() != 0)
+        std::cout << live->dropped() << " anomalies were not shown live; the visualizer fell behind or was closed."
+                  << std::endl;
+    std::cout << "Collision logging completed." << std::endl;
+    return true;
+}
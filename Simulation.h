@@ -0,0 +1,77 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Particles.h"
+#include "ParticleStore.h"
+#include "WaveBank.h"
+#include "WaveSynth.h"
+#include "ThreadPool.h"
+#include "CollisionWriter.h"
+#include "InteractionSet.h"
+#include "AnomalyStream.h"
+#include "MonteCarlo.h"
+
+class CheckpointWriter;
+
+// Settings for one batch run, shared by the viewer and rattrap-cli
+struct RunOptions
+{
+    std::string catalogFileName;                     // Empty: use the built-in particles
+    std::string outputFileName = "collisions.csv";
+    std::string anomalyFileName = "collisions.rta";  // Empty: CSV only; follows outputFileName unless set
+    std::string compactFileName;                     // Set: parametric .rtc records instead of CSV and .rta
+    std::string logFileName = "collision_log.txt";
+    std::string seenFileName;                        // Pairs logged by earlier runs; updated after the run
+    unsigned threads = 0;                            // 0: one per core
+    std::string metricsFileName;                     // Empty: no metrics export
+    unsigned metricsIntervalMs = 1000;
+    size_t samples = DEFAULT_WAVE_SAMPLES;           // Samples per wave, spread over WAVE_DURATION
+    size_t coarseStride = 0;                         // 0: samples / DEFAULT_WAVE_SAMPLES; 1: off
+    float interactionRadius = 0.0f;                  // > 0: only pair particles at most this far apart
+    WaveSynthMode waveSynth = WaveSynthMode::Exact;
+    bool validateSynth = false;                      // Report pairs where waveSynth and Exact disagree
+    MonteCarloOptions monteCarlo;                    // draws > 0: random collisions instead of the sweep
+    std::string rateFileName = "pair_rates.csv";     // Per-pair table written in Monte Carlo mode
+    bool visualize = true;
+    bool live = false;                               // Viewer: show anomalies while the sweep runs
+    size_t liveQueue = 1024;                         // Records buffered between the sweep and the viewer
+    StreamPolicy livePolicy = StreamPolicy::Block;   // What the sweep does when the viewer falls behind
+    std::string checkpointFileName;                  // Set: snapshot the run there as it goes
+    unsigned checkpointInterval = 60;                // Seconds between checkpoints
+    bool resume = false;                             // Carry on from checkpointFileName if it exists
+    bool showHelp = false;
+};
+
+// Parse the command line into `options`; on failure `error` says why
+bool parseRunOptions(int argc, char **argv, RunOptions &options, std::string &error);
+void printUsage(std::ostream &out, const char *program);
+
+// Function to log new collision into CSV
+void logNewCollision(CollisionInfo collision, CollisionWriter &writer);
+
+// Function to check every pair for new interactions and log them; with a
+// `live` stream, each logged anomaly is also published there, breach points
+// included. With `checkpoints`, the sweep position, the interaction set and a
+// writer mark are submitted whenever a checkpoint is due, and once at the start.
+void checkAndLogInteractions(const ParticleStore &particles, const WaveBank &waves,
+                             ThreadPool &pool,
+                             InteractionSet &loggedInteractions,
+                             CollisionWriter &writer,
+                             const SweepOptions &sweepOptions = SweepOptions(),
+                             AnomalyStream *live = nullptr,
+                             CheckpointWriter *checkpoints = nullptr);
+
+void logCollisionData(float initialEnergy, float finalEnergy, float initialMass, float finalMass,
+                      const std::vector<std::pair<int, float>> &breachPoints, CollisionWriter &writer);
+
+// Load the particles, sweep every pair (or draw random collisions) and write
+// the results; returns false if the catalog could not be read or nothing
+// could be drawn. Anomalies are also published to `live`, if given, which is
+// closed when the run ends either way. With options.resume, a checkpoint left
+// by an interrupted run is picked up and the output files are cut back to it.
+bool runSimulation(const RunOptions &options, AnomalyStream *live = nullptr);
+
+#endif // SIMULATION_H
@@ -0,0 +1,72 @@
+#include "SpatialGrid.h"
+#include "ParticleStore.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // Cells are a little wider than the radius, so rounding a coordinate to
+    // its cell can never separate two particles within the radius by more
+    // than one cell
+    constexpr double CELL_SLACK = 1.0 + 1.0 / (1 << 20);
+}
+
+void SpatialGrid::setRadius(float radius)
+{
+    interactionRadius = radius;
+    radiusSquared = static_cast<double>(radius) * radius;
+    inverseCellSize = radius > 0.0f ? 1.0 / (static_cast<double>(radius) * CELL_SLACK) : 0.0;
+    clear();
+}
+
+void SpatialGrid::clear()
+{
+    cells.clear();
+    nodes.clear();
+    cellOf.clear();
+}
+
+int32_t SpatialGrid::cellIndex(float coordinate) const
+{
+    // Clamping merges far-away cells, which keeps neighbours neighbours
+    const double scaled = std::floor(static_cast<double>(coordinate) * inverseCellSize);
+    return static_cast<int32_t>(std::clamp(scaled, static_cast<double>(-CELL_LIMIT), static_cast<double>(CELL_LIMIT - 1)));
+}
+
+void SpatialGrid::sync(const ParticleStore &particles)
+{
+    const size_t first = size();
+    const size_t count = particles.size();
+    if (first >= count)
+        return;
+
+    nodes.reserve(count);
+    cellOf.resize(count, NO_CELL);
+    for (size_t p = first; p < count; ++p)
+    {
+        const ParticleHandle h = static_cast<ParticleHandle>(p);
+        nodes.push_back(Node{particles.x(h), particles.y(h), particles.z(h), END});
+        Node &node = nodes.back();
+
+        // Non-finite positions, and cells outside the packable range, are
+        // never within the radius of anything
+        if (!std::isfinite(node.x) || !std::isfinite(node.y) || !std::isfinite(node.z) || inverseCellSize == 0.0)
+            continue;
+        uint64_t key;
+        if (!packCell(cellIndex(node.x), cellIndex(node.y), cellIndex(node.z), key))
+            continue;
+        Cell &cell = cells.try_emplace(key, Cell{END, 0}).first->second;
+        node.next = cell.head;
+        cell.head = static_cast<uint32_t>(p);
+        ++cell.count;
+        cellOf[p] = key;
+    }
+}
+
+size_t SpatialGrid::neighbourEstimate(size_t i) const
+{
+    if (cellOf[i] == NO_CELL)
+        return 0;
+    const auto cell = cells.find(cellOf[i]);
+    return cell == cells.end() ? 0 : static_cast<size_t>(cell->second.count) * 27;
+}
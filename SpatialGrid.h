@@ -0,0 +1,130 @@
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+class ParticleStore;
+
+// Uniform grid over particle positions, for sweeps that only pair particles
+// within an interaction radius of each other.
+//
+// Space is cut into cubes whose edge is (just over) the radius, so every
+// particle within the radius of another sits in the same cube or one of its
+// 26 neighbours, and a neighbour query looks at 27 cells instead of every
+// particle. Only occupied cells are stored, in a hash map, so sparse or
+// unbounded layouts cost nothing for the empty space. Each cell is a linked
+// list threaded through a per-particle array, which makes adding a particle
+// O(1): sync() indexes particles appended to the store since the last call
+// and leaves the others alone.
+//
+// Positions are copied in when a particle is indexed. Call clear() after
+// moving particles that are already indexed.
+class SpatialGrid
+{
+public:
+    explicit SpatialGrid(float radius = 0.0f) { setRadius(radius); }
+
+    // Change the radius; the grid is emptied and re-indexed by the next sync()
+    void setRadius(float radius);
+    float radius() const { return interactionRadius; }
+
+    // Index every particle of `particles` past size()
+    void sync(const ParticleStore &particles);
+
+    // Forget every particle
+    void clear();
+
+    size_t size() const { return nodes.size(); }
+
+    // True if particles i and j are at most radius() apart (in double precision)
+    bool within(size_t i, size_t j) const
+    {
+        const double dx = static_cast<double>(nodes[i].x) - nodes[j].x;
+        const double dy = static_cast<double>(nodes[i].y) - nodes[j].y;
+        const double dz = static_cast<double>(nodes[i].z) - nodes[j].z;
+        return dx * dx + dy * dy + dz * dz <= radiusSquared;
+    }
+
+    // Rough count of the particles in i's 27-cell neighbourhood, for scheduling
+    size_t neighbourEstimate(size_t i) const;
+
+    // Call visit(j) for every indexed j >= from within radius() of i, j != i,
+    // in no particular order
+    template <typename Visit>
+    void forEachNeighbour(size_t i, size_t from, Visit visit) const
+    {
+        if (cellOf[i] == NO_CELL)
+            return;
+        const int32_t cx = cellCoordinate(cellOf[i], 0);
+        const int32_t cy = cellCoordinate(cellOf[i], 1);
+        const int32_t cz = cellCoordinate(cellOf[i], 2);
+        for (int32_t dx = -1; dx <= 1; ++dx)
+        {
+            for (int32_t dy = -1; dy <= 1; ++dy)
+            {
+                for (int32_t dz = -1; dz <= 1; ++dz)
+                {
+                    uint64_t key;
+                    if (!packCell(cx + dx, cy + dy, cz + dz, key))
+                        continue;
+                    const auto cell = cells.find(key);
+                    if (cell == cells.end())
+                        continue;
+                    for (uint32_t j = cell->second.head; j != END; j = nodes[j].next)
+                    {
+                        if (j >= from && j != i && within(i, j))
+                            visit(static_cast<size_t>(j));
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    // One per indexed particle; the cell walk reads nothing else
+    struct Node
+    {
+        float x;
+        float y;
+        float z;
+        uint32_t next; // Next particle in the same cell
+    };
+
+    struct Cell
+    {
+        uint32_t head;  // Most recently indexed particle; lists run to END
+        uint32_t count;
+    };
+
+    // Cell coordinates are clamped to 21 bits each and packed into one key
+    static constexpr int32_t CELL_LIMIT = 1 << 20;
+    static constexpr uint64_t NO_CELL = ~uint64_t(0); // Non-finite position
+    static constexpr uint32_t END = ~uint32_t(0);
+
+    static bool packCell(int32_t x, int32_t y, int32_t z, uint64_t &key)
+    {
+        if (x < -CELL_LIMIT || x >= CELL_LIMIT || y < -CELL_LIMIT || y >= CELL_LIMIT || z < -CELL_LIMIT ||
+            z >= CELL_LIMIT)
+            return false;
+        key = (static_cast<uint64_t>(x + CELL_LIMIT) << 42) | (static_cast<uint64_t>(y + CELL_LIMIT) << 21) |
+              static_cast<uint64_t>(z + CELL_LIMIT);
+        return true;
+    }
+    static int32_t cellCoordinate(uint64_t key, int axis)
+    {
+        return static_cast<int32_t>((key >> (42 - 21 * axis)) & ((uint64_t(1) << 21) - 1)) - CELL_LIMIT;
+    }
+    int32_t cellIndex(float coordinate) const;
+
+    float interactionRadius = 0.0f;
+    double radiusSquared = 0.0;
+    double inverseCellSize = 0.0;
+    std::unordered_map<uint64_t, Cell> cells;
+    std::vector<Node> nodes;
+    std::vector<uint64_t> cellOf; // Per particle: cell key
+};
+
+#endif // SPATIAL_GRID_H
@@ -0,0 +1,124 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threadCount)
+{
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    for (size_t i = 0; i < threadCount; ++i)
+        queues.push_back(std::make_unique<WorkQueue>());
+
+    // Worker 0 is whichever thread calls run()
+    for (size_t i = 1; i < threadCount; ++i)
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+void ThreadPool::run(size_t taskCount, const std::function<void(size_t)> &task)
+{
+    if (taskCount == 0)
+        return;
+
+    if (queues.size() == 1)
+    {
+        for (size_t i = 0; i < taskCount; ++i)
+            task(i);
+        return;
+    }
+
+    // Publish the task before any index becomes visible: a worker still
+    // draining the previous batch may pick up the new indices right away
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        currentTask = &task;
+        remaining.store(taskCount);
+        ++batchId;
+    }
+
+    for (size_t i = 0; i < taskCount; ++i)
+    {
+        WorkQueue &queue = *queues[i % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(i);
+    }
+    wake.notify_all();
+
+    drain(0);
+
+    std::unique_lock<std::mutex> lock(stateMutex);
+    done.wait(lock, [this] { return remaining.load() == 0; });
+    currentTask = nullptr;
+}
+
+void ThreadPool::workerLoop(size_t self)
+{
+    size_t seenBatch = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(stateMutex);
+            wake.wait(lock, [&] { return stopping || batchId != seenBatch; });
+            if (stopping)
+                return;
+            seenBatch = batchId;
+        }
+        drain(self);
+    }
+}
+
+void ThreadPool::drain(size_t self)
+{
+    size_t index;
+    while (nextTask(self, index))
+    {
+        (*currentTask)(index);
+        if (remaining.fetch_sub(1) == 1)
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            done.notify_all();
+        }
+    }
+}
+
+bool ThreadPool::nextTask(size_t self, size_t &index)
+{
+    // Own work first, oldest task first
+    {
+        WorkQueue &own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (own.head < own.tasks.size())
+        {
+            index = own.tasks[own.head++];
+            if (own.head == own.tasks.size())
+                own.clear();
+            return true;
+        }
+    }
+
+    // Then steal the newest task from another worker
+    for (size_t offset = 1; offset < queues.size(); ++offset)
+    {
+        WorkQueue &victim = *queues[(self + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.head < victim.tasks.size())
+        {
+            index = victim.tasks.back();
+            victim.tasks.pop_back();
+            if (victim.head == victim.tasks.size())
+                victim.clear();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,69 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads with per-worker task queues.
+//
+// run() deals a batch of tasks round-robin onto the workers' queues. A worker
+// pops work from the front of its own queue and, once that is empty, steals
+// from the back of the others, so uneven tasks still keep every core busy.
+// The calling thread takes part as worker 0 and run() returns once the whole
+// batch has finished.
+class ThreadPool
+{
+public:
+    // threadCount == 0 picks std::thread::hardware_concurrency()
+    explicit ThreadPool(size_t threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Total number of threads that execute tasks, including the caller
+    size_t size() const { return queues.size(); }
+
+    // Run task(index) for every index in [0, taskCount) and wait for all of them
+    void run(size_t taskCount, const std::function<void(size_t)> &task);
+
+private:
+    // Tasks [head, tasks.size()) are waiting. The vector is cleared, not
+    // freed, once it runs empty, so run() stops allocating after the first
+    // few batches.
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::vector<size_t> tasks;
+        size_t head = 0;
+
+        void clear()
+        {
+            tasks.clear();
+            head = 0;
+        }
+    };
+
+    void workerLoop(size_t self);
+    bool nextTask(size_t self, size_t &index);
+    void drain(size_t self);
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex stateMutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(size_t)> *currentTask = nullptr;
+    size_t batchId = 0;
+    std::atomic<size_t> remaining{0};
+    bool stopping = false;
+};
+
+#endif // THREAD_POOL_H
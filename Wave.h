@@ -0,0 +1,108 @@
+#ifndef WAVE_H
+#define WAVE_H
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "AlignedAllocator.h"
+
+// Non-owning view of contiguous elements, for C++17 code that cannot use
+// std::span. Wave helpers read from and write into spans so callers decide
+// where the samples live: a Wave<N> on the stack, a WaveBank row, an arena.
+template <typename T>
+class Span
+{
+public:
+    constexpr Span() = default;
+    constexpr Span(T *data, size_t size) : pointer(data), count(size) {}
+
+    template <typename Allocator>
+    Span(std::vector<std::remove_const_t<T>, Allocator> &vector) : pointer(vector.data()), count(vector.size()) {}
+
+    template <typename Allocator, typename U = T, typename = std::enable_if_t<std::is_const<U>::value>>
+    Span(const std::vector<std::remove_const_t<T>, Allocator> &vector) : pointer(vector.data()), count(vector.size()) {}
+
+    // Span<float> converts to Span<const float>
+    template <typename U, typename = std::enable_if_t<std::is_same<const U, T>::value && !std::is_same<U, T>::value>>
+    constexpr Span(Span<U> other) : pointer(other.data()), count(other.size()) {}
+
+    constexpr T *data() const { return pointer; }
+    constexpr size_t size() const { return count; }
+    constexpr bool empty() const { return count == 0; }
+    constexpr T &operator[](size_t index) const { return pointer[index]; }
+    constexpr T *begin() const { return pointer; }
+    constexpr T *end() const { return pointer + count; }
+
+    constexpr Span first(size_t n) const { return Span(pointer, n < count ? n : count); }
+
+private:
+    T *pointer = nullptr;
+    size_t count = 0;
+};
+
+using WaveSpan = Span<float>;
+using ConstWaveSpan = Span<const float>;
+
+// (sample index, combined amplitude) of a sample above the threshold
+using BreachPoint = std::pair<int, float>;
+using BreachSpan = Span<BreachPoint>;
+
+constexpr size_t DEFAULT_WAVE_SAMPLES = 360;
+
+// Largest sample count a run accepts (--samples) or a file may declare
+constexpr size_t MAX_WAVE_SAMPLES = size_t(1) << 24;
+
+// Fixed-size wave stored inline; no heap allocation
+template <size_t N = DEFAULT_WAVE_SAMPLES>
+struct Wave
+{
+    static constexpr size_t sampleCount = N;
+
+    alignas(64) std::array<float, N> samples{};
+
+    static constexpr size_t size() { return N; }
+    float *data() { return samples.data(); }
+    const float *data() const { return samples.data(); }
+    float &operator[](size_t index) { return samples[index]; }
+    const float &operator[](size_t index) const { return samples[index]; }
+    float *begin() { return samples.data(); }
+    float *end() { return samples.data() + N; }
+    const float *begin() const { return samples.data(); }
+    const float *end() const { return samples.data() + N; }
+
+    WaveSpan span() { return WaveSpan(samples.data(), N); }
+    ConstWaveSpan span() const { return ConstWaveSpan(samples.data(), N); }
+    operator WaveSpan() { return span(); }
+    operator ConstWaveSpan() const { return span(); }
+};
+
+// Breach points of a Wave<N>: never more than N of them
+template <size_t N = DEFAULT_WAVE_SAMPLES>
+using BreachBuffer = std::array<BreachPoint, N>;
+
+// Wave whose resolution is chosen at run time. Allocates once, when created
+// or resized, and is reused from then on.
+class DynamicWave
+{
+public:
+    explicit DynamicWave(size_t sampleCount = DEFAULT_WAVE_SAMPLES) : samples(sampleCount) {}
+
+    void resize(size_t sampleCount) { samples.resize(sampleCount); }
+    size_t size() const { return samples.size(); }
+    float *data() { return samples.data(); }
+    const float *data() const { return samples.data(); }
+    float &operator[](size_t index) { return samples[index]; }
+    const float &operator[](size_t index) const { return samples[index]; }
+
+    WaveSpan span() { return WaveSpan(samples.data(), samples.size()); }
+    ConstWaveSpan span() const { return ConstWaveSpan(samples.data(), samples.size()); }
+    operator WaveSpan() { return span(); }
+    operator ConstWaveSpan() const { return span(); }
+
+private:
+    AlignedVector<float> samples;
+};
+
+#endif // WAVE_H
@@ -0,0 +1,88 @@
+#include "WaveBank.h"
+#include "Particles.h"
+#include "Metrics.h"
+#include <algorithm>
+
+namespace
+{
+    constexpr size_t FLOATS_PER_LINE = 64 / sizeof(float);
+}
+
+WaveBank::WaveBank(size_t sampleCount, WaveSynthMode mode)
+    : samplesPerWave(sampleCount),
+      rowStride((sampleCount + FLOATS_PER_LINE - 1) / FLOATS_PER_LINE * FLOATS_PER_LINE),
+      mode(mode)
+{
+}
+
+void WaveBank::sync(const std::vector<Particle> &particles)
+{
+    std::vector<float> amplitudeColumn(particles.size());
+    std::vector<float> frequencyColumn(particles.size());
+    for (size_t i = 0; i < particles.size(); ++i)
+    {
+        amplitudeColumn[i] = particles[i].amplitude;
+        frequencyColumn[i] = particles[i].frequency;
+    }
+    sync(amplitudeColumn.data(), frequencyColumn.data(), particles.size());
+}
+
+void WaveBank::sync(const ParticleStore &particles)
+{
+    sync(particles.amplitudes(), particles.frequencies(), particles.size());
+}
+
+void WaveBank::sync(const float *newAmplitudes, const float *newFrequencies, size_t newSize)
+{
+    RATTRAP_TIME(WaveGeneration);
+    const size_t oldSize = amplitudes.size();
+
+    if (newSize != oldSize)
+    {
+        samples.resize(newSize * rowStride, 0.0f);
+        amplitudes.resize(newSize);
+        frequencies.resize(newSize);
+        stale.resize(newSize, 1);
+    }
+
+    for (size_t i = 0; i < newSize; ++i)
+    {
+        if (stale[i] || amplitudes[i] != newAmplitudes[i] || frequencies[i] != newFrequencies[i])
+        {
+            regenerate(i, newAmplitudes[i], newFrequencies[i]);
+        }
+    }
+}
+
+void WaveBank::invalidate(size_t index)
+{
+    if (index < stale.size())
+        stale[index] = 1;
+}
+
+void WaveBank::clear()
+{
+    samples.clear();
+    amplitudes.clear();
+    frequencies.clear();
+    stale.clear();
+}
+
+void WaveBank::setSynthMode(WaveSynthMode newMode)
+{
+    if (newMode == mode)
+        return;
+    mode = newMode;
+    std::fill(stale.begin(), stale.end(), 1);
+}
+
+void WaveBank::regenerate(size_t index, float amplitude, float frequency)
+{
+    float *row = samples.data() + index * rowStride;
+    synthesizeWave(amplitude, frequency, row, samplesPerWave, mode, sampleSpacing(samplesPerWave));
+    std::fill(row + samplesPerWave, row + rowStride, 0.0f);
+
+    amplitudes[index] = amplitude;
+    frequencies[index] = frequency;
+    stale[index] = 0;
+}
@@ -0,0 +1,64 @@
+#ifndef WAVE_BANK_H
+#define WAVE_BANK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "AlignedAllocator.h"
+#include "WaveSynth.h"
+
+class Particle;
+class ParticleStore;
+
+// Cache of every particle's wave, generated once and shared by all pair loops.
+// Every row has sampleCount() samples spread over WAVE_DURATION.
+//
+// Samples live in one contiguous buffer, one row per particle. Rows are padded
+// to a multiple of 16 floats (one 64-byte cache line) and the padding is zero,
+// so each row starts aligned and can be processed in whole SIMD registers.
+// Amplitude and frequency are kept in parallel arrays; a row is regenerated
+// only when those no longer match the particle it was built from. Rows are
+// generated with the bank's WaveSynthMode (Exact unless set otherwise).
+class WaveBank
+{
+public:
+    explicit WaveBank(size_t sampleCount, WaveSynthMode mode = WaveSynthMode::Exact);
+
+    // Bring the bank in line with `particles`: new particles get a row, rows
+    // whose amplitude or frequency changed are regenerated, the rest are kept
+    void sync(const std::vector<Particle> &particles);
+    void sync(const ParticleStore &particles);
+
+    // Same, from parallel arrays of wave parameters
+    void sync(const float *amplitudes, const float *frequencies, size_t count);
+
+    // Force the row at `index` to be regenerated on the next sync()
+    void invalidate(size_t index);
+
+    // Forget every row
+    void clear();
+
+    // Switch synthesis mode; every row is regenerated on the next sync()
+    void setSynthMode(WaveSynthMode mode);
+    WaveSynthMode synthMode() const { return mode; }
+
+    const float *wave(size_t index) const { return samples.data() + index * rowStride; }
+    size_t size() const { return amplitudes.size(); }
+    float amplitude(size_t index) const { return amplitudes[index]; }
+    float frequency(size_t index) const { return frequencies[index]; }
+    size_t sampleCount() const { return samplesPerWave; }
+    size_t stride() const { return rowStride; }
+
+private:
+    void regenerate(size_t index, float amplitude, float frequency);
+
+    size_t samplesPerWave;
+    size_t rowStride;
+    WaveSynthMode mode;
+    AlignedVector<float> samples;
+    std::vector<float> amplitudes;
+    std::vector<float> frequencies;
+    std::vector<uint8_t> stale;
+};
+
+#endif // WAVE_BANK_H
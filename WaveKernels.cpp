@@ -0,0 +1,169 @@
+#include "WaveKernels.h"
+#include <cmath>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define RATTRAP_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    using KernelFn = size_t (*)(const float *, const float *, size_t, float, uint64_t *, float *);
+
+    // Handles samples [begin, end) one at a time; used for tails and as the portable fallback
+    size_t scalarRange(const float *wave1, const float *wave2, size_t begin, size_t end,
+                       float threshold, uint64_t *breachMask, float *combined)
+    {
+        size_t count = 0;
+        for (size_t i = begin; i < end; ++i)
+        {
+            float value = wave1[i] + wave2[i];
+            if (combined)
+                combined[i] = value;
+            if (std::abs(value) > threshold)
+            {
+                ++count;
+                if (breachMask)
+                    breachMask[i / 64] |= uint64_t(1) << (i % 64);
+            }
+        }
+        return count;
+    }
+
+    void clearMask(uint64_t *breachMask, size_t sampleCount)
+    {
+        if (!breachMask)
+            return;
+        for (size_t w = 0; w < breachMaskWords(sampleCount); ++w)
+            breachMask[w] = 0;
+    }
+
+    size_t scalarKernel(const float *wave1, const float *wave2, size_t sampleCount,
+                        float threshold, uint64_t *breachMask, float *combined)
+    {
+        clearMask(breachMask, sampleCount);
+        return scalarRange(wave1, wave2, 0, sampleCount, threshold, breachMask, combined);
+    }
+
+#ifdef RATTRAP_X86_KERNELS
+    // Each SIMD kernel walks the waves in 64-sample blocks so that one block
+    // produces exactly one mask word, then finishes the tail with scalarRange.
+
+    __attribute__((target("sse2")))
+    size_t sse2Kernel(const float *wave1, const float *wave2, size_t sampleCount,
+                      float threshold, uint64_t *breachMask, float *combined)
+    {
+        clearMask(breachMask, sampleCount);
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        const __m128 limit = _mm_set1_ps(threshold);
+        size_t count = 0;
+        size_t i = 0;
+        for (; i + 64 <= sampleCount; i += 64)
+        {
+            uint64_t bits = 0;
+            for (size_t k = 0; k < 64; k += 4)
+            {
+                __m128 sum = _mm_add_ps(_mm_loadu_ps(wave1 + i + k), _mm_loadu_ps(wave2 + i + k));
+                if (combined)
+                    _mm_storeu_ps(combined + i + k, sum);
+                __m128 breach = _mm_cmpgt_ps(_mm_and_ps(sum, absMask), limit);
+                bits |= uint64_t(_mm_movemask_ps(breach)) << k;
+            }
+            if (breachMask)
+                breachMask[i / 64] = bits;
+            count += __builtin_popcountll(bits);
+        }
+        return count + scalarRange(wave1, wave2, i, sampleCount, threshold, breachMask, combined);
+    }
+
+    __attribute__((target("avx2")))
+    size_t avx2Kernel(const float *wave1, const float *wave2, size_t sampleCount,
+                      float threshold, uint64_t *breachMask, float *combined)
+    {
+        clearMask(breachMask, sampleCount);
+        const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+        const __m256 limit = _mm256_set1_ps(threshold);
+        size_t count = 0;
+        size_t i = 0;
+        for (; i + 64 <= sampleCount; i += 64)
+        {
+            uint64_t bits = 0;
+            for (size_t k = 0; k < 64; k += 8)
+            {
+                __m256 sum = _mm256_add_ps(_mm256_loadu_ps(wave1 + i + k), _mm256_loadu_ps(wave2 + i + k));
+                if (combined)
+                    _mm256_storeu_ps(combined + i + k, sum);
+                __m256 breach = _mm256_cmp_ps(_mm256_and_ps(sum, absMask), limit, _CMP_GT_OQ);
+                bits |= uint64_t(_mm256_movemask_ps(breach)) << k;
+            }
+            if (breachMask)
+                breachMask[i / 64] = bits;
+            count += __builtin_popcountll(bits);
+        }
+        return count + scalarRange(wave1, wave2, i, sampleCount, threshold, breachMask, combined);
+    }
+
+    __attribute__((target("avx512f")))
+    size_t avx512Kernel(const float *wave1, const float *wave2, size_t sampleCount,
+                        float threshold, uint64_t *breachMask, float *combined)
+    {
+        clearMask(breachMask, sampleCount);
+        const __m512 limit = _mm512_set1_ps(threshold);
+        size_t count = 0;
+        size_t i = 0;
+        for (; i + 64 <= sampleCount; i += 64)
+        {
+            uint64_t bits = 0;
+            for (size_t k = 0; k < 64; k += 16)
+            {
+                __m512 sum = _mm512_add_ps(_mm512_loadu_ps(wave1 + i + k), _mm512_loadu_ps(wave2 + i + k));
+                if (combined)
+                    _mm512_storeu_ps(combined + i + k, sum);
+                __mmask16 breach = _mm512_cmp_ps_mask(_mm512_abs_ps(sum), limit, _CMP_GT_OQ);
+                bits |= uint64_t(breach) << k;
+            }
+            if (breachMask)
+                breachMask[i / 64] = bits;
+            count += __builtin_popcountll(bits);
+        }
+        return count + scalarRange(wave1, wave2, i, sampleCount, threshold, breachMask, combined);
+    }
+#endif
+
+    struct KernelChoice
+    {
+        KernelFn fn;
+        const char *name;
+    };
+
+    KernelChoice pickKernel()
+    {
+#ifdef RATTRAP_X86_KERNELS
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return {avx512Kernel, "avx512"};
+        if (__builtin_cpu_supports("avx2"))
+            return {avx2Kernel, "avx2"};
+        if (__builtin_cpu_supports("sse2"))
+            return {sse2Kernel, "sse2"};
+#endif
+        return {scalarKernel, "scalar"};
+    }
+
+    const KernelChoice &activeKernel()
+    {
+        static const KernelChoice choice = pickKernel();
+        return choice;
+    }
+}
+
+size_t combineAndDetectBreaches(const float *wave1, const float *wave2, size_t sampleCount,
+                                float threshold, uint64_t *breachMask, float *combined)
+{
+    return activeKernel().fn(wave1, wave2, sampleCount, threshold, breachMask, combined);
+}
+
+const char *waveKernelName()
+{
+    return activeKernel().name;
+}
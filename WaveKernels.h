@@ -0,0 +1,28 @@
+#ifndef WAVE_KERNELS_H
+#define WAVE_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Number of 64-bit words needed to hold one breach bit per sample
+constexpr size_t breachMaskWords(size_t sampleCount)
+{
+    return (sampleCount + 63) / 64;
+}
+
+// Fused pair kernel: adds wave1 and wave2 sample by sample and flags every
+// sample whose combined magnitude is above `threshold`, all in one pass.
+//
+// - breachMask: if not null, receives breachMaskWords(sampleCount) words with
+//   bit i set when sample i breaches (bits past sampleCount are zero)
+// - combined: if not null, receives the summed samples
+//
+// Returns the number of breaching samples. Nothing is allocated. The result is
+// bit-identical to combineWaves() followed by checkAmplitudeBreach().
+size_t combineAndDetectBreaches(const float *wave1, const float *wave2, size_t sampleCount,
+                                float threshold, uint64_t *breachMask, float *combined);
+
+// Name of the instruction set picked at runtime ("avx512", "avx2", "sse2" or "scalar")
+const char *waveKernelName();
+
+#endif // WAVE_KERNELS_H
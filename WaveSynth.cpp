@@ -0,0 +1,294 @@
+#include "WaveSynth.h"
+#include <algorithm>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define RATTRAP_X86_SYNTH 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    using SynthFn = void (*)(float, float, float *, size_t, float);
+
+    // pi/2 split in three (from fdlibm). The first two parts have 33
+    // significant bits, so n * part is exact for |n| < 2^20, which covers
+    // every phase up to WAVE_SYNTH_POLY_MAX_PHASE.
+    constexpr double TWO_OVER_PI = 6.36619772367581382433e-01;
+    constexpr double PIO2_1 = 1.57079632673412561417e+00;
+    constexpr double PIO2_2 = 6.07710050630396597660e-11;
+    constexpr double PIO2_2T = 2.02226624879595063154e-21;
+
+    // x + 1.5 * 2^52 rounds x to an integer and leaves it in the low mantissa
+    // bits; subtracting the constant again gives the integer as a double
+    constexpr double ROUNDING_MAGIC = 6755399441055744.0;
+
+    // fdlibm __kernel_sin and __kernel_cos coefficients on [-pi/4, pi/4]
+    constexpr double S1 = -1.66666666666666324348e-01;
+    constexpr double S2 = 8.33333333332248946124e-03;
+    constexpr double S3 = -1.98412698298579493134e-04;
+    constexpr double S4 = 2.75573137070700676789e-06;
+    constexpr double S5 = -2.50507602534068634195e-08;
+    constexpr double S6 = 1.58969099521155010221e-10;
+    constexpr double C1 = 4.16666666666666019037e-02;
+    constexpr double C2 = -1.38888888888741095749e-03;
+    constexpr double C3 = 2.48015872894767294178e-05;
+    constexpr double C4 = -2.75573143513906633035e-07;
+    constexpr double C5 = 2.08757232129817482790e-09;
+    constexpr double C6 = -1.13596475577881948265e-11;
+
+    // Polynomial mode for one sample; the SIMD kernels below do the same
+    // steps lane by lane and use this for their tails
+    float polynomialSample(float amplitude, float frequency, size_t i, float spacing)
+    {
+        const float phase = frequency * (static_cast<float>(i) * spacing);
+        if (!(std::abs(phase) <= WAVE_SYNTH_POLY_MAX_PHASE))
+            return exactWaveSample(amplitude, frequency, static_cast<int>(i), spacing);
+
+        const double x = phase;
+        const double shifted = x * TWO_OVER_PI + ROUNDING_MAGIC;
+        const double n = shifted - ROUNDING_MAGIC;
+        uint64_t quadrant;
+        std::memcpy(&quadrant, &shifted, sizeof(quadrant));
+
+        const double r = ((x - n * PIO2_1) - n * PIO2_2) - n * PIO2_2T;
+        const double z = r * r;
+        double s;
+        if (quadrant & 1)
+            s = 1.0 - 0.5 * z + z * z * (C1 + z * (C2 + z * (C3 + z * (C4 + z * (C5 + z * C6)))));
+        else
+            s = r + r * z * (S1 + z * (S2 + z * (S3 + z * (S4 + z * (S5 + z * S6)))));
+        if (quadrant & 2)
+            s = -s;
+        s = std::min(std::max(s, -1.0), 1.0);
+        return static_cast<float>(amplitude * s);
+    }
+
+    void exactWave(float amplitude, float frequency, float *out, size_t count, float spacing)
+    {
+        for (size_t i = 0; i < count; ++i)
+            out[i] = exactWaveSample(amplitude, frequency, static_cast<int>(i), spacing);
+    }
+
+    void recurrenceWave(float amplitude, float frequency, float *out, size_t count, float spacing)
+    {
+        // Rotating (cos, sin) by the per-sample step is exact up to rounding,
+        // which would accumulate; restarting from libm bounds the drift
+        const double step = static_cast<double>(frequency) * spacing;
+        const double stepCos = std::cos(step);
+        const double stepSin = std::sin(step);
+        for (size_t start = 0; start < count; start += WAVE_SYNTH_RESYNC)
+        {
+            const double phase = step * static_cast<double>(start);
+            double c = std::cos(phase);
+            double s = std::sin(phase);
+            const size_t end = std::min(count, start + WAVE_SYNTH_RESYNC);
+            for (size_t i = start; i < end; ++i)
+            {
+                out[i] = static_cast<float>(amplitude * std::min(std::max(s, -1.0), 1.0));
+                const double nextC = c * stepCos - s * stepSin;
+                s = s * stepCos + c * stepSin;
+                c = nextC;
+            }
+        }
+    }
+
+    void polynomialScalar(float amplitude, float frequency, float *out, size_t count, float spacing)
+    {
+        for (size_t i = 0; i < count; ++i)
+            out[i] = polynomialSample(amplitude, frequency, i, spacing);
+    }
+
+#ifdef RATTRAP_X86_SYNTH
+    // Lanes whose phase is out of range (or NaN) are redone through libm
+    void patchOutOfRange(unsigned outOfRange, float amplitude, float frequency, float spacing, float *out,
+                         size_t first)
+    {
+        while (outOfRange != 0)
+        {
+            const size_t lane = static_cast<size_t>(__builtin_ctz(outOfRange));
+            outOfRange &= outOfRange - 1;
+            out[first + lane] = exactWaveSample(amplitude, frequency, static_cast<int>(first + lane), spacing);
+        }
+    }
+
+    __attribute__((target("avx2")))
+    void polynomialAvx2(float amplitude, float frequency, float *out, size_t count, float spacing)
+    {
+        const __m128 freq = _mm_set1_ps(frequency);
+        const __m128 dt = _mm_set1_ps(spacing);
+        const __m256d amp = _mm256_set1_pd(amplitude);
+        const __m256d signBit = _mm256_set1_pd(-0.0);
+        const __m256d maxPhase = _mm256_set1_pd(WAVE_SYNTH_POLY_MAX_PHASE);
+        const __m256d magic = _mm256_set1_pd(ROUNDING_MAGIC);
+        const __m256d one = _mm256_set1_pd(1.0);
+        const __m256d minusOne = _mm256_set1_pd(-1.0);
+        const __m256i oneBits = _mm256_set1_epi64x(1);
+        const __m256i twoBits = _mm256_set1_epi64x(2);
+        __m128i index = _mm_setr_epi32(0, 1, 2, 3);
+        const __m128i indexStep = _mm_set1_epi32(4);
+
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4, index = _mm_add_epi32(index, indexStep))
+        {
+            const __m256d x = _mm256_cvtps_pd(_mm_mul_ps(freq, _mm_mul_ps(_mm_cvtepi32_ps(index), dt)));
+            const __m256d shifted = _mm256_add_pd(_mm256_mul_pd(x, _mm256_set1_pd(TWO_OVER_PI)), magic);
+            const __m256d n = _mm256_sub_pd(shifted, magic);
+            __m256d r = _mm256_sub_pd(x, _mm256_mul_pd(n, _mm256_set1_pd(PIO2_1)));
+            r = _mm256_sub_pd(r, _mm256_mul_pd(n, _mm256_set1_pd(PIO2_2)));
+            r = _mm256_sub_pd(r, _mm256_mul_pd(n, _mm256_set1_pd(PIO2_2T)));
+            const __m256d z = _mm256_mul_pd(r, r);
+
+            __m256d sp = _mm256_add_pd(_mm256_set1_pd(S5), _mm256_mul_pd(z, _mm256_set1_pd(S6)));
+            sp = _mm256_add_pd(_mm256_set1_pd(S4), _mm256_mul_pd(z, sp));
+            sp = _mm256_add_pd(_mm256_set1_pd(S3), _mm256_mul_pd(z, sp));
+            sp = _mm256_add_pd(_mm256_set1_pd(S2), _mm256_mul_pd(z, sp));
+            sp = _mm256_add_pd(_mm256_set1_pd(S1), _mm256_mul_pd(z, sp));
+            const __m256d sinR = _mm256_add_pd(r, _mm256_mul_pd(_mm256_mul_pd(r, z), sp));
+
+            __m256d cp = _mm256_add_pd(_mm256_set1_pd(C5), _mm256_mul_pd(z, _mm256_set1_pd(C6)));
+            cp = _mm256_add_pd(_mm256_set1_pd(C4), _mm256_mul_pd(z, cp));
+            cp = _mm256_add_pd(_mm256_set1_pd(C3), _mm256_mul_pd(z, cp));
+            cp = _mm256_add_pd(_mm256_set1_pd(C2), _mm256_mul_pd(z, cp));
+            cp = _mm256_add_pd(_mm256_set1_pd(C1), _mm256_mul_pd(z, cp));
+            const __m256d cosR = _mm256_add_pd(_mm256_sub_pd(one, _mm256_mul_pd(_mm256_set1_pd(0.5), z)),
+                                               _mm256_mul_pd(_mm256_mul_pd(z, z), cp));
+
+            const __m256i quadrant = _mm256_castpd_si256(shifted);
+            const __m256d useCos = _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_and_si256(quadrant, oneBits), oneBits));
+            const __m256d negate = _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_and_si256(quadrant, twoBits), 62));
+            __m256d s = _mm256_xor_pd(_mm256_blendv_pd(sinR, cosR, useCos), negate);
+            s = _mm256_min_pd(_mm256_max_pd(s, minusOne), one);
+            _mm_storeu_ps(out + i, _mm256_cvtpd_ps(_mm256_mul_pd(amp, s)));
+
+            const __m256d inRange = _mm256_cmp_pd(_mm256_andnot_pd(signBit, x), maxPhase, _CMP_LE_OQ);
+            patchOutOfRange(~static_cast<unsigned>(_mm256_movemask_pd(inRange)) & 0xfu, amplitude, frequency, spacing, out, i);
+        }
+        for (; i < count; ++i)
+            out[i] = polynomialSample(amplitude, frequency, i, spacing);
+    }
+
+    __attribute__((target("avx512f")))
+    void polynomialAvx512(float amplitude, float frequency, float *out, size_t count, float spacing)
+    {
+        const __m256 freq = _mm256_set1_ps(frequency);
+        const __m256 dt = _mm256_set1_ps(spacing);
+        const __m512d amp = _mm512_set1_pd(amplitude);
+        const __m512d maxPhase = _mm512_set1_pd(WAVE_SYNTH_POLY_MAX_PHASE);
+        const __m512d magic = _mm512_set1_pd(ROUNDING_MAGIC);
+        const __m512d one = _mm512_set1_pd(1.0);
+        const __m512d minusOne = _mm512_set1_pd(-1.0);
+        const __m512i oneBits = _mm512_set1_epi64(1);
+        const __m512i twoBits = _mm512_set1_epi64(2);
+        __m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        const __m256i indexStep = _mm256_set1_epi32(8);
+
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8, index = _mm256_add_epi32(index, indexStep))
+        {
+            const __m512d x = _mm512_cvtps_pd(_mm256_mul_ps(freq, _mm256_mul_ps(_mm256_cvtepi32_ps(index), dt)));
+            const __m512d shifted = _mm512_add_pd(_mm512_mul_pd(x, _mm512_set1_pd(TWO_OVER_PI)), magic);
+            const __m512d n = _mm512_sub_pd(shifted, magic);
+            __m512d r = _mm512_sub_pd(x, _mm512_mul_pd(n, _mm512_set1_pd(PIO2_1)));
+            r = _mm512_sub_pd(r, _mm512_mul_pd(n, _mm512_set1_pd(PIO2_2)));
+            r = _mm512_sub_pd(r, _mm512_mul_pd(n, _mm512_set1_pd(PIO2_2T)));
+            const __m512d z = _mm512_mul_pd(r, r);
+
+            __m512d sp = _mm512_add_pd(_mm512_set1_pd(S5), _mm512_mul_pd(z, _mm512_set1_pd(S6)));
+            sp = _mm512_add_pd(_mm512_set1_pd(S4), _mm512_mul_pd(z, sp));
+            sp = _mm512_add_pd(_mm512_set1_pd(S3), _mm512_mul_pd(z, sp));
+            sp = _mm512_add_pd(_mm512_set1_pd(S2), _mm512_mul_pd(z, sp));
+            sp = _mm512_add_pd(_mm512_set1_pd(S1), _mm512_mul_pd(z, sp));
+            const __m512d sinR = _mm512_add_pd(r, _mm512_mul_pd(_mm512_mul_pd(r, z), sp));
+
+            __m512d cp = _mm512_add_pd(_mm512_set1_pd(C5), _mm512_mul_pd(z, _mm512_set1_pd(C6)));
+            cp = _mm512_add_pd(_mm512_set1_pd(C4), _mm512_mul_pd(z, cp));
+            cp = _mm512_add_pd(_mm512_set1_pd(C3), _mm512_mul_pd(z, cp));
+            cp = _mm512_add_pd(_mm512_set1_pd(C2), _mm512_mul_pd(z, cp));
+            cp = _mm512_add_pd(_mm512_set1_pd(C1), _mm512_mul_pd(z, cp));
+            const __m512d cosR = _mm512_add_pd(_mm512_sub_pd(one, _mm512_mul_pd(_mm512_set1_pd(0.5), z)),
+                                               _mm512_mul_pd(_mm512_mul_pd(z, z), cp));
+
+            const __m512i quadrant = _mm512_castpd_si512(shifted);
+            const __mmask8 useCos = _mm512_test_epi64_mask(quadrant, oneBits);
+            const __m512i negate = _mm512_slli_epi64(_mm512_and_si512(quadrant, twoBits), 62);
+            __m512d s = _mm512_mask_blend_pd(useCos, sinR, cosR);
+            s = _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(s), negate));
+            s = _mm512_min_pd(_mm512_max_pd(s, minusOne), one);
+            _mm256_storeu_ps(out + i, _mm512_cvtpd_ps(_mm512_mul_pd(amp, s)));
+
+            const __mmask8 inRange = _mm512_cmp_pd_mask(_mm512_abs_pd(x), maxPhase, _CMP_LE_OQ);
+            patchOutOfRange(~static_cast<unsigned>(inRange) & 0xffu, amplitude, frequency, spacing, out, i);
+        }
+        for (; i < count; ++i)
+            out[i] = polynomialSample(amplitude, frequency, i, spacing);
+    }
+#endif
+
+    struct SynthChoice
+    {
+        SynthFn fn;
+        const char *name;
+    };
+
+    SynthChoice pickPolynomial()
+    {
+#ifdef RATTRAP_X86_SYNTH
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return {polynomialAvx512, "avx512"};
+        if (__builtin_cpu_supports("avx2"))
+            return {polynomialAvx2, "avx2"};
+#endif
+        return {polynomialScalar, "scalar"};
+    }
+
+    const SynthChoice &activePolynomial()
+    {
+        static const SynthChoice choice = pickPolynomial();
+        return choice;
+    }
+
+    const char *const MODE_NAMES[] = {"exact", "recurrence", "polynomial"};
+}
+
+const char *waveSynthModeName(WaveSynthMode mode)
+{
+    return MODE_NAMES[static_cast<size_t>(mode)];
+}
+
+bool parseWaveSynthMode(const std::string &text, WaveSynthMode &mode)
+{
+    for (size_t m = 0; m < sizeof(MODE_NAMES) / sizeof(MODE_NAMES[0]); ++m)
+    {
+        if (text == MODE_NAMES[m])
+        {
+            mode = static_cast<WaveSynthMode>(m);
+            return true;
+        }
+    }
+    return false;
+}
+
+void synthesizeWave(float amplitude, float frequency, float *out, size_t count, WaveSynthMode mode,
+                    float spacing)
+{
+    switch (mode)
+    {
+    case WaveSynthMode::Recurrence:
+        recurrenceWave(amplitude, frequency, out, count, spacing);
+        break;
+    case WaveSynthMode::Polynomial:
+        activePolynomial().fn(amplitude, frequency, out, count, spacing);
+        break;
+    case WaveSynthMode::Exact:
+    default:
+        exactWave(amplitude, frequency, out, count, spacing);
+        break;
+    }
+}
+
+const char *waveSynthKernelName()
+{
+    return activePolynomial().name;
+}
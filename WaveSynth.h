@@ -0,0 +1,78 @@
+#ifndef WAVE_SYNTH_H
+#define WAVE_SYNTH_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// How wave samples amplitude * sin(frequency * t) are computed.
+//
+// A wave covers t in [0, WAVE_DURATION) whatever its sample count: sample i
+// is taken at t = i * spacing, spacing = sampleSpacing(sampleCount). At
+// DEFAULT_WAVE_SAMPLES samples the spacing is exactly 1, so t = i, and a wave
+// with k times as many samples contains the default wave's samples at every
+// k-th index.
+//
+// Every mode keeps |sample| <= |amplitude|, which AmplitudeBound relies on to
+// prune pairs; the fast modes clamp sin to [-1, 1] before scaling.
+enum class WaveSynthMode : uint8_t
+{
+    // One libm sin() per sample, of the phase frequency * t rounded to float
+    // as the original code computes it. The reference for the other modes.
+    Exact,
+
+    // Rotates a (cos, sin) phasor by frequency * spacing radians per sample
+    // in double, re-synchronized with libm every WAVE_SYNTH_RESYNC samples.
+    // The phase is the exact product frequency * t, so samples differ from
+    // Exact by the float rounding Exact applies to the phase: up to about
+    // |amplitude| * ulp(frequency * t) / 2, i.e. ~3% of the amplitude for
+    // phases near 8e5 radians. Two libm calls per WAVE_SYNTH_RESYNC samples.
+    Recurrence,
+
+    // Exact's float phase, reduced to [-pi/4, pi/4] in double (three-part
+    // Cody-Waite) and evaluated with fdlibm's sin/cos polynomials, 4 or 8
+    // samples at a time with AVX2 or AVX-512. Before the final rounding to
+    // float the error is below 1e-15 * |amplitude|, so samples agree with
+    // Exact to within one float ulp (and are almost always bit-identical).
+    // Phases beyond WAVE_SYNTH_POLY_MAX_PHASE, or NaN, fall back to libm.
+    Polynomial,
+};
+
+// Samples between two re-synchronizations in Recurrence mode
+constexpr size_t WAVE_SYNTH_RESYNC = 64;
+
+// Time span covered by every wave
+constexpr double WAVE_DURATION = 360.0;
+
+// Time between two samples of a wave with `sampleCount` samples
+inline float sampleSpacing(size_t sampleCount)
+{
+    return static_cast<float>(WAVE_DURATION / static_cast<double>(sampleCount));
+}
+
+// Largest |frequency * t| the polynomial range reduction handles exactly
+constexpr double WAVE_SYNTH_POLY_MAX_PHASE = 1.6e6;
+
+const char *waveSynthModeName(WaveSynthMode mode);
+
+// Accepts "exact", "recurrence" or "polynomial"
+bool parseWaveSynthMode(const std::string &text, WaveSynthMode &mode);
+
+// Single sample in Exact mode: float time and phase, double sin, product
+// rounded to float
+inline float exactWaveSample(float amplitude, float frequency, int i, float spacing = 1.0f)
+{
+    const float t = static_cast<float>(i) * spacing;
+    const float phase = frequency * t;
+    return static_cast<float>(amplitude * std::sin(static_cast<double>(phase)));
+}
+
+// Write samples 0..count-1 of one wave, `spacing` apart in time, to `out`
+void synthesizeWave(float amplitude, float frequency, float *out, size_t count, WaveSynthMode mode,
+                    float spacing = 1.0f);
+
+// Instruction set Polynomial mode picked at runtime ("avx512", "avx2" or "scalar")
+const char *waveSynthKernelName();
+
+#endif // WAVE_SYNTH_H
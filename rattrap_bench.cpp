@@ -0,0 +1,619 @@
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "Particles.h"
+#include "Simulation.h"
+#include "AnomalyCsv.h"
+#include "AnomalyStore.h"
+#include "Catalog.h"
+#include "InteractionSet.h"
+
+// rattrap_bench: throughput of the simulation hot paths.
+//
+//   kernels  - wave generation, combination and breach detection per sample count
+//   sweep    - every pair of a synthetic catalog (10^2 .. 10^5 particles), and Coil::interact
+//   io       - CSV and compact (.rtc) writing through CollisionWriter and reading back,
+//              and loading particle catalogs (CSV and binary .rtp)
+//
+// Results go to the console and, unless --benchmark_out is given, to
+// rattrap_bench.json in the working directory. Rates are reported as
+// items_per_second/bytes_per_second plus a "pairs/s" counter for the sweeps.
+// Pass --benchmark_filter=... to run a subset: on a single core the 10^4
+// sweep takes about a minute and the 10^5 sweep over an hour.
+
+namespace
+{
+    constexpr int COLLISIONS_PER_FILE = 1000;
+
+    // Deterministic catalog with amplitudes and frequencies in the range of the
+    // built-in particles, so roughly the same fraction of pairs breaches
+    std::vector<Particle> syntheticCatalog(size_t count)
+    {
+        std::mt19937 rng(12345);
+        std::uniform_real_distribution<float> amplitude(0.1f, 1.0f);
+        std::uniform_real_distribution<float> frequency(500.0f, 2200.0f);
+
+        std::vector<Particle> particles;
+        particles.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            particles.emplace_back(ParticleType::Unknown, "Synthetic " + std::to_string(i), 1.0e-28, 0.0, 1.0e-13,
+                                   0.0f, 0.0f, 0.0f, amplitude(rng), frequency(rng));
+        }
+        return particles;
+    }
+
+    std::vector<float> syntheticWave(size_t samples, float amplitude, float frequency)
+    {
+        std::vector<float> wave(samples);
+        for (size_t i = 0; i < samples; ++i)
+            wave[i] = Particle::waveSample(amplitude, frequency, static_cast<int>(i));
+        return wave;
+    }
+
+    std::string scratchFile(const char *name)
+    {
+        return "rattrap_bench_" + std::to_string(getpid()) + "_" + name;
+    }
+
+    long fileSize(const std::string &fileName)
+    {
+        std::FILE *file = std::fopen(fileName.c_str(), "rb");
+        if (!file)
+            return 0;
+        std::fseek(file, 0, SEEK_END);
+        long size = std::ftell(file);
+        std::fclose(file);
+        return size;
+    }
+
+    // Writes a collisions.csv with COLLISIONS_PER_FILE rows for the read benchmarks
+    std::string writeSampleCsv(const char *name)
+    {
+        const std::string fileName = scratchFile(name);
+        std::remove(fileName.c_str());
+        std::vector<Particle> particles = syntheticCatalog(64);
+        CollisionWriter writer(fileName, scratchFile("unused.log"));
+        for (int k = 0; k < COLLISIONS_PER_FILE; ++k)
+        {
+            const Particle &p1 = particles[k % particles.size()];
+            const Particle &p2 = particles[(k * 7 + 1) % particles.size()];
+            CollisionInfo collision;
+            collision.particle1 = p1.name;
+            collision.particle2 = p2.name;
+            collision.interactionInfo = "Anomaly Detected";
+            collision.waveData = Particle::combineWaves(p1.generateWave(), p2.generateWave());
+            writer.write(std::move(collision));
+        }
+        writer.close();
+        return fileName;
+    }
+
+    // Discards everything written to it; keeps Coil's console output out of the timings
+    class NullBuffer : public std::streambuf
+    {
+    protected:
+        int overflow(int c) override { return c; }
+        std::streamsize xsputn(const char *, std::streamsize count) override { return count; }
+    };
+}
+
+// --- Allocation counting ------------------------------------------------------
+//
+// Every operator new in this binary is counted, so the sweeps can report how
+// many heap allocations they make (the pair loop itself should make none).
+
+namespace
+{
+    std::atomic<uint64_t> allocationCount{0};
+
+    void *countedAllocate(size_t size, size_t alignment)
+    {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        size = size == 0 ? 1 : size;
+        void *pointer = alignment <= alignof(std::max_align_t)
+                            ? std::malloc(size)
+                            : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+        if (!pointer)
+            throw std::bad_alloc();
+        return pointer;
+    }
+}
+
+void *operator new(size_t size) { return countedAllocate(size, 0); }
+void *operator new[](size_t size) { return countedAllocate(size, 0); }
+void *operator new(size_t size, std::align_val_t alignment) { return countedAllocate(size, static_cast<size_t>(alignment)); }
+void *operator new[](size_t size, std::align_val_t alignment) { return countedAllocate(size, static_cast<size_t>(alignment)); }
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete[](void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, size_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, size_t) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete(void *pointer, size_t, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, size_t, std::align_val_t) noexcept { std::free(pointer); }
+
+// --- Kernels -----------------------------------------------------------------
+
+static void BM_GenerateWave(benchmark::State &state)
+{
+    const size_t samples = static_cast<size_t>(state.range(0));
+    std::vector<float> wave(samples);
+    for (auto _ : state)
+    {
+        for (size_t i = 0; i < samples; ++i)
+            wave[i] = Particle::waveSample(0.7f, 1250.0f, static_cast<int>(i));
+        benchmark::DoNotOptimize(wave.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * samples);
+}
+BENCHMARK(BM_GenerateWave)->RangeMultiplier(4)->Range(90, 5760);
+
+static void BM_CombineWaves(benchmark::State &state)
+{
+    const size_t samples = static_cast<size_t>(state.range(0));
+    std::vector<float> wave1 = syntheticWave(samples, 0.6f, 500.0f);
+    std::vector<float> wave2 = syntheticWave(samples, 0.9f, 1000.0f);
+    for (auto _ : state)
+    {
+        std::vector<float> combined = Particle::combineWaves(wave1, wave2);
+        benchmark::DoNotOptimize(combined.data());
+    }
+    state.SetItemsProcessed(state.iterations() * samples);
+    state.SetBytesProcessed(state.iterations() * samples * 3 * sizeof(float));
+}
+BENCHMARK(BM_CombineWaves)->RangeMultiplier(4)->Range(90, 5760);
+
+// A whole catalog's waves, as WaveBank::sync generates them; argument is the WaveSynthMode
+static void BM_WaveSynth(benchmark::State &state)
+{
+    const WaveSynthMode mode = static_cast<WaveSynthMode>(state.range(0));
+    const std::vector<Particle> particles = syntheticCatalog(1000);
+    DynamicWave wave(Particle::WAVE_SAMPLES);
+    for (auto _ : state)
+    {
+        for (const Particle &p : particles)
+            synthesizeWave(p.amplitude, p.frequency, wave.data(), wave.size(), mode);
+        benchmark::DoNotOptimize(wave.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * particles.size() * wave.size());
+    state.SetLabel(mode == WaveSynthMode::Polynomial ? std::string("polynomial/") + waveSynthKernelName()
+                                                     : std::string(waveSynthModeName(mode)));
+}
+BENCHMARK(BM_WaveSynth)->DenseRange(0, 2);
+
+// The same three steps on Wave<N> and spans: no allocation at all
+static void BM_WaveSpans(benchmark::State &state)
+{
+    const Particle p1(ParticleType::Unknown, "A", 0, 0, 0, 0, 0, 0, 0.6f, 500.0f);
+    const Particle p2(ParticleType::Unknown, "B", 0, 0, 0, 0, 0, 0, 0.9f, 1000.0f);
+    Wave<> combined;
+    BreachBuffer<> breaches;
+    const uint64_t allocationsBefore = allocationCount.load();
+    for (auto _ : state)
+    {
+        const Wave<> wave1 = p1.wave();
+        const Wave<> wave2 = p2.wave();
+        Particle::combineWaves(wave1, wave2, combined);
+        benchmark::DoNotOptimize(Particle::checkAmplitudeBreach(combined, BreachSpan(breaches.data(), breaches.size())));
+    }
+    state.SetItemsProcessed(state.iterations() * Wave<>::size());
+    state.counters["allocs/iter"] = static_cast<double>(allocationCount.load() - allocationsBefore) / state.iterations();
+}
+BENCHMARK(BM_WaveSpans);
+
+static void BM_CheckAmplitudeBreach(benchmark::State &state)
+{
+    const size_t samples = static_cast<size_t>(state.range(0));
+    std::vector<float> combined = Particle::combineWaves(syntheticWave(samples, 0.6f, 500.0f),
+                                                         syntheticWave(samples, 0.9f, 1000.0f));
+    for (auto _ : state)
+    {
+        auto breachPoints = Particle::checkAmplitudeBreach(combined);
+        benchmark::DoNotOptimize(breachPoints.data());
+    }
+    state.SetItemsProcessed(state.iterations() * samples);
+    state.SetBytesProcessed(state.iterations() * samples * sizeof(float));
+}
+BENCHMARK(BM_CheckAmplitudeBreach)->RangeMultiplier(4)->Range(90, 5760);
+
+// The fused pass the sweep runs for every pair: count breaches without storing anything
+static void BM_DetectBreaches(benchmark::State &state)
+{
+    const size_t samples = static_cast<size_t>(state.range(0));
+    WaveBank waves(samples);
+    std::vector<Particle> particles = {
+        Particle(ParticleType::Unknown, "A", 0, 0, 0, 0, 0, 0, 0.6f, 500.0f),
+        Particle(ParticleType::Unknown, "B", 0, 0, 0, 0, 0, 0, 0.9f, 1000.0f)};
+    waves.sync(particles);
+    for (auto _ : state)
+    {
+        size_t breaches = combineAndDetectBreaches(waves.wave(0), waves.wave(1), samples,
+                                                   Particle::AMPLITUDE_THRESHOLD, nullptr, nullptr);
+        benchmark::DoNotOptimize(breaches);
+    }
+    state.SetItemsProcessed(state.iterations() * samples);
+    state.SetBytesProcessed(state.iterations() * samples * 2 * sizeof(float));
+    state.SetLabel(waveKernelName());
+}
+BENCHMARK(BM_DetectBreaches)->RangeMultiplier(4)->Range(90, 5760);
+
+// --- Sweeps ------------------------------------------------------------------
+
+// Every pair of the catalog through sweepAnomalies on all cores; anomalies are counted and dropped
+static void BM_Sweep(benchmark::State &state)
+{
+    const size_t count = static_cast<size_t>(state.range(0));
+    std::vector<Particle> particles = syntheticCatalog(count);
+    WaveBank waves(Particle::WAVE_SAMPLES);
+    waves.sync(particles);
+    ThreadPool pool;
+    SweepWorkspace workspace;
+    SweepOptions options;
+    options.prune = state.range(1) != 0;
+    options.workspace = &workspace;
+
+    // One untimed sweep grows the workspace; allocs/pair counts the rest
+    const double pairs = static_cast<double>(count) * (count - 1) / 2;
+    size_t anomalies = 0;
+    sweepAnomalies(pool, waves, 0, Particle::AMPLITUDE_THRESHOLD, options, [&](PairAnomaly &) { ++anomalies; });
+    const uint64_t allocationsBefore = allocationCount.load();
+    for (auto _ : state)
+    {
+        anomalies = 0;
+        sweepAnomalies(pool, waves, 0, Particle::AMPLITUDE_THRESHOLD, options,
+                       [&](PairAnomaly &) { ++anomalies; });
+    }
+    const uint64_t allocations = allocationCount.load() - allocationsBefore;
+    state.counters["pairs/s"] = benchmark::Counter(pairs, benchmark::Counter::kIsIterationInvariantRate);
+    state.counters["anomalies"] = static_cast<double>(anomalies);
+    state.counters["allocs/pair"] = static_cast<double>(allocations) / (pairs * state.iterations());
+    state.counters["threads"] = static_cast<double>(pool.size());
+}
+// Second argument: 1 prunes with AmplitudeBound, 0 samples every pair
+BENCHMARK(BM_Sweep)->ArgsProduct({{100, 1000}, {0, 1}})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Sweep)->ArgsProduct({{10000}, {0, 1}})->Iterations(1)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Sweep)->Args({100000, 1})->Iterations(1)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Sweep restricted to an interaction radius through SpatialGrid. Particles
+// fill a cube at unit density and the radius gives about 16 neighbours each,
+// so the work grows as N * 16 rather than N^2 / 2.
+static void BM_SweepGrid(benchmark::State &state)
+{
+    const size_t count = static_cast<size_t>(state.range(0));
+    std::vector<Particle> particles = syntheticCatalog(count);
+    std::mt19937 rng(777);
+    std::uniform_real_distribution<float> position(0.0f, std::cbrt(static_cast<float>(count)));
+    for (Particle &p : particles)
+    {
+        p.x = position(rng);
+        p.y = position(rng);
+        p.z = position(rng);
+    }
+    const ParticleStore store(particles);
+    particles.clear();
+    WaveBank waves(Particle::WAVE_SAMPLES);
+    waves.sync(store);
+    ThreadPool pool;
+
+    SpatialGrid grid(std::cbrt(3.0f * 16.0f / (4.0f * 3.14159265f)));
+    SweepOptions options;
+    options.grid = &grid;
+
+    size_t anomalies = 0;
+    for (auto _ : state)
+    {
+        grid.clear();
+        grid.sync(store);
+        anomalies = 0;
+        sweepAnomalies(pool, waves, 0, Particle::AMPLITUDE_THRESHOLD, options,
+                       [&](PairAnomaly &) { ++anomalies; });
+    }
+    state.counters["particles/s"] = benchmark::Counter(static_cast<double>(count),
+                                                       benchmark::Counter::kIsIterationInvariantRate);
+    state.counters["anomalies"] = static_cast<double>(anomalies);
+}
+BENCHMARK(BM_SweepGrid)->Arg(100000)->Arg(1000000)->Iterations(1)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// 1000 particles at ten times the default resolution. First argument is the
+// coarse stride (1: every sample), second scales frequencies down 10^4 so the
+// Lipschitz bound can certify blocks.
+static void BM_SweepHighRes(benchmark::State &state)
+{
+    const size_t samples = DEFAULT_WAVE_SAMPLES * 10;
+    std::vector<Particle> particles = syntheticCatalog(1000);
+    if (state.range(1) != 0)
+    {
+        for (Particle &p : particles)
+            p.frequency *= 1e-4f;
+    }
+    WaveBank waves(samples);
+    waves.sync(particles);
+    ThreadPool pool;
+    SweepOptions options;
+    options.coarseStride = static_cast<size_t>(state.range(0));
+
+    size_t anomalies = 0;
+    for (auto _ : state)
+    {
+        anomalies = 0;
+        sweepAnomalies(pool, waves, 0, Particle::AMPLITUDE_THRESHOLD, options,
+                       [&](PairAnomaly &) { ++anomalies; });
+    }
+    const double pairs = static_cast<double>(particles.size()) * (particles.size() - 1) / 2;
+    state.counters["pairs/s"] = benchmark::Counter(pairs, benchmark::Counter::kIsIterationInvariantRate);
+    state.counters["anomalies"] = static_cast<double>(anomalies);
+}
+BENCHMARK(BM_SweepHighRes)->ArgsProduct({{1, 10}, {0, 1}})->Iterations(3)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// 10^6 random collisions per iteration. The 100-particle catalog is small
+// enough for the (pair, offset) table; 2000 particles evaluate every draw
+// and tally into the sparse map.
+static void BM_MonteCarlo(benchmark::State &state)
+{
+    const size_t count = static_cast<size_t>(state.range(0));
+    const ParticleStore particles(syntheticCatalog(count));
+    WaveBank waves(Particle::WAVE_SAMPLES);
+    waves.sync(particles);
+    ThreadPool pool;
+    MonteCarloOptions options;
+    options.draws = 1000000;
+
+    PairTally tally;
+    std::string error;
+    for (auto _ : state)
+    {
+        if (!runMonteCarlo(pool, particles, waves, Particle::AMPLITUDE_THRESHOLD, options, tally, error))
+            state.SkipWithError(error.c_str());
+    }
+    state.counters["draws/s"] = benchmark::Counter(static_cast<double>(options.draws),
+                                                   benchmark::Counter::kIsIterationInvariantRate);
+    state.counters["anomaly_rate"] = tally.draws() ? static_cast<double>(tally.anomalies()) / tally.draws() : 0.0;
+    state.counters["threads"] = static_cast<double>(pool.size());
+}
+BENCHMARK(BM_MonteCarlo)->Arg(100)->Arg(2000)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// One generation of Coil::interact, including the particles it creates
+static void BM_CoilInteract(benchmark::State &state)
+{
+    const size_t count = static_cast<size_t>(state.range(0));
+    std::vector<Particle> particles = syntheticCatalog(count);
+
+    NullBuffer null;
+    std::streambuf *console = std::cout.rdbuf(&null);
+    std::ios_base::fmtflags flags = std::cout.flags();
+    std::streamsize precision = std::cout.precision();
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        Coil coil;
+        coil.particles = ParticleStore(particles);
+        coil.threadCount = 0;
+        state.ResumeTiming();
+
+        benchmark::DoNotOptimize(coil.interact());
+    }
+    std::cout.rdbuf(console);
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+
+    const double pairs = static_cast<double>(count) * (count - 1) / 2;
+    state.counters["pairs/s"] = benchmark::Counter(pairs, benchmark::Counter::kIsIterationInvariantRate);
+}
+BENCHMARK(BM_CoilInteract)->Arg(100)->Arg(1000)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Dedup of every pair of the catalog, as checkAndLogInteractions does it
+static void BM_Dedup(benchmark::State &state)
+{
+    const size_t count = static_cast<size_t>(state.range(0));
+    std::vector<Particle> particles = syntheticCatalog(count);
+    for (auto _ : state)
+    {
+        InteractionSet logged;
+        std::vector<uint32_t> ids(count);
+        for (size_t i = 0; i < count; ++i)
+            ids[i] = logged.intern(particles[i].name);
+        for (size_t i = 0; i < count; ++i)
+        {
+            for (size_t j = i + 1; j < count; ++j)
+                benchmark::DoNotOptimize(logged.insert(ids[i], ids[j]));
+        }
+    }
+    const double pairs = static_cast<double>(count) * (count - 1) / 2;
+    state.counters["pairs/s"] = benchmark::Counter(pairs, benchmark::Counter::kIsIterationInvariantRate);
+}
+BENCHMARK(BM_Dedup)->Arg(1000)->Arg(10000)->Unit(benchmark::kMillisecond);
+
+// --- I/O ---------------------------------------------------------------------
+
+// COLLISIONS_PER_FILE collisions between synthetic particles, wave parameters included
+static std::vector<CollisionInfo> sampleCollisions()
+{
+    std::vector<Particle> particles = syntheticCatalog(64);
+    std::vector<CollisionInfo> collisions(COLLISIONS_PER_FILE);
+    for (int k = 0; k < COLLISIONS_PER_FILE; ++k)
+    {
+        const Particle &p1 = particles[k % particles.size()];
+        const Particle &p2 = particles[(k * 7 + 1) % particles.size()];
+        collisions[k].particle1 = p1.name;
+        collisions[k].particle2 = p2.name;
+        collisions[k].interactionInfo = "Anomaly Detected";
+        collisions[k].waveData = Particle::combineWaves(p1.generateWave(), p2.generateWave());
+        collisions[k].amplitude1 = p1.amplitude;
+        collisions[k].frequency1 = p1.frequency;
+        collisions[k].amplitude2 = p2.amplitude;
+        collisions[k].frequency2 = p2.frequency;
+    }
+    return collisions;
+}
+
+// logNewCollision into a fresh collisions.csv, including the final flush
+static void BM_CsvWrite(benchmark::State &state)
+{
+    const std::vector<CollisionInfo> collisions = sampleCollisions();
+    const std::string fileName = scratchFile("write.csv");
+    const std::string logName = scratchFile("write.log");
+    long bytes = 0;
+    for (auto _ : state)
+    {
+        std::remove(fileName.c_str());
+        CollisionWriter writer(fileName, logName);
+        for (const CollisionInfo &collision : collisions)
+            logNewCollision(collision, writer);
+        writer.close();
+        bytes = fileSize(fileName);
+    }
+    std::remove(fileName.c_str());
+    std::remove(logName.c_str());
+
+    state.SetItemsProcessed(state.iterations() * COLLISIONS_PER_FILE);
+    state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK(BM_CsvWrite)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Eager parse of a whole collisions.csv, as the visualizer used to do
+static void BM_CsvRead(benchmark::State &state)
+{
+    const std::string fileName = writeSampleCsv("read.csv");
+    const long bytes = fileSize(fileName);
+    for (auto _ : state)
+    {
+        std::vector<Anomaly> anomalies = loadAnomalyCsv(fileName, static_cast<size_t>(state.range(0)));
+        benchmark::DoNotOptimize(anomalies.data());
+    }
+    std::remove(fileName.c_str());
+    std::remove(scratchFile("unused.log").c_str());
+
+    state.SetItemsProcessed(state.iterations() * COLLISIONS_PER_FILE);
+    state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK(BM_CsvRead)->Arg(1)->Arg(0)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// AnomalyVisualizer::loadAnomalies: index the file and decode every record once
+static void BM_AnomalyStoreLoad(benchmark::State &state)
+{
+    const std::string fileName = writeSampleCsv("store.csv");
+    const std::string indexName = fileName + ".idx";
+    const long bytes = fileSize(fileName);
+    for (auto _ : state)
+    {
+        std::remove(indexName.c_str()); // Always measure the cold scan
+        AnomalyStore store(0, 0);
+        store.open(fileName);
+        for (size_t i = 0; i < store.size(); ++i)
+            benchmark::DoNotOptimize(store.get(i).get());
+    }
+    std::remove(fileName.c_str());
+    std::remove(indexName.c_str());
+    std::remove(scratchFile("unused.log").c_str());
+
+    state.SetItemsProcessed(state.iterations() * COLLISIONS_PER_FILE);
+    state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK(BM_AnomalyStoreLoad)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// The same collisions as parametric .rtc records, written and then decoded
+// through AnomalyStore, which rebuilds every wave and its breach points
+static void BM_CompactRoundTrip(benchmark::State &state)
+{
+    const std::vector<CollisionInfo> collisions = sampleCollisions();
+    const std::string fileName = scratchFile("compact.rtc");
+    const std::string logName = scratchFile("compact.log");
+    CollisionWriter::Options options;
+    options.writeCsv = false;
+    options.compactFileName = fileName;
+    long bytes = 0;
+    for (auto _ : state)
+    {
+        std::remove(fileName.c_str());
+        {
+            CollisionWriter writer(scratchFile("unused.csv"), logName, options);
+            for (const CollisionInfo &collision : collisions)
+                logNewCollision(collision, writer);
+        }
+        bytes = fileSize(fileName);
+
+        AnomalyStore store(0, 0);
+        store.open(fileName);
+        for (size_t i = 0; i < store.size(); ++i)
+            benchmark::DoNotOptimize(store.get(i).get());
+    }
+    std::remove(fileName.c_str());
+    std::remove(logName.c_str());
+
+    state.SetItemsProcessed(state.iterations() * COLLISIONS_PER_FILE);
+    state.SetBytesProcessed(state.iterations() * bytes);
+    state.counters["bytes/record"] = static_cast<double>(bytes) / COLLISIONS_PER_FILE;
+}
+BENCHMARK(BM_CompactRoundTrip)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Load of a 10^5 or 10^6 particle catalog through loadCatalog on all cores;
+// second argument is 0 for a CSV catalog, 1 for a binary one
+static void BM_CatalogLoad(benchmark::State &state)
+{
+    const size_t count = static_cast<size_t>(state.range(0));
+    const bool binary = state.range(1) != 0;
+    const std::string fileName = scratchFile(binary ? "catalog.rtp" : "catalog.csv");
+    {
+        const ParticleStore particles(syntheticCatalog(count));
+        if (!(binary ? saveCatalog(fileName, particles) : saveCatalogCsv(fileName, particles)))
+        {
+            state.SkipWithError("cannot write the catalog");
+            return;
+        }
+    }
+    const long bytes = fileSize(fileName);
+    ThreadPool pool;
+
+    for (auto _ : state)
+    {
+        ParticleStore particles;
+        std::string error;
+        if (!loadCatalog(fileName, particles, error, &pool))
+        {
+            state.SkipWithError(error.c_str());
+            break;
+        }
+        benchmark::DoNotOptimize(particles.amplitudes());
+    }
+    std::remove(fileName.c_str());
+
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(count));
+    state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK(BM_CatalogLoad)->ArgsProduct({{100000, 1000000}, {0, 1}})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+int main(int argc, char **argv)
+{
+    // Default to a JSON report next to the console output
+    std::vector<char *> args(argv, argv + argc);
+    bool hasOut = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::string(argv[i]).rfind("--benchmark_out=", 0) == 0)
+            hasOut = true;
+    }
+    std::string out = "--benchmark_out=rattrap_bench.json";
+    std::string format = "--benchmark_out_format=json";
+    if (!hasOut)
+    {
+        args.push_back(&out[0]);
+        args.push_back(&format[0]);
+    }
+    int count = static_cast<int>(args.size());
+
+    benchmark::Initialize(&count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(count, args.data()))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,26 @@
+#include <iostream>
+#include "Simulation.h"
+
+// rattrap-cli: headless batch runs of the simulation. Takes the same flags as
+// the viewer; --no-viz is accepted and implied, and --live has no effect.
+//
+// compile: g++ -std=c++17 -O2 rattrap_cli.cpp Simulation.cpp Catalog.cpp Metrics.cpp NameInterner.cpp InteractionSet.cpp ParticleStore.cpp AmplitudeBound.cpp CoarseBreachDetector.cpp SpatialGrid.cpp AnomalyStream.cpp MonteCarlo.cpp AliasTable.cpp WaveBank.cpp WaveSynth.cpp WaveKernels.cpp ThreadPool.cpp CollisionWriter.cpp AnomalyCsv.cpp AnomalyFile.cpp CompactAnomalyFile.cpp Checkpoint.cpp MappedFile.cpp AnomalyStore.cpp -o rattrap-cli -lpthread
+
+int main(int argc, char **argv)
+{
+    RunOptions options;
+    std::string error;
+    if (!parseRunOptions(argc, argv, options, error))
+    {
+        std::cerr << "Error: " << error << std::endl;
+        printUsage(std::cerr, argv[0]);
+        return 1;
+    }
+    if (options.showHelp)
+    {
+        printUsage(std::cout, argv[0]);
+        return 0;
+    }
+
+    return runSimulation(options) ? 0 : 1;
+}
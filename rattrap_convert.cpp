@@ -0,0 +1,71 @@
+#include <iostream>
+#include <string>
+#include "AnomalyFile.h"
+#include "Catalog.h"
+#include "CompactAnomalyFile.h"
+#include "ThreadPool.h"
+
+namespace
+{
+    bool endsWith(const std::string &text, const char *suffix)
+    {
+        const std::string tail = suffix;
+        return text.size() >= tail.size() && text.compare(text.size() - tail.size(), tail.size(), tail) == 0;
+    }
+
+    // Particle catalogs: a binary .rtp input is written out as CSV, anything
+    // else is read as a catalog (CSV or binary) and written as .rtp
+    bool convertCatalog(const std::string &input, const std::string &output, bool toBinary)
+    {
+        ThreadPool pool;
+        ParticleStore particles;
+        std::string error;
+        if (!loadCatalog(input, particles, error, &pool))
+        {
+            std::cerr << "Error: " << error << std::endl;
+            return false;
+        }
+        return toBinary ? saveCatalog(output, particles) : saveCatalogCsv(output, particles);
+    }
+}
+
+// Converts anomaly logs between collisions.csv and the binary .rta format.
+// The direction is picked from the input: .rta files are written out as CSV,
+// anything else is read as CSV and written as .rta. Compact .rtc files are
+// expanded to .rta when the output name ends in ".rta", else to CSV.
+// Particle catalogs convert between CSV and the binary .rtp format: an .rtp
+// input becomes a CSV catalog, and an output name ending in ".rtp" asks for one.
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "Usage: rattrap-convert <input.csv|input.rta|input.rtc|input.rtp> <output>" << std::endl;
+        return 2;
+    }
+
+    const std::string input = argv[1];
+    const std::string output = argv[2];
+
+    bool ok;
+    if (isCatalogFile(input) || endsWith(output, ".rtp"))
+    {
+        ok = convertCatalog(input, output, endsWith(output, ".rtp"));
+    }
+    else if (CompactAnomalyFileReader::isCompactAnomalyFile(input))
+    {
+        const bool toBinary = endsWith(output, ".rta");
+        ok = toBinary ? convertCompactAnomalyFileToAnomalyFile(input, output)
+                      : convertCompactAnomalyFileToCsv(input, output);
+    }
+    else
+    {
+        ok = AnomalyFileReader::isAnomalyFile(input) ? convertAnomalyFileToCsv(input, output)
+                                                     : convertCsvToAnomalyFile(input, output);
+    }
+    if (!ok)
+    {
+        std::cerr << "Conversion of " << input << " failed." << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,192 @@
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Particles.h"
+
+// rattrap_tests: checks run by ctest.
+//
+//   allocations - once its buffers have grown, a sweep through a SweepWorkspace
+//                 and the span-based wave functions make no heap allocations
+//
+// Exits with 0 when every check passes; failures are reported on std::cerr.
+
+// --- Allocation counting ------------------------------------------------------
+//
+// Every operator new in this binary is counted, so a check can tell whether
+// the code it runs touched the heap.
+
+namespace
+{
+    std::atomic<uint64_t> allocationCount{0};
+
+    void *countedAllocate(size_t size, size_t alignment)
+    {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        size = size == 0 ? 1 : size;
+        void *pointer = alignment <= alignof(std::max_align_t)
+                            ? std::malloc(size)
+                            : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+        if (!pointer)
+            throw std::bad_alloc();
+        return pointer;
+    }
+}
+
+void *operator new(size_t size) { return countedAllocate(size, 0); }
+void *operator new[](size_t size) { return countedAllocate(size, 0); }
+void *operator new(size_t size, std::align_val_t alignment) { return countedAllocate(size, static_cast<size_t>(alignment)); }
+void *operator new[](size_t size, std::align_val_t alignment) { return countedAllocate(size, static_cast<size_t>(alignment)); }
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete[](void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, size_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, size_t) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete(void *pointer, size_t, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, size_t, std::align_val_t) noexcept { std::free(pointer); }
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool passed, const std::string &what)
+    {
+        if (passed)
+            return;
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+
+    // Same kind of catalog rattrap_bench sweeps: amplitudes and frequencies in
+    // the range of the built-in particles, positions in a cube at unit density
+    std::vector<Particle> syntheticCatalog(size_t count)
+    {
+        std::mt19937 rng(12345);
+        std::uniform_real_distribution<float> amplitude(0.1f, 1.0f);
+        std::uniform_real_distribution<float> frequency(500.0f, 2200.0f);
+        std::uniform_real_distribution<float> position(0.0f, std::cbrt(static_cast<float>(count)));
+
+        std::vector<Particle> particles;
+        particles.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            particles.emplace_back(ParticleType::Unknown, "Synthetic " + std::to_string(i), 1.0e-28, 0.0, 1.0e-13,
+                                   position(rng), position(rng), position(rng), amplitude(rng), frequency(rng));
+        }
+        return particles;
+    }
+
+    // Run one task on every thread of the pool at once, so each of them has
+    // made its one-off allocations (per-thread metrics) before counting starts
+    void touchEveryThread(ThreadPool &pool)
+    {
+        std::atomic<size_t> arrived{0};
+        auto task = [&](size_t) {
+            RATTRAP_COUNT(PairsEvaluated, 0);
+            arrived.fetch_add(1);
+            while (arrived.load() < pool.size())
+                std::this_thread::yield();
+        };
+        pool.run(pool.size(), std::ref(task));
+    }
+
+    void checkWaveSpans()
+    {
+        const Particle p1(ParticleType::Unknown, "p1", 1.0e-28, 0.0, 1.0e-13, 0.0f, 0.0f, 0.0f, 0.8f, 1000.0f);
+        const Particle p2(ParticleType::Unknown, "p2", 1.0e-28, 0.0, 1.0e-13, 0.0f, 0.0f, 0.0f, 0.7f, 1500.0f);
+
+        const uint64_t before = allocationCount.load();
+        const Wave<> wave1 = p1.wave();
+        const Wave<> wave2 = p2.wave();
+        Wave<> combined;
+        BreachBuffer<DEFAULT_WAVE_SAMPLES> breaches;
+        Particle::combineWaves(wave1, wave2, combined);
+        const size_t found = Particle::checkAmplitudeBreach(combined.span(), BreachSpan(breaches.data(), breaches.size()));
+        const uint64_t allocations = allocationCount.load() - before;
+
+        check(found > 0, "span path: the test waves should breach");
+        check(allocations == 0, "span path: " + std::to_string(allocations) + " allocations");
+    }
+
+    // Sweep `waves` a few times through one workspace; every sweep after the
+    // first must leave the allocation count alone
+    void checkSweep(const std::string &name, ThreadPool &pool, const WaveBank &waves, SweepOptions options)
+    {
+        SweepWorkspace workspace;
+        options.workspace = &workspace;
+        options.pairsPerChunk = 256;
+        options.chunksPerBatch = 8;
+
+        size_t anomalies = 0;
+        auto consume = [&](PairAnomaly &) { ++anomalies; };
+        sweepAnomalies(pool, waves, 0, Particle::AMPLITUDE_THRESHOLD, options, consume);
+        const size_t expected = anomalies;
+
+        bool consistent = true;
+        const uint64_t before = allocationCount.load();
+        for (int repeat = 0; repeat < 3; ++repeat)
+        {
+            anomalies = 0;
+            sweepAnomalies(pool, waves, 0, Particle::AMPLITUDE_THRESHOLD, options, consume);
+            consistent = consistent && anomalies == expected;
+        }
+        const uint64_t allocations = allocationCount.load() - before;
+
+        check(expected > 0, name + ": the catalog should produce anomalies");
+        check(consistent, name + ": sweeps disagree on the anomaly count");
+        check(allocations == 0, name + ": " + std::to_string(allocations) + " allocations in steady state");
+    }
+
+    void checkSweeps(size_t threadCount)
+    {
+        const std::vector<Particle> particles = syntheticCatalog(600);
+        const ParticleStore store(particles);
+        WaveBank waves(Particle::WAVE_SAMPLES);
+        waves.sync(store);
+        WaveBank fineWaves(256);
+        fineWaves.sync(store);
+        SpatialGrid grid(3.0f);
+        grid.sync(store);
+
+        ThreadPool pool(threadCount);
+        touchEveryThread(pool);
+        const std::string threads = " (" + std::to_string(pool.size()) + " threads)";
+
+        SweepOptions every;
+        every.prune = false;
+        checkSweep("every pair" + threads, pool, waves, every);
+
+        SweepOptions pruned;
+        checkSweep("pruned" + threads, pool, waves, pruned);
+
+        SweepOptions coarse;
+        coarse.coarseStride = 16;
+        checkSweep("coarse-to-fine" + threads, pool, fineWaves, coarse);
+
+        SweepOptions nearby;
+        nearby.grid = &grid;
+        checkSweep("grid" + threads, pool, waves, nearby);
+    }
+}
+
+int main()
+{
+    checkWaveSpans();
+    checkSweeps(1);
+    checkSweeps(3);
+
+    if (failures > 0)
+    {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}